@@ -14,34 +14,76 @@
 #include <stack>
 
 #include "parser_iface.h"
+#include "fe_numeric.h"
 
 using namespace std;
 
+/**
+ * Nodes with more children than this get an index by child name on the first
+ * named lookup (see FE_XMLNode::next_child).
+ */
+#define FE_XMLNODE_INDEX_THRESHOLD 8
+
 class FE_XMLNode : public FE_ParsedNode {
   private:
+    /**
+     * Index of the children by name: an open addressing table with one slot
+     * per distinct name, keyed by its hash, and for every child the position
+     * of the next child of the same name (-1 for the last one).
+     */
+    struct ChildIndex {
+        struct Slot {
+            unsigned int hash;
+            /** Position of the first child of the name, -1 for a free slot */
+            int first;
+            unsigned int count;
+        };
+        vector<Slot> slots;
+        vector<int> next;
+    };
+
+    /** An attribute value along with its parsed forms */
+    struct Attribute {
+        string value;
+        FE_ValueCache cache;
+    };
+    typedef map<string,Attribute> AttributeMap;
+
     string _element;
-    map<string,string> _attribute;
+    AttributeMap _attribute;
     FE_XMLNode **_child;
     int children;
     int _child_size;
     string _text;
+    FE_ValueCache _text_cache;
     static string empty_value;
 
+    /** Built lazily by named lookups on wide nodes. Dropped by add_child. */
+    mutable ChildIndex *_index;
+
+    const ChildIndex::Slot *indexed_children(const string &name) const;
+
   public:
     FE_XMLNode(const string &name);
     ~FE_XMLNode();
 
-    const string &text() const;
+    virtual const string &text() const;
 
     void append_text(const char *fragment);
 
+    void append_text(const char *fragment, size_t length);
+
     void add_attribute(const char *name, const char *value);
 
+    void add_attribute(const FE_StringRef &name, const FE_StringRef &value);
+
     unsigned int attribute_count() const;
     list<string> attributes() const;
 
     FE_XMLNode &add_child(const char *element);
 
+    FE_XMLNode &add_child(const string &element);
+
     //Debug
     void print(int indent = 0) const;
 
@@ -53,6 +95,20 @@ class FE_XMLNode : public FE_ParsedNode {
 
     virtual list<const FE_ParsedNode *> get_children(const string &name) const;
 
+    /**
+     * See FE_ParsedNode::next_child. Nodes with more than
+     * FE_XMLNODE_INDEX_THRESHOLD children build an index by name on the first
+     * call. After that, finding the first match takes one hash of the name and
+     * usually one probe, and every further match follows a link, whatever the
+     * number of children.
+     * Building the index modifies the node, so do not make the first lookup on
+     * a node from two threads at once.
+     */
+    virtual const FE_ParsedNode *next_child(const string &name,
+                                            unsigned int &cursor) const;
+
+    virtual unsigned int count_children(const string &name) const;
+
     virtual bool has_property(const string &name) const;
 
     virtual const string &get_string_property(const string &name) const;
@@ -62,6 +118,12 @@ class FE_XMLNode : public FE_ParsedNode {
     virtual double get_double_property(const string &name, bool *error = NULL) const;
 
     virtual bool get_bool_property(const string &name, bool *error = NULL) const;
+
+    virtual long get_long_text(bool *error = NULL) const;
+
+    virtual double get_double_text(bool *error = NULL) const;
+
+    virtual bool get_bool_text(bool *error = NULL) const;
 };
 
 class FE_XMLParser : public FE_Parser {
@@ -75,6 +137,9 @@ class FE_XMLParser : public FE_Parser {
 
     FE_ParsedNode *parse(const string &document);
 
+    enum FE_event_status parse_events(const string &document,
+                                      FE_ParseEvents &events);
+
     void push(FE_XMLNode &node);
 
     void pop();
@@ -0,0 +1,90 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#ifndef FAST_XML_PARSER_H
+#define FAST_XML_PARSER_H
+
+#include <string>
+#include <vector>
+
+#include "parser_iface.h"
+#include "expat_parser.h"
+
+using namespace std;
+
+/**
+ * A tokenizer specialized for Fire Eagle responses. It handles the subset of
+ * XML that Fire Eagle actually sends: UTF-8 documents with elements,
+ * attributes, text, the predefined and numeric character references,
+ * comments, processing instructions and CDATA sections. Markup is located
+ * with a vectorized scan (SSE2 where available) for '<', '>', '"' and '&',
+ * and node names are classified with FE_lookup_node_id as they are read.
+ *
+ * Anything outside that subset (a DOCTYPE, a non UTF-8 encoding, carriage
+ * returns needing end-of-line normalization) makes FE_XMLScanner::scan return
+ * FE_EVENTS_UNSUPPORTED before the first event. Entity references other than
+ * the predefined ones can only be declared in a DOCTYPE, so without one they
+ * are errors, as they are for expat: scan returns FE_EVENTS_FAILED and there
+ * is no fallback. The scanner checks tag nesting, but it is not a validating
+ * parser. Use FE_FastXMLParser to get the expat fallback for free.
+ */
+class FE_XMLScanner {
+  private:
+    /** An element waiting for its end tag */
+    struct OpenElement {
+        FE_StringRef name;
+        enum FE_node_id id;
+    };
+
+    /** Attribute values that needed decoding (references, normalization). */
+    string scratch;
+    /** Attributes of the start tag being read. */
+    vector<FE_EventAttribute> attrs;
+    /** Offset of each value in scratch, or string::npos if it points into
+     * the document. */
+    vector<size_t> value_offset;
+    /** The open elements, to verify the end tags. */
+    vector<OpenElement> open;
+
+  public:
+    /**
+     * Tokenize a document.
+     * @param document Start of the document.
+     * @param length Length of the document.
+     * @param events Callbacks.
+     * @return FE_EVENTS_DONE, FE_EVENTS_STOPPED, FE_EVENTS_FAILED when the
+     * document is not well formed, or FE_EVENTS_UNSUPPORTED when the
+     * document uses XML features the scanner does not handle. Events may
+     * have been sent before FE_EVENTS_FAILED, but never before
+     * FE_EVENTS_UNSUPPORTED.
+     */
+    enum FE_event_status scan(const char *document, size_t length,
+                              FE_ParseEvents &events);
+};
+
+/**
+ * A FE_Parser that builds FE_XMLNode trees (same as FE_XMLParser) with
+ * FE_XMLScanner. Falls back to FE_XMLParser (expat) for documents the
+ * scanner cannot handle, so the result is always what FE_XMLParser would
+ * have produced. parse_events falls back only for those documents, so every
+ * event is delivered once; a malformed document is reported as
+ * FE_EVENTS_FAILED.
+ */
+class FE_FastXMLParser : public FE_Parser {
+  private:
+    FE_XMLScanner scanner;
+
+  public:
+    FE_FastXMLParser();
+    ~FE_FastXMLParser();
+
+    FE_ParsedNode *parse(const string &document);
+
+    enum FE_event_status parse_events(const string &document,
+                                      FE_ParseEvents &events);
+};
+
+#endif /* FAST_XML_PARSER_H */
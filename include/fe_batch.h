@@ -0,0 +1,194 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#ifndef FE_BATCH_H
+#define FE_BATCH_H
+
+#include <string>
+#include <vector>
+
+#include "fire_objects.h"
+#include "fe_intern.h"
+
+using namespace std;
+
+/** Bits of FE_LocationBatch::flags. */
+#define FE_BATCH_BEST_GUESS 0x01
+#define FE_BATCH_PLACE_ID_EXACT 0x02
+#define FE_BATCH_WOEID_EXACT 0x04
+
+/**
+ * Many locations stored column by column, for scanning hundreds of
+ * thousands of them: a filter on the level only touches the level column.
+ * Row i of every column is location i. Names are symbols of the batch's own
+ * dictionary, so comparing a name column with a value is an integer compare
+ * (look the value up once with names.find). Addresses and postal codes are
+ * nearly unique, so they are not put in the process-wide FE_interner():
+ * clear() frees them with the batch.
+ *
+ * The columns are public, like the members of FE_location; they must all
+ * keep the same size, so add rows only with append. Not thread-safe while
+ * being appended to; a finished batch can be read from any number of
+ * threads.
+ */
+class FE_LocationBatch {
+  public:
+    /** Center of the geometry (FE_geometry::latitude and longitude). */
+    vector<double> latitude;
+    vector<double> longitude;
+    /** Bounding box of the geometry. */
+    vector<double> min_lat;
+    vector<double> min_lon;
+    vector<double> max_lat;
+    vector<double> max_lon;
+    /** FE_geometry_type of each row. */
+    vector<unsigned char> geometry_type;
+    /** Polygon vertices of row i are the (latitude, longitude) pairs from
+     * vertex_begin[i] to vertex_begin[i + 1] in vertices. Has size() + 1
+     * entries. */
+    vector<unsigned int> vertex_begin;
+    vector<double> vertices;
+    vector<unsigned int> level;
+    vector<unsigned int> woeid;
+    /** UTC milliseconds, and the offset of the original text (see
+     * FE_compact_location). */
+    vector<long long> timestamp_ms;
+    vector<short> timestamp_offset;
+    /** FE_BATCH_ bits. */
+    vector<unsigned char> flags;
+    /** Text of the symbols of the name columns below. */
+    FE_StringDictionary names;
+    vector<FE_symbol> label;
+    vector<FE_symbol> level_name;
+    vector<FE_symbol> full_location;
+    vector<FE_symbol> place_name;
+    vector<FE_symbol> place_id;
+
+    FE_LocationBatch();
+
+    /** Number of rows. */
+    size_t size() const;
+
+    void clear();
+
+    /** Make room for rows locations without reallocating. */
+    void reserve(size_t rows);
+
+    /** Add a row, adding the names of the location to names. */
+    void append(const FE_location &location);
+
+    /** Get row i back as a FE_location. */
+    void expand(size_t i, FE_location &location) const;
+
+    /**
+     * Decode a 'lookup' response straight into the batch, without building
+     * FE_location lists. Throws like FE_location::from_response.
+     * @return Number of rows added.
+     */
+    size_t append_response(const string &resp, enum FE_format format, FireEagleConfig *config);
+
+    /**
+     * Find the rows at a location level.
+     * @param _level 0 (exact) to 8 (continent).
+     * @param rows Out argument, cleared first: matching rows in order.
+     * @return Number of matching rows.
+     */
+    size_t select_level(unsigned int _level, vector<unsigned int> &rows) const;
+
+    /**
+     * Find the rows whose center is inside a box, edges included. The box
+     * does not wrap around the 180th meridian.
+     * @param rows Out argument, cleared first: matching rows in order.
+     * @return Number of matching rows.
+     */
+    size_t select_within(double _min_lat, double _min_lon, double _max_lat, double _max_lon,
+                         vector<unsigned int> &rows) const;
+
+    /** Like select_level, but only keep the rows already in rows. */
+    size_t refine_level(unsigned int _level, vector<unsigned int> &rows) const;
+
+    /** Like select_within, but only keep the rows already in rows. */
+    size_t refine_within(double _min_lat, double _min_lon, double _max_lat, double _max_lon,
+                         vector<unsigned int> &rows) const;
+
+    /** Bytes used by the columns and the names. */
+    size_t memory_used() const;
+};
+
+/**
+ * Many users stored column by column. Their locations are the rows
+ * location_begin[i] to location_begin[i + 1] of locations, and their WOEID
+ * hierarchies the entries woeid_begin[i] to woeid_begin[i + 1] of woeids.
+ * The '|' delimited hierarchy text is rebuilt from those by expand, not
+ * interned: it is different for almost every user. Same rules as
+ * FE_LocationBatch.
+ */
+class FE_UserBatch {
+  public:
+    vector<unsigned char> can_read;
+    vector<unsigned char> can_write;
+    /** OAuth tokens are unique, so they are not interned. Token i is
+     * token_text[token_begin[i] .. token_begin[i + 1]). */
+    vector<unsigned int> token_begin;
+    string token_text;
+    vector<long long> last_update_ms;
+    vector<short> last_update_offset;
+    vector<FE_symbol> timezone;
+    vector<unsigned int> woeid_begin;
+    vector<unsigned int> woeids;
+    vector<unsigned int> location_begin;
+    FE_LocationBatch locations;
+
+    FE_UserBatch();
+
+    /** Number of users. */
+    size_t size() const;
+
+    void clear();
+
+    /** Add a user and its locations. */
+    void append(const FE_user &user);
+
+    /** Get user i back as a FE_user. */
+    void expand(size_t i, FE_user &user) const;
+
+    /** Token of user i. Not null terminated. */
+    FE_StringRef token(size_t i) const;
+
+    /** @return The user a row of locations belongs to. */
+    size_t user_of_location(size_t row) const;
+
+    /**
+     * Decode a response straight into the batch. Throws like
+     * FE_user::list_from_response.
+     * @param container FE_NODE_USER ('user') or FE_NODE_USERS ('within',
+     * 'recent'). See FE_decode_response.
+     * @return Number of users added.
+     */
+    size_t append_response(const string &resp, enum FE_format format, FireEagleConfig *config,
+                           enum FE_node_id container = FE_NODE_USERS);
+
+    /** Bytes used by the columns, not counting the interned timezones. */
+    size_t memory_used() const;
+};
+
+/**
+ * A FE_ObjectSink appending decoded objects to batches. Either batch may be
+ * NULL to drop that kind of object.
+ */
+class FE_BatchSink : public FE_ObjectSink {
+  private:
+    FE_UserBatch *users;
+    FE_LocationBatch *locations;
+
+  public:
+    FE_BatchSink(FE_UserBatch *_users, FE_LocationBatch *_locations);
+
+    virtual bool decoded_user(FE_user &user);
+    virtual bool decoded_location(FE_location &location);
+};
+
+#endif /* FE_BATCH_H */
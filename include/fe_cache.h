@@ -0,0 +1,112 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#ifndef FE_CACHE_H
+#define FE_CACHE_H
+
+#include <string>
+
+#include <stddef.h>
+
+#include "fireeagle.h"
+
+using namespace std;
+
+/** Counters of a FE_ResponseCache, summed over its shards. */
+struct FE_CacheStats {
+    /** get calls answered from the cache. */
+    unsigned long long hits;
+    /** get calls that found nothing, or an expired entry. */
+    unsigned long long misses;
+    /** Entries added or replaced by put. */
+    unsigned long long insertions;
+    /** Entries dropped, least recently used first, to stay in the budget. */
+    unsigned long long evictions;
+    /** Entries dropped because their time to live was over. */
+    unsigned long long expirations;
+    /** Entries in the cache now. */
+    size_t entries;
+    /** Bytes counted against the budget now. */
+    size_t bytes;
+};
+
+/**
+ * A thread-safe cache of API responses, for calls such as lookup that are
+ * repeated with the same arguments and whose answer rarely changes. Entries
+ * live for a time to live, and the least recently used are dropped when the
+ * keys and responses stored go over a memory budget.
+ *
+ * The cache is split into shards, each with its own lock and its own share
+ * of the budget, so threads looking up different keys rarely wait on each
+ * other. Time is measured on the monotonic clock.
+ */
+class FE_ResponseCache {
+  public:
+    /** Internal. Defined in fe_cache.cc. */
+    struct Shard;
+
+  private:
+    Shard *shards;
+    /** Time to live of put(key, response), in seconds. */
+    unsigned int default_ttl;
+
+    FE_ResponseCache(const FE_ResponseCache &other);
+    FE_ResponseCache &operator=(const FE_ResponseCache &other);
+
+  public:
+    /**
+     * @param max_bytes Memory budget for keys, responses and bookkeeping.
+     * @param ttl_seconds Time to live of the entries added with put(key,
+     * response).
+     */
+    FE_ResponseCache(size_t max_bytes = 8 * 1024 * 1024, unsigned int ttl_seconds = 3600);
+    ~FE_ResponseCache();
+
+    /**
+     * Build the key of an API call. The values of free text arguments
+     * (q, address, city, state, country, postal) are trimmed, runs of white
+     * space become one space and ASCII letters are folded to lower case, so
+     * "San Francisco" and " san  francisco" share an entry. Names and all
+     * other values, identifiers such as place_id and woeid, are kept as they
+     * are: place ids are case sensitive. FE_ParamPairs is already sorted by
+     * name.
+     * @param method Name of the API method.
+     * @param args Arguments of the call.
+     * @param format Format of the response.
+     */
+    static string make_key(const string &method, const FE_ParamPairs &args,
+                           enum FE_format format);
+
+    /**
+     * @param key Key of the entry.
+     * @param response Out argument: a copy of the cached response.
+     * @return false if there is no live entry for key.
+     */
+    bool get(const string &key, string &response);
+
+    /** Add or replace an entry, with the time to live of the cache. */
+    void put(const string &key, const string &response);
+
+    /**
+     * Add or replace an entry. Responses too big for the share of the budget
+     * of a shard are not kept.
+     * @param ttl_seconds How long the entry may be returned by get.
+     */
+    void put(const string &key, const string &response, unsigned int ttl_seconds);
+
+    /** Drop an entry, if any. */
+    void erase(const string &key);
+
+    /** Drop all entries. Counters are kept. */
+    void clear();
+
+    FE_CacheStats stats() const;
+
+    /** Milliseconds on the monotonic clock used for expiry. */
+    static long long now_ms();
+};
+
+#endif /* FE_CACHE_H */
@@ -0,0 +1,91 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#ifndef FE_DIFF_H
+#define FE_DIFF_H
+
+#include "fire_objects.h"
+
+using namespace std;
+
+/** Levels a FE_UserFingerprint tells apart: 0 (exact) to 15. Fire Eagle
+ * uses 0 to 9; higher levels share the last slot. */
+#define FE_FINGERPRINT_LEVELS 16
+
+/** Grid cells per degree the bounds of geometries are snapped to before
+ * they are fingerprinted: about 110 m. Moves within a cell are not changes;
+ * a small move across the edge of a cell still is. */
+#define FE_FINGERPRINT_GRID 1000
+
+/** No best guess location. */
+#define FE_FINGERPRINT_NO_LEVEL 0xff
+
+/** Bits of FE_UserChange::permissions. */
+#define FE_CHANGE_READ_REVOKED 0x1
+#define FE_CHANGE_READ_GRANTED 0x2
+#define FE_CHANGE_WRITE_REVOKED 0x4
+#define FE_CHANGE_WRITE_GRANTED 0x8
+
+/**
+ * A compact summary of a FE_user for spotting changes between two user()
+ * results without comparing their strings: per level, a 64 bit hash of the
+ * woeid, the level and the bounds of the geometry on a coarse grid; the
+ * level of the best guess; the permissions; and a hash of all of these.
+ * Names, labels and timestamps are left out: a user who updates from the
+ * same place again has the same fingerprint.
+ */
+struct FE_UserFingerprint {
+    /** Hash of each level, 0 where the user has no location. */
+    unsigned long long levels[FE_FINGERPRINT_LEVELS];
+    /** Bit i set when the user has a location at level i. */
+    unsigned int present;
+    /** Level of the best guess location, or FE_FINGERPRINT_NO_LEVEL. */
+    unsigned char best_guess;
+    bool can_read;
+    bool can_write;
+    /** Hash of everything above. */
+    unsigned long long all;
+
+    FE_UserFingerprint();
+
+    /** Fingerprint a user. */
+    void assign(const FE_user &user);
+};
+
+/** What changed between two fingerprints. */
+struct FE_UserChange {
+    /** Bit i set when the location at level i appeared, disappeared or
+     * changed. */
+    unsigned int levels;
+    /** The best guess moved to another level. */
+    bool best_guess;
+    /** FE_CHANGE_* bits. */
+    unsigned char permissions;
+
+    FE_UserChange() : levels(0), best_guess(false), permissions(0) {}
+
+    /** true if nothing changed. */
+    bool empty() const { return !levels && !best_guess && !permissions; }
+
+    /** Lowest level that changed, for instance to notify only moves to
+     * another city (level 3) or coarser; -1 if none. */
+    int finest_level() const;
+};
+
+/**
+ * Compare two fingerprints. Returns at once when their overall hashes
+ * match; otherwise compares level by level.
+ * @param change Out argument.
+ * @return true if anything changed.
+ */
+bool FE_diff_users(const FE_UserFingerprint &before, const FE_UserFingerprint &after,
+                   FE_UserChange &change);
+
+/** Fingerprint two users and compare them. Keep the fingerprint of the
+ * previous result rather than the user when diffing a stream of them. */
+bool FE_diff_users(const FE_user &before, const FE_user &after, FE_UserChange &change);
+
+#endif /* FE_DIFF_H */
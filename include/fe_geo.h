@@ -0,0 +1,113 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#ifndef FE_GEO_H
+#define FE_GEO_H
+
+#include <vector>
+
+using namespace std;
+
+/**
+ * Distance and containment kernels over arrays of coordinates, such as the
+ * columns of a FE_LocationBatch. They use SSE2 where the compiler targets it
+ * (always on x86-64) and plain loops elsewhere, or when built with
+ * FE_NO_SIMD defined; both give the same results.
+ *
+ * SSE2 has no trigonometry, so the distance kernels work on points turned
+ * into unit vectors once (FE_UnitVectors): the straight line (chord) between
+ * two unit vectors gives the great circle distance with one asin, and orders
+ * points like the distance does without any.
+ */
+
+/** Mean radius of the Earth in meters, as used by all the kernels. */
+#define FE_EARTH_RADIUS_M 6371008.8
+
+/**
+ * Great circle distance with the haversine formula. The reference the
+ * kernels are checked against.
+ * @return Meters.
+ */
+double FE_haversine(double lat1, double lon1, double lat2, double lon2);
+
+/**
+ * Points as unit vectors on the sphere, one column per axis.
+ */
+class FE_UnitVectors {
+  public:
+    vector<double> x;
+    vector<double> y;
+    vector<double> z;
+
+    FE_UnitVectors();
+    /** See assign. */
+    FE_UnitVectors(const double *lat, const double *lon, size_t n);
+
+    /**
+     * Replace the contents with n points.
+     * @param lat Latitudes in degrees.
+     * @param lon Longitudes in degrees.
+     */
+    void assign(const double *lat, const double *lon, size_t n);
+
+    size_t size() const;
+};
+
+/**
+ * Distance from one point to many.
+ * @param lat Latitude of the point, in degrees.
+ * @param lon Longitude of the point, in degrees.
+ * @param points The other points.
+ * @param meters Out argument, points.size() entries.
+ */
+void FE_geo_distances(double lat, double lon, const FE_UnitVectors &points, double *meters);
+
+/**
+ * Nearest neighbor of every point of from among the points of to, by brute
+ * force. When from and to are the same object, a point is not its own
+ * neighbor.
+ * @param nearest Out argument, from.size() entries: index in to, or
+ * (unsigned int)-1 if to has no candidate.
+ * @param meters Out argument, from.size() entries, may be NULL: distance to
+ * the neighbor.
+ */
+void FE_geo_nearest(const FE_UnitVectors &from, const FE_UnitVectors &to,
+                    unsigned int *nearest, double *meters);
+
+/**
+ * Which points are inside a box, edges included. The box does not wrap
+ * around the 180th meridian.
+ * @param inside Out argument, n entries: 1 inside, 0 outside.
+ * @return Number of points inside.
+ */
+size_t FE_geo_points_in_box(const double *lat, const double *lon, size_t n,
+                            double min_lat, double min_lon, double max_lat, double max_lon,
+                            unsigned char *inside);
+
+/**
+ * Which boxes contain a point, edges included. The boxes are given by their
+ * bounds, as in FE_geometry or the columns of FE_LocationBatch.
+ * @param inside Out argument, n entries: 1 inside, 0 outside.
+ * @return Number of boxes containing the point.
+ */
+size_t FE_geo_boxes_containing(const double *min_lat, const double *min_lon,
+                               const double *max_lat, const double *max_lon, size_t n,
+                               double lat, double lon, unsigned char *inside);
+
+/** Longest geohash FE_geohash writes: 60 bits, cells under 4 cm. */
+#define FE_GEOHASH_MAX 12
+
+/**
+ * Geohash of a point: the cell of a grid, named in base 32, that contains
+ * it. Each character splits the cell of the previous ones in 32, so points
+ * whose geohashes share a prefix are in the same cell at that precision.
+ * Cells are about 5 km across with 5 characters, 150 m with 7.
+ * @param precision Number of characters, at most FE_GEOHASH_MAX.
+ * @param out precision characters. Not null terminated.
+ */
+void FE_geohash(double lat, double lon, unsigned int precision, char *out);
+
+#endif /* FE_GEO_H */
@@ -0,0 +1,132 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#ifndef FE_GEOCACHE_H
+#define FE_GEOCACHE_H
+
+#include <string>
+#include <list>
+
+#include "fireeagle.h"
+#include "fire_objects.h"
+#include "fe_cache.h"
+#include "fe_geo.h"
+
+using namespace std;
+
+/** Location levels FE_GeoCache has a precision for: 0 (exact) to 8
+ * (continent). */
+#define FE_GEOCACHE_LEVELS 9
+
+/** Counters of a FE_GeoCache. Hit ratios are hits[p] / lookups. */
+struct FE_GeoCacheStats {
+    /** get calls. */
+    unsigned long long lookups;
+    /** get calls answered from an entry stored at precision p, by p. */
+    unsigned long long hits[FE_GEOHASH_MAX + 1];
+    /** Entries found at precision p whose bounding box did not contain the
+     * point, so they could not answer. Many of these mean the precision is
+     * too coarse for its levels. */
+    unsigned long long outside[FE_GEOHASH_MAX + 1];
+    /** Entries stored at precision p. */
+    unsigned long long stores[FE_GEOHASH_MAX + 1];
+    /** get calls not answered. */
+    unsigned long long misses;
+    /** Responses put without their locations that could not be decoded,
+     * and so were not stored. */
+    unsigned long long decode_errors;
+    /** The entries themselves. */
+    FE_CacheStats cache;
+};
+
+/**
+ * A cache of lookup responses for latitude / longitude queries, for GPS
+ * fixes a few meters apart that would never share an exact key. A response
+ * is stored under the geohash cell of the point it answered, at a
+ * precision that depends on the level of its best guess location: a city
+ * can answer points kilometers apart, an exact address only a few meters.
+ * A later point is answered by an entry of the cell it falls in, if the
+ * bounding box of the best guess of the entry contains it too.
+ *
+ * The response returned is the one Fire Eagle sent for the first point, so
+ * its querystring is that of the first point. Entries expire, and are
+ * bounded in memory, as in FE_ResponseCache. Thread-safe.
+ */
+class FE_GeoCache {
+  private:
+    FE_ResponseCache cache;
+    /** Geohash characters by location level, 0 to not cache the level. */
+    unsigned int precision[FE_GEOCACHE_LEVELS];
+    /** The distinct precisions in use, finest first. */
+    unsigned int probes[FE_GEOCACHE_LEVELS];
+    unsigned int nprobes;
+    FE_GeoCacheStats counters;
+
+    void update_probes();
+    void put_best(double lat, double lon, enum FE_format format, const string &response,
+                  const FE_location &best);
+    static string make_key(enum FE_format format, const char *cell, unsigned int precision);
+
+    FE_GeoCache(const FE_GeoCache &other);
+    FE_GeoCache &operator=(const FE_GeoCache &other);
+
+  public:
+    /**
+     * Start with precisions of 7 characters (about 150 m) for exact
+     * locations, 6 (1 km) for postal codes and neighborhoods, 5 (5 km) for
+     * cities, 4 (40 km) for regions and states and 3 (150 km) for countries
+     * and larger.
+     * @param max_bytes Memory budget, as for FE_ResponseCache.
+     * @param ttl_seconds Time to live of the entries.
+     */
+    FE_GeoCache(size_t max_bytes = 8 * 1024 * 1024, unsigned int ttl_seconds = 3600);
+
+    /**
+     * Set the precision of the entries whose best guess is at a level. Not
+     * thread-safe: set precisions before sharing the cache.
+     * @param level Location level, below FE_GEOCACHE_LEVELS.
+     * @param chars Geohash characters, at most FE_GEOHASH_MAX, or 0 not to
+     * cache responses whose best guess is at this level.
+     */
+    void set_precision(unsigned int level, unsigned int chars);
+
+    unsigned int get_precision(unsigned int level) const;
+
+    /**
+     * Find a response for a point.
+     * @param response Out argument: a copy of the cached response.
+     * @return false if no entry can answer for the point.
+     */
+    bool get(double lat, double lon, enum FE_format format, string &response);
+
+    /**
+     * Store the response Fire Eagle sent for a point. Responses without a
+     * location at a level with a precision are not stored.
+     * @param locations The locations of response, decoded.
+     */
+    void put(double lat, double lon, enum FE_format format, const string &response,
+             const list<FE_location> &locations);
+
+    /**
+     * Like put above, for a response not decoded yet: decodes only as far
+     * as its best guess location. Responses that cannot be decoded are
+     * counted in decode_errors, not thrown.
+     * @param config Config with the parsers.
+     */
+    void put(double lat, double lon, enum FE_format format, const string &response,
+             FireEagleConfig *config);
+
+    FE_GeoCacheStats stats() const;
+
+    /**
+     * Recognize a lookup for a point: the only arguments are 'lat' and
+     * 'lon', or 'q' holding "lat,lon".
+     * @return false for any other lookup.
+     */
+    static bool parse_query(const FE_ParamPairs &args, double &lat, double &lon);
+};
+
+#endif /* FE_GEOCACHE_H */
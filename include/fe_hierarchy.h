@@ -0,0 +1,103 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#ifndef FE_HIERARCHY_H
+#define FE_HIERARCHY_H
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include <pthread.h>
+
+using namespace std;
+
+/**
+ * Split a '|' delimited WOEID hierarchy, as in the 'string' attribute of
+ * <location-hierarchy>.
+ * @param s Start of the text. Need not be null terminated.
+ * @param len Length of the text.
+ * @param woeids Out argument, cleared first. WOEIDs from the coarsest level
+ * to the finest. Items that are not a WOEID are skipped.
+ */
+void FE_parse_woeid_hierarchy(const char *s, size_t len, vector<unsigned int> &woeids);
+
+/**
+ * Inverse of FE_parse_woeid_hierarchy: join WOEIDs with '|'. Gives back the
+ * text Fire Eagle sent, except for items the parse skipped.
+ * @param woeids WOEIDs from the coarsest level to the finest.
+ * @param n Number of WOEIDs.
+ */
+string FE_format_woeid_hierarchy(const unsigned int *woeids, size_t n);
+
+/**
+ * Groups users by their WOEID hierarchy so that regional roll ups do not
+ * need to look at every user. Users with a common prefix (same country,
+ * same city) share the nodes of that prefix. Every node knows how many
+ * users are below it, and an index from WOEID to nodes makes "all users
+ * under WOEID X" proportional to the size of the answer.
+ *
+ * Users are identified by their OAuth token (FE_user::token). Safe to use
+ * from any number of threads: queries share a read lock, updates take it
+ * exclusively.
+ */
+class FE_HierarchyTrie {
+  private:
+    struct Node {
+        unsigned int woeid;
+        Node *parent;
+        map<unsigned int, Node *> children;
+        /** Users whose hierarchy ends here. */
+        vector<string> users;
+        /** Users here and in all descendants. */
+        size_t total;
+    };
+
+    Node root;
+    /** All nodes for a WOEID. Usually just one. */
+    map<unsigned int, vector<Node *> > by_woeid;
+    /** Where each user is. */
+    map<string, Node *> by_user;
+    mutable pthread_rwlock_t lock;
+
+    void unlink(const string &token, Node *node);
+    void collect(const Node *node, vector<string> &tokens) const;
+    void destroy(Node *node);
+
+    FE_HierarchyTrie(const FE_HierarchyTrie &other);
+    FE_HierarchyTrie &operator=(const FE_HierarchyTrie &other);
+
+  public:
+    FE_HierarchyTrie();
+    ~FE_HierarchyTrie();
+
+    /**
+     * Add a user, or move it if its hierarchy changed.
+     * @param token The user.
+     * @param woeids Hierarchy from the coarsest level to the finest, as in
+     * FE_user::woeids. A user with an empty hierarchy is removed.
+     */
+    void insert(const string &token, const vector<unsigned int> &woeids);
+
+    /** @return false if the user was not in the trie. */
+    bool remove(const string &token);
+
+    /**
+     * Find the users at or below a WOEID.
+     * @param woeid Any level: country, state, city...
+     * @param tokens Out argument. Matching users are appended.
+     * @return Number of users appended.
+     */
+    size_t users_under(unsigned int woeid, vector<string> &tokens) const;
+
+    /** @return Number of users at or below a WOEID, without listing them. */
+    size_t count_under(unsigned int woeid) const;
+
+    /** @return Number of users in the trie. */
+    size_t size() const;
+};
+
+#endif /* FE_HIERARCHY_H */
@@ -0,0 +1,131 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#ifndef FE_INTERN_H
+#define FE_INTERN_H
+
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+
+#include "parser_iface.h" //For FE_StringRef
+
+using namespace std;
+
+/** Id of an interned string. 0 is always the empty string. */
+typedef unsigned int FE_symbol;
+
+/** Returned by FE_StringInterner::find for strings never interned. */
+#define FE_NO_SYMBOL 0xffffffffU
+
+/**
+ * A concurrent, append only string table handing out 32 bit ids. Each
+ * distinct string is stored once, so objects that repeat the same few
+ * thousand place names can keep ids instead of copies. Strings are never
+ * removed: intern values from a bounded vocabulary (names, levels,
+ * timezones), not tokens or timestamps.
+ *
+ * The table is split into shards, each with its own lock, so threads
+ * interning different strings rarely wait on each other. lookup does not
+ * lock at all: the text of a symbol never moves once interned. As with any
+ * shared value, a symbol must reach other threads through some
+ * synchronization (a mutex, a queue) before they look it up.
+ */
+class FE_StringInterner {
+  public:
+    /** Internal. Defined in fe_intern.cc. */
+    struct Shard;
+
+  private:
+    Shard *shards;
+
+    FE_StringInterner(const FE_StringInterner &other);
+    FE_StringInterner &operator=(const FE_StringInterner &other);
+
+  public:
+    FE_StringInterner();
+    ~FE_StringInterner();
+
+    /**
+     * Get the id of a string, adding it if needed. Throws a
+     * FireEagleException pointer with FE_INTERNAL_ERROR if the table is full.
+     * @param s Start of the string. Need not be null terminated.
+     * @param len Length of the string.
+     */
+    FE_symbol intern(const char *s, size_t len);
+
+    FE_symbol intern(const string &s);
+
+    /** @return The id of a string, or FE_NO_SYMBOL if it was never interned. */
+    FE_symbol find(const char *s, size_t len) const;
+
+    /**
+     * @return The text of a symbol. Valid, and null terminated, for the life
+     * of the interner.
+     */
+    FE_StringRef lookup(FE_symbol symbol) const;
+
+    /** Number of distinct strings, not counting the empty string. */
+    size_t size() const;
+
+    /** Bytes used by the table and the string text. */
+    size_t memory_used() const;
+};
+
+/** The process-wide interner used by FE_compact_location and FE_compact_user. */
+FE_StringInterner &FE_interner();
+
+/**
+ * A string table owned by one container, such as a FE_LocationBatch, for
+ * values of any cardinality: unlike FE_interner(), it goes away with its
+ * owner and clear() empties it. Symbols only mean something to the
+ * dictionary that handed them out. Not thread-safe while strings are added;
+ * a dictionary no longer growing can be read from any number of threads.
+ */
+class FE_StringDictionary {
+  private:
+    /** Text of every symbol, each followed by a null; symbol 0 at 0. */
+    string text;
+    /** Start of each symbol in text, plus the end of the last one. */
+    vector<unsigned int> offsets;
+    /** Open addressing hash table of symbols (0 for a free slot), with the
+     * hash of each next to it. */
+    vector<unsigned int> slots;
+    vector<unsigned int> hashes;
+
+    unsigned int find_slot(unsigned int h, const char *s, size_t len) const;
+    void grow();
+
+  public:
+    FE_StringDictionary();
+
+    /**
+     * Get the id of a string, adding it if needed. Throws a
+     * FireEagleException pointer with FE_INTERNAL_ERROR past 4G of text.
+     */
+    FE_symbol intern(const char *s, size_t len);
+
+    FE_symbol intern(const string &s);
+
+    /** @return The id of a string, or FE_NO_SYMBOL if it was never added. */
+    FE_symbol find(const char *s, size_t len) const;
+
+    /** @return The text of a symbol, null terminated. Valid until the next
+     * string is added. */
+    FE_StringRef lookup(FE_symbol symbol) const;
+
+    /** Number of distinct strings, not counting the empty string. */
+    size_t size() const;
+
+    /** Forget every string and free their memory. */
+    void clear();
+
+    /** Bytes used by the table and the string text. */
+    size_t memory_used() const;
+};
+
+#endif /* FE_INTERN_H */
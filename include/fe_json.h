@@ -0,0 +1,111 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#ifndef FE_JSON_H
+#define FE_JSON_H
+
+#include <string>
+
+#include <stddef.h>
+
+#include "fire_objects.h"
+
+using namespace std;
+
+/** How FE_JsonWriter separates the objects it writes. */
+enum FE_json_mode {
+    /** One object per line (NDJSON). */
+    FE_JSON_LINES = 0,
+    /** A single JSON array, closed by finish(). */
+    FE_JSON_ARRAY
+};
+
+/**
+ * Writes FE_user, FE_location and FE_geometry objects as compact JSON, for
+ * exporting many of them. Output goes to a buffer that grows as needed and
+ * is then reused, or to a file descriptor each time 64K are ready, so a
+ * steady export does not allocate. Numbers use FE_format_double. Strings
+ * are escaped as JSON requires and otherwise copied as they are, so UTF-8
+ * text stays UTF-8.
+ *
+ * The keys follow the names of Fire Eagle's own XML and JSON responses:
+ *
+ * - location: best_guess, label, level, level_name, located_at,
+ *   located_at_ms, name, normal_name, place_id, place_id_exact, woeid,
+ *   woeid_exact, geometry.
+ * - user: token, readable, writable, located_at, located_at_ms, timezone,
+ *   woeid_hierarchy, location_hierarchy (an array of locations).
+ * - geometry: GeoJSON. A Point, or a Polygon with a bbox for boxes and
+ *   polygons. Coordinates are [longitude, latitude]. An invalid geometry
+ *   is null.
+ *
+ * Unknown levels, WOEIDs and timestamps are null. Errors writing to a file
+ * descriptor are thrown as FireEagleException pointers with
+ * FE_INTERNAL_ERROR. Not thread-safe.
+ */
+class FE_JsonWriter {
+  private:
+    char *buffer;
+    size_t length;
+    size_t capacity;
+    /** -1 to keep the output in the buffer. */
+    int fd;
+    enum FE_json_mode mode;
+    size_t _records;
+
+    void reserve(size_t more);
+    inline void put(char c);
+    inline void put(const char *s, size_t len);
+    void put_key(const char *key);
+    void put_string(const string &s);
+    void put_bool(bool value);
+    void put_number(double value);
+    void put_integer(long long value);
+    void put_uint(unsigned int value);
+    void put_lonlat(double lat, double lon);
+    void put_geometry(const FE_geometry &geometry);
+    void put_location(const FE_location &location);
+    void put_user(const FE_user &user);
+    void begin_record();
+    void end_record();
+
+    FE_JsonWriter(const FE_JsonWriter &other);
+    FE_JsonWriter &operator=(const FE_JsonWriter &other);
+
+  public:
+    /** Write to a buffer, read with data() and size(). */
+    FE_JsonWriter(enum FE_json_mode _mode = FE_JSON_LINES);
+
+    /** Write to a file descriptor, such as a file or a pipe. It is not
+     * closed. */
+    FE_JsonWriter(int _fd, enum FE_json_mode _mode = FE_JSON_LINES);
+
+    /** Flushes to the file descriptor, if any. Errors at this point are
+     * lost: call finish() first to see them. */
+    ~FE_JsonWriter();
+
+    void write(const FE_user &user);
+    void write(const FE_location &location);
+    void write(const FE_geometry &geometry);
+
+    /** Close the array in FE_JSON_ARRAY mode, and flush. */
+    void finish();
+
+    /** Write the buffer out to the file descriptor. Nothing without one. */
+    void flush();
+
+    /** Output so far, when writing to a buffer. Not null terminated. */
+    const char *data() const;
+    size_t size() const;
+
+    /** Empty the buffer, keeping its memory, to start a new document. */
+    void clear();
+
+    /** Objects written so far. */
+    size_t records() const;
+};
+
+#endif /* FE_JSON_H */
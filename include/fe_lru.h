@@ -0,0 +1,50 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#ifndef FE_LRU_H
+#define FE_LRU_H
+
+#include <stddef.h>
+
+/**
+ * Intrusive least recently used lists, as kept by the shards of the caches:
+ * the list has 'newest' and 'oldest' pointers, its nodes 'newer' and 'older'
+ * ones. Nothing is allocated; the caller holds whatever lock guards the
+ * list.
+ */
+
+/** Take a node out of its list. */
+template <class List, class Node> inline void FE_lru_unlink(List &list, Node *node) {
+    if (node->newer)
+        node->newer->older = node->older;
+    else
+        list.newest = node->older;
+    if (node->older)
+        node->older->newer = node->newer;
+    else
+        list.oldest = node->newer;
+}
+
+/** Put a node, in no list, at the newest end. */
+template <class List, class Node> inline void FE_lru_link_newest(List &list, Node *node) {
+    node->newer = NULL;
+    node->older = list.newest;
+    if (list.newest)
+        list.newest->newer = node;
+    else
+        list.oldest = node;
+    list.newest = node;
+}
+
+/** Move a node of the list to the newest end. */
+template <class List, class Node> inline void FE_lru_touch(List &list, Node *node) {
+    if (list.newest == node)
+        return;
+    FE_lru_unlink(list, node);
+    FE_lru_link_newest(list, node);
+}
+
+#endif /* FE_LRU_H */
@@ -0,0 +1,122 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#ifndef FE_NUMERIC_H
+#define FE_NUMERIC_H
+
+#include <string>
+
+#include <stddef.h>
+
+using namespace std;
+
+/**
+ * Parse a decimal integer. Locale independent. Accepts an optional sign
+ * followed by digits, and nothing else (no white space, no hex or octal
+ * prefixes).
+ * @param s Start of the text. Need not be null terminated.
+ * @param len Length of the text.
+ * @param value Out argument. Not touched on failure.
+ * @return false on a syntax error or overflow.
+ */
+bool FE_parse_long(const char *s, size_t len, long *value);
+
+/**
+ * Parse a decimal floating point number (optional sign, digits with an
+ * optional fraction, optional exponent). Locale independent: the decimal
+ * point is always '.'. Numbers with up to 15 significant digits and small
+ * exponents - which covers every coordinate Fire Eagle sends - are converted
+ * exactly without calling into libc. The rest go through strtod_l in the "C"
+ * locale.
+ * @param s Start of the text. Need not be null terminated.
+ * @param len Length of the text.
+ * @param value Out argument. Not touched on failure.
+ * @return false on a syntax error.
+ */
+bool FE_parse_double(const char *s, size_t len, double *value);
+
+/** Room FE_format_double needs. */
+#define FE_DOUBLE_CHARS 32
+
+/**
+ * Format a double in the shortest decimal form that parses back to the same
+ * value, locale independent. Numbers with up to 9 decimals (every coordinate
+ * Fire Eagle sends) are formatted with integer arithmetic; the rest go
+ * through snprintf in the "C" locale. NaN and infinities come out as "nan",
+ * "inf" and "-inf".
+ * @param value The number.
+ * @param out At least FE_DOUBLE_CHARS bytes. Not null terminated.
+ * @return Number of characters written.
+ */
+size_t FE_format_double(double value, char *out);
+
+/**
+ * Parse a timestamp as Fire Eagle sends them: ISO 8601 in the fixed form
+ * 'YYYY-MM-DDTHH:MM:SS', optionally followed by a fraction of a second, and
+ * then 'Z' or a '+HH:MM' / '-HH:MM' offset from UTC. No locale or timezone
+ * database is involved.
+ * @param s Start of the text. Need not be null terminated.
+ * @param len Length of the text.
+ * @param epoch_ms Out argument: milliseconds since 1970-01-01T00:00:00Z.
+ * @param offset_minutes Out argument, may be NULL: the offset of the
+ * original text from UTC.
+ * @return false if the text is not in that form or a field is out of range.
+ * Out arguments are not touched on failure.
+ */
+bool FE_parse_timestamp(const char *s, size_t len, long long *epoch_ms, int *offset_minutes);
+
+/**
+ * Inverse of FE_parse_timestamp: format a time as 'YYYY-MM-DDTHH:MM:SS+HH:MM'
+ * in the given offset from UTC. Milliseconds are dropped.
+ */
+string FE_format_timestamp(long long epoch_ms, int offset_minutes);
+
+/**
+ * 32 bit FNV-1a hash of some bytes, as used for the shards and buckets of
+ * the caches and the interner and for the name index of snapshots. Snapshot
+ * files store these hashes, so it must not change.
+ */
+inline unsigned int FE_hash_fnv1a(const char *s, size_t len) {
+    unsigned int h = 2166136261U;
+    for (size_t i = 0 ; i < len ; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619U;
+    }
+    return h;
+}
+
+/**
+ * Typed views of a string value, each parsed at most once. Meant to sit next
+ * to the string it caches, which must not change without a call to clear().
+ * Surrounding white space is ignored when parsing. The first call for a type
+ * modifies the cache, so the usual rule for const methods on shared objects
+ * does not hold.
+ */
+class FE_ValueCache {
+  private:
+    mutable unsigned char parsed;
+    mutable unsigned char failed;
+    mutable long long_value;
+    mutable double double_value;
+    mutable bool bool_value;
+
+  public:
+    FE_ValueCache();
+
+    /** Forget the parsed values. Call whenever the string changes. */
+    void clear();
+
+    /** See FE_ParsedNode::get_long_property for the meaning of error. */
+    long as_long(const string &text, bool *error) const;
+
+    /** See FE_ParsedNode::get_double_property for the meaning of error. */
+    double as_double(const string &text, bool *error) const;
+
+    /** 'true' or 'false'. See FE_ParsedNode::get_bool_property. */
+    bool as_bool(const string &text, bool *error) const;
+};
+
+#endif /* FE_NUMERIC_H */
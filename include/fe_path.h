@@ -0,0 +1,170 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#ifndef FE_PATH_H
+#define FE_PATH_H
+
+#include <string>
+#include <vector>
+
+#include "parser_iface.h"
+
+using namespace std;
+
+/** One result of FE_PathQuery::select */
+struct FE_PathMatch {
+    /** The node matched by the last step of the path. */
+    const FE_ParsedNode *node;
+    /** The selected value: the text of the node, or the attribute value when
+     * the path ends in '@name'. Points into the tree. */
+    FE_StringRef value;
+};
+
+/**
+ * Receives the values matched by a FE_PathMatcher. The value is valid only
+ * during the call.
+ */
+class FE_PathCallback {
+  public:
+    virtual ~FE_PathCallback() {}
+
+    /**
+     * @param value Text of the matched node, or the attribute value.
+     * @return true to keep going, false to stop the parse.
+     */
+    virtual bool path_match(const FE_StringRef &value) = 0;
+};
+
+/**
+ * A compiled path expression for pulling a few values out of a response
+ * without walking it by hand. Compile once, run as often as needed, from any
+ * number of threads. The supported subset of XPath is:
+ * - Absolute child steps separated by '/', starting with the root node. The
+ *   leading '/' is optional: 'rsp/user' and '/rsp/user' are the same.
+ * - '*' for any name.
+ * - Predicates on a step: '[@attr]' (attribute present),
+ *   '[@attr=value]' (value optionally in single or double quotes) and
+ *   '[n]' (n-th of the nodes passing the step so far, 1 based). A position
+ *   must be the last predicate of its step.
+ * - An optional last step 'text()' or '@attr' to select a value instead of
+ *   the text of the node.
+ *
+ * For example 'rsp/user/location-hierarchy/location[@best-guess=true]/woeid'.
+ * There is no '//', no axes, and no functions other than text().
+ */
+class FE_PathQuery {
+  public:
+    /** What the expression selects from the last node */
+    enum target_type { FE_PATH_NODE = 0, FE_PATH_TEXT, FE_PATH_ATTRIBUTE };
+
+  private:
+    struct Predicate {
+        string attribute;
+        string value;
+        bool has_value;
+    };
+
+    struct Step {
+        string name;
+        enum FE_node_id id;
+        bool any;
+        vector<Predicate> predicates;
+        unsigned int position; //0 when there is no position predicate.
+    };
+
+    string expression;
+    vector<Step> steps;
+    enum target_type target;
+    string target_attribute;
+
+    void compile();
+
+    bool name_matches(const Step &step, const FE_ParsedNode &node) const;
+    bool predicates_match(const Step &step, const FE_ParsedNode &node) const;
+    bool walk(const FE_ParsedNode &node, size_t step, vector<FE_PathMatch> &matches,
+              size_t limit) const;
+
+    friend class FE_PathMatcher;
+
+  public:
+    /**
+     * Compile an expression. Throws a FireEagleException pointer with
+     * FE_INTERNAL_ERROR for a syntax error.
+     * @param expr The path expression.
+     */
+    FE_PathQuery(const string &expr);
+
+    /** The expression this query was compiled from */
+    const string &source() const;
+
+    /**
+     * Run the query against a tree. Matches come in document order.
+     * @param root Root of the tree. Matched against the first step.
+     * @param matches Out argument, cleared first. Reuse the same vector
+     * across calls to avoid allocations.
+     * @param limit Stop after this many matches. 0 for no limit.
+     * @return Number of matches.
+     */
+    size_t select(const FE_ParsedNode &root, vector<FE_PathMatch> &matches,
+                  size_t limit = 0) const;
+
+    /**
+     * Convenience for the first match only.
+     * @param root Root of the tree.
+     * @param value Out argument for the matched value.
+     * @return false if nothing matched.
+     */
+    bool select_first(const FE_ParsedNode &root, FE_StringRef &value) const;
+
+    /**
+     * Run the query directly over a document, without building a tree. See
+     * FE_PathMatcher.
+     * @param parser Any parser supporting FE_Parser::parse_events.
+     * @param document The document.
+     * @param callback Gets the matches.
+     * @return The result of parse_events.
+     */
+    enum FE_event_status scan(FE_Parser &parser, const string &document,
+                              FE_PathCallback &callback) const;
+};
+
+/**
+ * Evaluates a FE_PathQuery over parse events. Only the text of matched nodes
+ * is ever copied (into a buffer kept across documents), so large documents
+ * can be searched without materializing them. Stopping from the callback
+ * stops the parse, so a query for a single value at the top of a document
+ * does not read the rest. A matcher is not thread-safe; use one per thread.
+ */
+class FE_PathMatcher : public FE_ParseEvents {
+  private:
+    const FE_PathQuery &query;
+    FE_PathCallback &callback;
+    /** Number of open elements. */
+    size_t depth;
+    /** Number of leading open elements that match the leading steps. */
+    size_t matched;
+    /** Matches so far among the current siblings, for each step. */
+    vector<unsigned int> seen;
+    /** Set while the node matched by the last step is open. */
+    bool pending;
+    /** Set while text of that node should be collected. */
+    bool capturing;
+    string text;
+
+  public:
+    FE_PathMatcher(const FE_PathQuery &_query, FE_PathCallback &_callback);
+
+    void reset();
+
+    bool start_node(enum FE_node_id id, const FE_StringRef &name,
+                    const FE_EventAttribute *attrs, unsigned int nattrs);
+
+    bool node_text(const FE_StringRef &text);
+
+    bool end_node(enum FE_node_id id, const FE_StringRef &name);
+};
+
+#endif /* FE_PATH_H */
@@ -0,0 +1,130 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#ifndef FE_RECENT_POLLER_H
+#define FE_RECENT_POLLER_H
+
+#include <string>
+#include <map>
+
+#include "fireeagle.h"
+#include "fire_objects.h"
+#include "fe_worker_pool.h"
+
+using namespace std;
+
+/**
+ * Receives the users a FE_RecentPoller found new or moved. The user is
+ * owned by the poller and reused for the next one: copy or swap out what
+ * is needed.
+ */
+class FE_RecentCallback {
+  public:
+    virtual ~FE_RecentCallback() {}
+
+    /**
+     * @param user The user as decoded from the 'recent' response.
+     * @param is_new true the first time the poller sees its token.
+     */
+    virtual void user_changed(FE_user &user, bool is_new) = 0;
+};
+
+/** Counters of a FE_RecentPoller. */
+struct FE_RecentPollerStats {
+    /** Calls to poll. */
+    unsigned long long polls;
+    /** 'recent' calls made. */
+    unsigned long long pages;
+    /** Of pages, those fetched in the background while the previous page
+     * was being delivered. */
+    unsigned long long prefetched;
+    /** Users decoded from the pages. */
+    unsigned long long seen;
+    /** Users handed to the callback. */
+    unsigned long long delivered;
+    /** Tokens tracked. */
+    size_t tokens;
+};
+
+/**
+ * Turns the 'recent' call into a feed of changes. Each poll() asks for the
+ * users who updated since the cursor, page by page with the 'time',
+ * 'count' and 'start' arguments, and hands the callback only the users it
+ * has not seen before or whose located-at has moved on since it last saw
+ * them. Consumers do work proportional to the changes rather than to the
+ * window. The cursor then moves to the latest located-at seen.
+ *
+ * With a FE_WorkerPool, the next page is fetched in the background while
+ * the changes of the current one are delivered.
+ *
+ * The cursor has a resolution of a second, and users updating during a
+ * poll shift the pages, so pages overlap; users are tracked per token so
+ * that none is delivered twice for the same update.
+ *
+ * Not thread-safe: poll from one thread at a time.
+ */
+class FE_RecentPoller {
+  public:
+    /** Internal. Defined in fe_recent_poller.cc. */
+    struct Fetch;
+
+  private:
+    FireEagleConfig *config;
+    FE_RecentCallback *callback;
+    FE_WorkerPool *pool;
+    unsigned int page_size;
+    long long cursor_ms;
+    /** Located-at of each token seen, in ms; 0 when it has none. */
+    map<string, long long> last_seen;
+    FE_RecentPollerStats counters;
+
+    void start_fetch(Fetch *fetch, bool background);
+
+    friend struct Fetch;
+
+    FE_RecentPoller(const FE_RecentPoller &other);
+    FE_RecentPoller &operator=(const FE_RecentPoller &other);
+
+  protected:
+    /** Make one 'recent' call, possibly on a worker thread. The default
+     * calls FireEagle::recent. */
+    virtual string fetch_page(const FE_ParamPairs &args);
+
+  public:
+    /**
+     * @param _config Config with the general token. Not owned.
+     * @param _callback Gets the changes. Not owned.
+     * @param _pool Pool for the prefetches. Not owned; NULL to fetch every
+     * page on the thread calling poll.
+     * @param _page_size Users per 'recent' call (the 'count' argument).
+     */
+    FE_RecentPoller(FireEagleConfig *_config, FE_RecentCallback *_callback,
+                    FE_WorkerPool *_pool = NULL, unsigned int _page_size = 100);
+
+    virtual ~FE_RecentPoller();
+
+    /**
+     * Fetch the users who updated since the cursor and deliver the changes.
+     * Throws like FireEagle::recent; users delivered before the failure
+     * stay delivered, and the cursor does not move.
+     * @return Number of users handed to the callback.
+     */
+    size_t poll();
+
+    /** Latest located-at seen, in ms since the epoch. 0 before the first
+     * poll, which then leaves 'time' to the default of Fire Eagle. */
+    long long cursor() const;
+
+    /** Start from another time, for instance one saved by a previous run. */
+    void set_cursor(long long epoch_ms);
+
+    /** Forget the tokens seen, so that every user is delivered again. */
+    void clear();
+
+    FE_RecentPollerStats stats() const;
+};
+
+#endif /* FE_RECENT_POLLER_H */
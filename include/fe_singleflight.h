@@ -0,0 +1,91 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#ifndef FE_SINGLEFLIGHT_H
+#define FE_SINGLEFLIGHT_H
+
+#include <string>
+#include <map>
+
+#include <pthread.h>
+
+#include "fireeagle.h"
+
+using namespace std;
+
+/**
+ * Lets threads making the same request at the same time share one: the
+ * first to join a key performs it, and the others wait for its response
+ * or its exception instead of sending their own. A key is only shared
+ * while its request is in flight; nothing is kept afterwards.
+ *
+ * The thread that joins first is the leader, and must end the flight with
+ * done() or fail(), whatever happens. The others call wait():
+ *
+ *     bool leader;
+ *     FE_SingleFlight::Flight *flight = group.join(key, leader);
+ *     if (!leader)
+ *         return group.wait(flight);
+ *     try {
+ *         response = ...;
+ *     } catch (FireEagleException *e) {
+ *         group.fail(flight, e);
+ *         throw;
+ *     }
+ *     group.done(flight, response);
+ */
+class FE_SingleFlight {
+  public:
+    /** Internal. Defined in fe_singleflight.cc. */
+    struct Flight;
+
+  private:
+    mutable pthread_mutex_t lock;
+    map<string, Flight *> flights;
+    unsigned long long _leaders;
+    unsigned long long _followers;
+
+    /** Drop a reference to flight. Call with the lock held. */
+    void release(Flight *flight);
+
+    FE_SingleFlight(const FE_SingleFlight &other);
+    FE_SingleFlight &operator=(const FE_SingleFlight &other);
+
+  public:
+    FE_SingleFlight();
+    ~FE_SingleFlight();
+
+    /**
+     * Join the flight for key, starting it if there is none.
+     * @param key Identifies the request: equal keys must mean requests with
+     * the same response.
+     * @param leader Out argument: true if the caller must perform the
+     * request and call done() or fail().
+     */
+    Flight *join(const string &key, bool &leader);
+
+    /** End a flight with its response. For the leader only. */
+    void done(Flight *flight, const string &response);
+
+    /** End a flight with an exception. For the leader only, who still owns
+     * e; each waiter gets a copy. */
+    void fail(Flight *flight, const FireEagleException *e);
+
+    /**
+     * Wait for the leader of a flight. For the other threads only.
+     * @return The response of the leader. Throws a copy of its exception
+     * instead if it failed.
+     */
+    string wait(Flight *flight);
+
+    /** Requests performed by leaders so far. */
+    unsigned long long leaders() const;
+
+    /** Requests answered by waiting on a leader so far. */
+    unsigned long long followers() const;
+};
+
+#endif /* FE_SINGLEFLIGHT_H */
@@ -0,0 +1,180 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#ifndef FE_SMALL_VECTOR_H
+#define FE_SMALL_VECTOR_H
+
+#include <new>
+
+#include <stddef.h>
+
+/**
+ * Move an element to uninitialized memory and destroy the original. The
+ * generic version copies; overload it (in the namespace of T) for types with
+ * a cheaper way, such as a swap.
+ */
+template <class T> inline void FE_relocate(T *to, T &from) {
+    new (to) T(from);
+    from.~T();
+}
+
+/**
+ * A vector keeping its first N elements inside the object itself, for lists
+ * that are almost always short. Only a longer list allocates, once per
+ * doubling. Elements are moved with FE_relocate when the storage changes.
+ * Iterators are plain pointers, invalidated by anything that adds elements
+ * and by swap.
+ */
+template <class T, unsigned int N>
+class FE_SmallVector {
+  private:
+    T *items;
+    size_t count;
+    size_t _capacity;
+    /** The inline elements, aligned for anything T may hold. */
+    union {
+        char bytes[N * sizeof(T)];
+        double align_double;
+        long long align_long;
+        void *align_pointer;
+    } storage;
+
+    T *inline_items() { return reinterpret_cast<T *>(storage.bytes); }
+    bool is_inline() const { return items == reinterpret_cast<const T *>(storage.bytes); }
+
+    void release() {
+        clear();
+        if (!is_inline())
+            ::operator delete(items);
+        items = inline_items();
+        _capacity = N;
+    }
+
+    //Take the elements of from, which is left empty. This one must be empty.
+    void take(FE_SmallVector &from) {
+        if (!from.is_inline()) {
+            release();
+            items = from.items;
+            count = from.count;
+            _capacity = from._capacity;
+            from.items = from.inline_items();
+            from._capacity = N;
+        } else {
+            reserve(from.count);
+            for (size_t i = 0 ; i < from.count ; i++)
+                FE_relocate(items + i, from.items[i]);
+            count = from.count;
+        }
+        from.count = 0;
+    }
+
+  public:
+    typedef T value_type;
+    typedef T *iterator;
+    typedef const T *const_iterator;
+    typedef size_t size_type;
+
+    FE_SmallVector() : items(inline_items()), count(0), _capacity(N) {}
+
+    FE_SmallVector(const FE_SmallVector &other)
+        : items(inline_items()), count(0), _capacity(N) {
+        reserve(other.count);
+        for ( ; count < other.count ; count++)
+            new (items + count) T(other.items[count]);
+    }
+
+    FE_SmallVector &operator=(const FE_SmallVector &other) {
+        if (this != &other) {
+            clear();
+            reserve(other.count);
+            for ( ; count < other.count ; count++)
+                new (items + count) T(other.items[count]);
+        }
+        return *this;
+    }
+
+    ~FE_SmallVector() { release(); }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    size_t capacity() const { return _capacity; }
+
+    iterator begin() { return items; }
+    iterator end() { return items + count; }
+    const_iterator begin() const { return items; }
+    const_iterator end() const { return items + count; }
+
+    T &operator[](size_t i) { return items[i]; }
+    const T &operator[](size_t i) const { return items[i]; }
+    T &front() { return items[0]; }
+    const T &front() const { return items[0]; }
+    T &back() { return items[count - 1]; }
+    const T &back() const { return items[count - 1]; }
+
+    /** Make room for n elements. */
+    void reserve(size_t n) {
+        if (n <= _capacity)
+            return;
+        size_t grown = 2 * _capacity;
+        if (grown < n)
+            grown = n;
+
+        T *moved = static_cast<T *>(::operator new(grown * sizeof(T)));
+        for (size_t i = 0 ; i < count ; i++)
+            FE_relocate(moved + i, items[i]);
+        if (!is_inline())
+            ::operator delete(items);
+        items = moved;
+        _capacity = grown;
+    }
+
+    /** Add a default constructed element, to be filled in place. */
+    T &push_back() {
+        reserve(count + 1);
+        new (items + count) T();
+        return items[count++];
+    }
+
+    void push_back(const T &value) {
+        if (count == _capacity) {
+            //value may be one of the elements about to move.
+            T copy(value);
+            reserve(count + 1);
+            new (items + count) T(copy);
+        } else {
+            new (items + count) T(value);
+        }
+        count++;
+    }
+
+    void pop_back() { items[--count].~T(); }
+
+    void clear() {
+        while (count)
+            pop_back();
+    }
+
+    void resize(size_t n) {
+        while (count > n)
+            pop_back();
+        reserve(n);
+        for ( ; count < n ; count++)
+            new (items + count) T();
+    }
+
+    /** Exchange contents. Heap storage is swapped, inline elements are
+     * relocated. */
+    void swap(FE_SmallVector &other) {
+        if (this == &other)
+            return;
+        FE_SmallVector tmp;
+        tmp.take(*this);
+        take(other);
+        other.take(tmp);
+    }
+};
+
+#endif /* FE_SMALL_VECTOR_H */
@@ -0,0 +1,179 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#ifndef FE_SNAPSHOT_H
+#define FE_SNAPSHOT_H
+
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+
+#include "fire_objects.h"
+
+using namespace std;
+
+/** Version written by FE_SnapshotWriter. Readers accept this and older. */
+#define FE_SNAPSHOT_VERSION 2
+
+/**
+ * A snapshot is a binary file of decoded FE_user and FE_location records,
+ * for saving a location cache across restarts without going back to Fire
+ * Eagle. It starts with the magic "FESN" and a version; then come records,
+ * each a type byte followed by the fields of the object:
+ *
+ * - Integers are varints (7 bits per byte, low bits first). Signed ones are
+ *   zigzag encoded first.
+ * - Names from a bounded vocabulary (timezones, level names, and the names
+ *   and place ids of cities and coarser levels) are written once, the first
+ *   time they appear, and referenced by index afterwards. Labels and the
+ *   names of finer levels, nearly unique, are written as text each time, so
+ *   the writer does not keep them.
+ * - WOEID hierarchies are a count and the WOEIDs. Version 1 wrote them as
+ *   names.
+ * - Coordinates are stored as multiples of 1e-7 degrees, each the
+ *   difference from the previous coordinate in the file, so the levels of
+ *   one user take a byte or two per coordinate. Geometries with coordinates
+ *   that would not come back exactly are stored as plain doubles.
+ * - Timestamps are the difference from the previous one in milliseconds,
+ *   plus the offset from UTC. Those not in the form FE_format_timestamp
+ *   writes are stored as text.
+ *
+ * Everything FE_location and FE_user hold comes back identical. A
+ * woeid_hierarchy that FE_user::woeids does not give back is stored as text,
+ * and woeids parsed again from it. Because of the differences and the names,
+ * a snapshot can only be read from the start.
+ */
+enum FE_snapshot_record {
+    /** No more records. */
+    FE_SNAPSHOT_END = 0,
+    FE_SNAPSHOT_USER = 1,
+    FE_SNAPSHOT_LOCATION = 2
+};
+
+/**
+ * Writes a snapshot, one record at a time, so a batch of any size can be
+ * written without holding it all. Output is buffered; errors are thrown as
+ * FireEagleException pointers with FE_INTERNAL_ERROR. Not thread-safe.
+ */
+class FE_SnapshotWriter {
+  private:
+    FILE *fp;
+    bool owned;
+    string buffer;
+    size_t _records;
+    size_t _bytes;
+    /** Delta state, mirrored by the reader. */
+    long long last_lat;
+    long long last_lon;
+    long long last_ms;
+    /** Names written so far, and an open addressing table of their
+     * indexes + 1 (0 for a free slot). */
+    vector<string> names;
+    vector<unsigned int> slots;
+    /** Scratch space for the coordinates of a geometry. */
+    vector<double> coords;
+    vector<long long> quantized;
+
+    void begin();
+    void put_varint(unsigned long long value);
+    void put_signed(long long value);
+    void put_text(const string &text);
+    void put_name(const string &name);
+    void put_level_name(unsigned int level, const string &name);
+    void put_timestamp(bool raw, const string &text, long long ms, int offset);
+    void put_location(const FE_location &location);
+    void maybe_flush();
+
+    FE_SnapshotWriter(const FE_SnapshotWriter &other);
+    FE_SnapshotWriter &operator=(const FE_SnapshotWriter &other);
+
+  public:
+    /** Create or truncate a file. */
+    FE_SnapshotWriter(const string &file);
+
+    /** Write to an open stream, such as a pipe. The stream is not closed. */
+    FE_SnapshotWriter(FILE *_fp);
+
+    /** Flushes, and closes the file if this writer opened it. Errors at this
+     * point are lost: call flush() first to see them. */
+    ~FE_SnapshotWriter();
+
+    void write(const FE_user &user);
+    void write(const FE_location &location);
+
+    /** Write out the buffered records. */
+    void flush();
+
+    /** Records written so far. */
+    size_t records() const;
+
+    /** Bytes written so far, including buffered ones. */
+    size_t bytes() const;
+};
+
+/**
+ * Reads a snapshot straight from memory: a file is mapped, not copied, and
+ * names are kept as views into it, so reading a record only copies the
+ * fields into the object it fills. Reusing the same object for every record
+ * reuses its string buffers too. Corrupt or truncated data is thrown as a
+ * FireEagleException pointer with FE_INTERNAL_ERROR. Not thread-safe.
+ */
+class FE_SnapshotReader {
+  private:
+    const char *data;
+    size_t length;
+    size_t pos;
+    unsigned int version;
+    /** Set when the data is a mapping owned by the reader. */
+    void *mapping;
+    long long last_lat;
+    long long last_lon;
+    long long last_ms;
+    vector<FE_StringRef> names;
+    /** Polygon vertices of the locations read. Created on demand. */
+    FE_VertexArena *arena;
+    vector<double> vertices;
+
+    void begin();
+    void corrupt(const char *what) const;
+    unsigned long long get_varint();
+    long long get_signed();
+    FE_StringRef get_bytes(size_t len);
+    FE_StringRef get_text();
+    FE_StringRef get_name();
+    FE_StringRef get_level_name(unsigned int level);
+    void get_timestamp(bool raw, string &text, long long &ms);
+    void get_location(FE_location &location);
+    void expect(enum FE_snapshot_record type);
+
+    FE_SnapshotReader(const FE_SnapshotReader &other);
+    FE_SnapshotReader &operator=(const FE_SnapshotReader &other);
+
+  public:
+    /** Map a file written by FE_SnapshotWriter. */
+    FE_SnapshotReader(const string &file);
+
+    /** Read a snapshot in memory. The data must outlive the reader. */
+    FE_SnapshotReader(const char *_data, size_t _length);
+
+    ~FE_SnapshotReader();
+
+    /** @return The type of the next record, without reading it. */
+    enum FE_snapshot_record peek() const;
+
+    /**
+     * Read the next record into user.
+     * @return false at the end of the snapshot. Throws if the next record is
+     * a location.
+     */
+    bool next(FE_user &user);
+
+    /** Like next(FE_user &), for a location record. */
+    bool next(FE_location &location);
+};
+
+#endif /* FE_SNAPSHOT_H */
@@ -0,0 +1,154 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#ifndef FE_UPDATE_COALESCER_H
+#define FE_UPDATE_COALESCER_H
+
+#include <string>
+#include <map>
+
+#include <pthread.h>
+
+#include "fireeagle.h"
+#include "fire_objects.h"
+
+using namespace std;
+
+/** What FE_UpdateCoalescer::submit did with an update. */
+enum FE_update_action {
+    /** Sent now: the first for its token, or the window had passed. */
+    FE_UPDATE_SENT = 0,
+    /** Sent now because it crossed the boundary of a location level. */
+    FE_UPDATE_SENT_BOUNDARY,
+    /** Not a position (see FE_GeoCache::parse_query), sent now as it is. */
+    FE_UPDATE_SENT_OTHER,
+    /** Dropped: too close to the last position sent. */
+    FE_UPDATE_SUPPRESSED,
+    /** Held until the window ends; a later update may replace it. */
+    FE_UPDATE_DEFERRED
+};
+
+/** Counters of a FE_UpdateCoalescer. */
+struct FE_UpdateStats {
+    /** Updates given to submit. */
+    unsigned long long submitted;
+    /** Updates sent to Fire Eagle, including deferred ones. */
+    unsigned long long sent;
+    /** Of sent, those sent early because they crossed a level boundary. */
+    unsigned long long boundary;
+    /** Dropped for being too close to the last position sent. */
+    unsigned long long suppressed;
+    /** Deferred updates replaced by a later one before being sent. */
+    unsigned long long merged;
+    /** Deferred updates that failed to send. */
+    unsigned long long errors;
+    /** Deferred updates waiting for their window to end. */
+    size_t pending;
+};
+
+/**
+ * Cuts down the update calls of clients sending GPS fixes every few seconds,
+ * most of which repeat the last position. Updates are given to submit()
+ * per access token instead of FireEagle::update:
+ *
+ * - A position within min_distance meters of the last one sent is dropped.
+ * - At most one position per token is sent per window: a position arriving
+ *   sooner is held, replacing any held before it, and the latest one is
+ *   sent by a background thread when the window ends.
+ * - A position that crosses a level boundary is sent at once. Boundaries
+ *   are the areas of the user's levels given to set_location (a city, a
+ *   neighborhood); without them, geohash cells of boundary_precision
+ *   characters (see FE_geohash).
+ *
+ * Positions are updates with 'lat' and 'lon' or q="lat,lon" only, as read
+ * by FE_GeoCache::parse_query; other updates are sent at once.
+ * Errors of updates sent by submit are thrown to its caller as
+ * FireEagle::update does; errors of deferred updates are counted.
+ * Thread-safe.
+ */
+class FE_UpdateCoalescer {
+  public:
+    /** Internal. Defined in fe_update_coalescer.cc. */
+    struct State;
+
+  private:
+    FireEagleConfig *config;
+    double min_distance;
+    long long window_ms;
+    unsigned int boundary_precision;
+
+    mutable pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_t timer;
+    bool running;
+    map<string, State *> states;
+    /** Tokens with a deferred update, by the time it is due. */
+    multimap<long long, string> due;
+    FE_UpdateStats counters;
+
+    static void *timer_main(void *arg);
+    void timer_loop();
+    bool crosses_boundary(const State &state, double lat, double lon) const;
+    void send_due(bool all);
+
+    FE_UpdateCoalescer(const FE_UpdateCoalescer &other);
+    FE_UpdateCoalescer &operator=(const FE_UpdateCoalescer &other);
+
+  protected:
+    /** Send an update. The default calls FireEagle::update with the token.
+     * Called on the timer thread for deferred updates. */
+    virtual void send(const OAuthTokenPair &token, const FE_ParamPairs &args);
+
+  public:
+    /**
+     * Starts the timer thread. Throws a FireEagleException pointer with
+     * FE_INTERNAL_ERROR if it cannot.
+     * @param _config Config for the requests. Not owned.
+     * @param _min_distance Meters a position must be from the last one sent.
+     * @param window_seconds Shortest time between two updates of a token,
+     * other than those crossing a boundary.
+     * @param _boundary_precision Geohash characters of the cells used as
+     * boundaries for users without set_location. 0 for none.
+     */
+    FE_UpdateCoalescer(FireEagleConfig *_config, double _min_distance = 50,
+                       unsigned int window_seconds = 30,
+                       unsigned int _boundary_precision = 5);
+
+    /** Calls stop(). */
+    virtual ~FE_UpdateCoalescer();
+
+    /**
+     * Send the deferred updates now and stop the timer thread. Later
+     * updates are sent or dropped by submit, never deferred. Subclasses
+     * overriding send must call this in their destructor.
+     */
+    void stop();
+
+    /**
+     * Take an update for a token.
+     * @param args Arguments as for FireEagle::update.
+     * @return What was done with it.
+     */
+    enum FE_update_action submit(const OAuthTokenPair &token, const FE_ParamPairs &args);
+
+    /** Use the areas of the levels of user (from FireEagle::user_object) as
+     * the boundaries of its token. */
+    void set_location(const OAuthTokenPair &token, const FE_user &user);
+
+    /** Send the deferred update of a token now, if any. */
+    void flush(const OAuthTokenPair &token);
+
+    /** Forget a token, dropping its deferred update. */
+    void forget(const OAuthTokenPair &token);
+
+    FE_UpdateStats stats() const;
+
+    /** Share of the submitted updates that were not sent: dropped, or
+     * replaced while deferred. */
+    double suppression_ratio() const;
+};
+
+#endif /* FE_UPDATE_COALESCER_H */
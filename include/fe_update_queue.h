@@ -0,0 +1,160 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#ifndef FE_UPDATE_QUEUE_H
+#define FE_UPDATE_QUEUE_H
+
+#include <string>
+#include <deque>
+#include <vector>
+
+#include <pthread.h>
+
+#include "fireeagle.h"
+
+using namespace std;
+
+/** What FE_UpdateQueue::submit does when the queue is full. */
+enum FE_queue_policy {
+    /** Wait for room. */
+    FE_QUEUE_BLOCK = 0,
+    /** Drop the oldest queued update to make room. */
+    FE_QUEUE_DROP_OLDEST,
+    /** Refuse the new update. */
+    FE_QUEUE_REJECT
+};
+
+/**
+ * Receives the outcome of the updates of a FE_UpdateQueue. Called on the
+ * sender threads, or on the thread calling submit for dropped updates:
+ * return quickly and do not call back into the queue.
+ */
+class FE_UpdateCallback {
+  public:
+    virtual ~FE_UpdateCallback() {}
+
+    /**
+     * An update was sent.
+     * @param response Response of Fire Eagle, when error is NULL.
+     * @param error Why it failed, or NULL. Owned by the queue.
+     * @param wait_ms Time it spent queued.
+     */
+    virtual void update_done(const OAuthTokenPair &token, const FE_ParamPairs &args,
+                             const string &response, const FireEagleException *error,
+                             long long wait_ms) {}
+
+    /** An update was dropped, unsent, by FE_QUEUE_DROP_OLDEST. */
+    virtual void update_dropped(const OAuthTokenPair &token, const FE_ParamPairs &args) {}
+};
+
+/** Counters and gauges of a FE_UpdateQueue. */
+struct FE_UpdateQueueStats {
+    /** Updates accepted by submit. */
+    unsigned long long submitted;
+    /** Updates sent successfully. */
+    unsigned long long sent;
+    /** Updates sent that failed. */
+    unsigned long long failed;
+    /** Updates dropped by FE_QUEUE_DROP_OLDEST. */
+    unsigned long long dropped;
+    /** Updates refused by FE_QUEUE_REJECT, or after stop. */
+    unsigned long long rejected;
+    /** Updates queued now. */
+    size_t depth;
+    /** Deepest the queue has been. */
+    size_t max_depth;
+    /** Updates being sent now. */
+    size_t in_flight;
+    /** Time the oldest queued update has waited, 0 if none. */
+    long long oldest_age_ms;
+    /** Total time the sent and failed updates spent queued. */
+    long long total_wait_ms;
+};
+
+/**
+ * Sends updates in the background so that request threads do not wait for
+ * the round trip of FireEagle::update: submit() copies the update into a
+ * bounded queue and returns. A fixed set of sender threads takes the
+ * updates one at a time, signs and sends them, and reports each outcome to
+ * a FE_UpdateCallback. Each update is its own request, so a sender only
+ * takes the next one when it is free: a slow update holds up no other.
+ *
+ * Updates are started in the order they were submitted; with more than one
+ * sender, updates of a token may complete out of order. Thread-safe.
+ */
+class FE_UpdateQueue {
+  public:
+    /** Internal. Defined in fe_update_queue.cc. */
+    struct Item;
+
+  private:
+    FireEagleConfig *config;
+    FE_UpdateCallback *callback;
+    size_t capacity;
+    enum FE_queue_policy policy;
+
+    mutable pthread_mutex_t lock;
+    /** Signalled when updates are queued or the queue stops. */
+    pthread_cond_t work;
+    /** Signalled when updates are taken from the queue. */
+    pthread_cond_t room;
+    /** Signalled when nothing is queued or being sent. */
+    pthread_cond_t idle;
+    deque<Item *> items;
+    vector<pthread_t> threads;
+    bool stopping;
+    FE_UpdateQueueStats counters;
+
+    static void *sender_main(void *arg);
+    void send_loop();
+
+    FE_UpdateQueue(const FE_UpdateQueue &other);
+    FE_UpdateQueue &operator=(const FE_UpdateQueue &other);
+
+  protected:
+    /** Send an update, on a sender thread. The default calls
+     * FireEagle::update with the token. */
+    virtual string send(const OAuthTokenPair &token, const FE_ParamPairs &args);
+
+  public:
+    /**
+     * Start the sender threads. Throws a FireEagleException pointer with
+     * FE_INTERNAL_ERROR if none can be started.
+     * @param _config Config for the requests. Not owned.
+     * @param _callback Receives the outcomes. Not owned; NULL for none.
+     * @param nsenders Number of sender threads, at least 1.
+     * @param _capacity Most updates queued at once, at least 1.
+     * @param _policy What submit does when the queue is full.
+     */
+    FE_UpdateQueue(FireEagleConfig *_config, FE_UpdateCallback *_callback = NULL,
+                   unsigned int nsenders = 4, size_t _capacity = 1024,
+                   enum FE_queue_policy _policy = FE_QUEUE_BLOCK);
+
+    /** Calls stop(). */
+    virtual ~FE_UpdateQueue();
+
+    /**
+     * Send the updates already queued, then stop the sender threads. Later
+     * submits are rejected. Subclasses overriding send must call this in
+     * their destructor.
+     */
+    void stop();
+
+    /**
+     * Queue an update.
+     * @param args Arguments as for FireEagle::update. Copied.
+     * @return false if it was refused: the queue is full with
+     * FE_QUEUE_REJECT, or stopped.
+     */
+    bool submit(const OAuthTokenPair &token, const FE_ParamPairs &args);
+
+    /** Wait until every update submitted so far has been sent or dropped. */
+    void wait_idle();
+
+    FE_UpdateQueueStats stats() const;
+};
+
+#endif /* FE_UPDATE_QUEUE_H */
@@ -0,0 +1,143 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#ifndef FE_USER_CACHE_H
+#define FE_USER_CACHE_H
+
+#include <string>
+
+#include <pthread.h>
+
+#include "fireeagle.h"
+#include "fire_objects.h"
+#include "fe_worker_pool.h"
+
+using namespace std;
+
+/** Counters of a FE_UserCache. */
+struct FE_UserCacheStats {
+    /** get calls answered from the cache. */
+    unsigned long long hits;
+    /** get calls that had to call Fire Eagle: no entry, or an expired one. */
+    unsigned long long misses;
+    /** Refreshes started in the background. */
+    unsigned long long refreshes;
+    /** Background refreshes that failed; the entry is kept until it expires. */
+    unsigned long long refresh_errors;
+    /** Entries dropped, least recently used first, to stay in the budget. */
+    unsigned long long evictions;
+    size_t entries;
+    /** Estimated bytes held by the entries, not counting FE_interner(). */
+    size_t bytes;
+};
+
+/**
+ * Caches the 'user' call for many access tokens, for applications polling
+ * their users' locations. Users are kept as FE_compact_user within a memory
+ * budget. The budget covers everything an entry holds, including the
+ * labels and the names of fine levels (addresses, postal codes) that the
+ * compact form keeps itself. The names of cities and coarser levels, level
+ * names and timezones are shared through FE_interner() and not counted:
+ * they grow with the number of distinct places seen, not with the number
+ * of users or updates.
+ *
+ * How long a user is kept depends on how long ago it last moved, from the
+ * located-at timestamp: a user who updated a minute ago may update again
+ * soon, one who has not moved in days probably will not. The time to live
+ * is a fraction of that idle time, within bounds. When a user is read
+ * towards the end of its time to live, it is returned from the cache and a
+ * refresh is queued on a FE_WorkerPool, so users read regularly are
+ * always answered without waiting. Only users not in the cache, or expired
+ * because nobody read them in time, are fetched while the caller waits.
+ *
+ * Thread-safe. The cache is split into shards, each with its own lock.
+ */
+class FE_UserCache {
+  public:
+    /** Internal. Defined in fe_user_cache.cc. */
+    struct Shard;
+    struct Entry;
+
+  private:
+    FireEagleConfig *config;
+    FE_WorkerPool *pool;
+    Shard *shards;
+    unsigned int min_ttl_ms;
+    unsigned int max_ttl_ms;
+    double idle_fraction;
+    double refresh_fraction;
+
+    /** Refreshes queued or running, waited for by the destructor. */
+    pthread_mutex_t refresh_lock;
+    pthread_cond_t refresh_done;
+    unsigned int refreshing;
+
+    unsigned int ttl_for(const FE_user &user) const;
+    void store(const OAuthTokenPair &token, const FE_user &user,
+               unsigned long long generation, unsigned long long epoch);
+    void finish_refresh(const string &token, unsigned long long generation, bool ok);
+
+    friend class FE_UserRefreshTask;
+
+    FE_UserCache(const FE_UserCache &other);
+    FE_UserCache &operator=(const FE_UserCache &other);
+
+  protected:
+    /**
+     * Get a user from Fire Eagle. Called on the worker threads too. The
+     * default calls FireEagle::user_object with the token. Override to
+     * use a FireEagle subclass.
+     */
+    virtual void fetch(const OAuthTokenPair &token, FE_user &user);
+
+  public:
+    /**
+     * @param _config Config for the requests. Not owned.
+     * @param _pool Pool for the refreshes. Not owned; it must outlive the
+     * cache. NULL to never refresh ahead.
+     * @param max_bytes Memory budget of the entries.
+     */
+    FE_UserCache(FireEagleConfig *_config, FE_WorkerPool *_pool,
+                 size_t max_bytes = 16 * 1024 * 1024);
+
+    /** Waits for the refreshes still queued or running. */
+    virtual ~FE_UserCache();
+
+    /** Wait for the refreshes queued or running. Subclasses overriding
+     * fetch must call this in their destructor, before the refreshes can
+     * no longer reach their fetch. */
+    void wait_refreshes();
+
+    /**
+     * Set how long users are kept. Not thread-safe: call before sharing the
+     * cache.
+     * @param min_seconds Shortest time to live. Also used for users with no
+     * located-at timestamp. 60 by default.
+     * @param max_seconds Longest time to live. 3600 by default.
+     * @param fraction Time to live as a fraction of the time since the user
+     * last moved. 0.25 by default.
+     * @param refresh_at Fraction of the time to live after which reads
+     * queue a refresh. 0.75 by default; 1 never refreshes ahead.
+     */
+    void set_ttl(unsigned int min_seconds, unsigned int max_seconds, double fraction,
+                 double refresh_at = 0.75);
+
+    /**
+     * Get the user of an access token, from the cache when possible.
+     * Throws as FireEagle::user_object when it has to call Fire Eagle.
+     * @param user Out argument.
+     */
+    void get(const OAuthTokenPair &token, FE_user &user);
+
+    /** Drop a user, for instance after updating its location. Fetches of
+     * the user already in flight, by a refresh or a miss, are not stored;
+     * a miss of another user of the same shard may not be either. */
+    void invalidate(const OAuthTokenPair &token);
+
+    FE_UserCacheStats stats() const;
+};
+
+#endif /* FE_USER_CACHE_H */
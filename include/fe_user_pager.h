@@ -0,0 +1,123 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#ifndef FE_USER_PAGER_H
+#define FE_USER_PAGER_H
+
+#include <string>
+#include <deque>
+#include <vector>
+
+#include "fireeagle.h"
+#include "fire_objects.h"
+#include "fe_worker_pool.h"
+
+using namespace std;
+
+/** The calls a FE_UserPager can page through. */
+enum FE_user_list {
+    /** FireEagle::within */
+    FE_LIST_WITHIN = 0,
+    /** FireEagle::recent */
+    FE_LIST_RECENT
+};
+
+/** Counters of a FE_UserPager. */
+struct FE_UserPagerStats {
+    /** Calls made. */
+    unsigned long long pages;
+    /** Pages fetched past the last one, the first that was not full, and
+     * discarded. At most the prefetch depth. Pages dropped by closing early or
+     * after a failed page are not counted. */
+    unsigned long long wasted;
+    /** Users returned by next. */
+    unsigned long long users;
+};
+
+/**
+ * Reads the users of a 'within' or 'recent' call one at a time, asking for
+ * them page by page with the 'start' and 'count' arguments instead of in
+ * one document. Only the page being read is decoded, and only the pages
+ * fetched ahead are kept as responses, so memory does not grow with the
+ * size of the result.
+ *
+ * With a FE_WorkerPool, the next prefetch pages are fetched in the
+ * background while the caller reads the current one. The end of the result
+ * is only known from a page that is not full, so up to prefetch pages may
+ * be fetched past it.
+ *
+ * Not thread-safe: read from one thread at a time.
+ */
+class FE_UserPager {
+  public:
+    /** Internal. Defined in fe_user_pager.cc. */
+    struct Page;
+
+  private:
+    FireEagleConfig *config;
+    enum FE_user_list call;
+    FE_ParamPairs args;
+    FE_WorkerPool *pool;
+    unsigned int page_size;
+    unsigned int prefetch;
+
+    /** Pages asked for and not read yet, in order. */
+    deque<Page *> ahead;
+    unsigned int next_start;
+    /** A page that was not full has been read: ask for no more. */
+    bool last_page;
+    bool finished;
+    vector<FE_user> users;
+    size_t position;
+    FE_UserPagerStats counters;
+
+    void request_pages();
+
+    friend struct Page;
+
+    FE_UserPager(const FE_UserPager &other);
+    FE_UserPager &operator=(const FE_UserPager &other);
+
+  protected:
+    /** Make one call, possibly on a worker thread. The default calls
+     * FireEagle::within or FireEagle::recent. */
+    virtual string fetch_page(const FE_ParamPairs &page_args);
+
+  public:
+    /**
+     * Nothing is fetched before the first call to next.
+     * @param _config Config with the general token. Not owned.
+     * @param _call The call to page through.
+     * @param _args Arguments of the call, but for 'start' and 'count'.
+     * @param _pool Pool for the prefetches. Not owned; NULL to fetch each
+     * page on the thread calling next, when it is needed.
+     * @param _page_size Users per call (the 'count' argument).
+     * @param _prefetch Pages fetched ahead of the one being read, with a
+     * pool.
+     */
+    FE_UserPager(FireEagleConfig *_config, enum FE_user_list _call,
+                 const FE_ParamPairs &_args = empty_params, FE_WorkerPool *_pool = NULL,
+                 unsigned int _page_size = 100, unsigned int _prefetch = 1);
+
+    /** Calls close(). */
+    virtual ~FE_UserPager();
+
+    /**
+     * Get the next user. Throws like FireEagle::within or FireEagle::recent
+     * when a page fails; the pager is then closed.
+     * @param user Out argument.
+     * @return false at the end of the result.
+     */
+    bool next(FE_user &user);
+
+    /** Stop reading: wait for the pages in flight and drop them. Subclasses
+     * overriding fetch_page must call this in their destructor. */
+    void close();
+
+    FE_UserPagerStats stats() const;
+};
+
+#endif /* FE_USER_PAGER_H */
@@ -0,0 +1,133 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#ifndef FE_WORKER_POOL_H
+#define FE_WORKER_POOL_H
+
+#include <string>
+#include <list>
+#include <vector>
+
+#include <pthread.h>
+
+using namespace std;
+
+class FireEagleException;
+
+/**
+ * A unit of work for FE_WorkerPool. Override run(); the pool deletes the
+ * task once it has run.
+ */
+class FE_Task {
+  public:
+    virtual ~FE_Task() {}
+
+    /** Called on a worker thread. Exceptions thrown out of it are caught
+     * and deleted by the pool: handle them here. */
+    virtual void run() = 0;
+};
+
+/**
+ * A fixed set of threads running FE_Task objects in the order they were
+ * submitted, for work that must not block the thread asking for it:
+ * refreshing caches, sending requests, fetching the next page of a result.
+ */
+class FE_WorkerPool {
+  private:
+    mutable pthread_mutex_t lock;
+    /** Signalled when a task is queued or the pool stops. */
+    pthread_cond_t work;
+    /** Signalled when the pool has nothing queued or running. */
+    pthread_cond_t idle;
+    list<FE_Task *> tasks;
+    vector<pthread_t> threads;
+    unsigned int running;
+    bool stopping;
+
+    static void *worker_main(void *arg);
+    void work_loop();
+
+    FE_WorkerPool(const FE_WorkerPool &other);
+    FE_WorkerPool &operator=(const FE_WorkerPool &other);
+
+  public:
+    /**
+     * Start the threads. Throws a FireEagleException pointer with
+     * FE_INTERNAL_ERROR if none can be started.
+     * @param nthreads Number of threads, at least 1.
+     */
+    FE_WorkerPool(unsigned int nthreads = 4);
+
+    /** Runs the tasks already submitted, then stops the threads. */
+    ~FE_WorkerPool();
+
+    /**
+     * Queue a task. The pool owns it from now on.
+     * @return false, deleting the task, if the pool is stopping.
+     */
+    bool submit(FE_Task *task);
+
+    /** Wait until every task submitted so far has run. */
+    void wait_idle();
+
+    /** Tasks waiting for a thread. */
+    size_t pending() const;
+
+    /** Number of threads. */
+    size_t size() const;
+};
+
+/**
+ * A call returning a string, such as fetching a page of a result, made on a
+ * worker of a FE_WorkerPool while the thread that started it does something
+ * else, then waits for its outcome. Override call(). A started call must be
+ * waited for before it is destroyed or started again.
+ */
+class FE_PendingCall {
+  private:
+    pthread_mutex_t lock;
+    pthread_cond_t finished;
+    bool pending;
+    string response;
+    FireEagleException *error;
+    /** Names the call in the error for an unknown exception. */
+    const char *context;
+
+    FE_PendingCall(const FE_PendingCall &other);
+    FE_PendingCall &operator=(const FE_PendingCall &other);
+
+  protected:
+    /** Make the call. Throws a FireEagleException pointer on failure. */
+    virtual string call() = 0;
+
+  public:
+    /** @param _context Static string, such as "FE_UserPager::fetch_page". */
+    FE_PendingCall(const char *_context);
+
+    virtual ~FE_PendingCall();
+
+    /**
+     * Start the call on a worker of a pool, or make it on this thread.
+     * @param pool Not owned. NULL to make the call now; also made now if
+     * the pool is stopping.
+     * @return true if the call was queued on the pool.
+     */
+    bool start(FE_WorkerPool *pool);
+
+    /** Make the call on this thread and record its outcome. */
+    void run();
+
+    /** Wait until the call started has finished. */
+    void wait();
+
+    /**
+     * Wait, then throw the error of the call if any.
+     * @return The response of the call. May be swapped out.
+     */
+    string &take();
+};
+
+#endif /* FE_WORKER_POOL_H */
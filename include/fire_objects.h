@@ -10,8 +10,12 @@
 
 #include <string>
 #include <list>
+#include <vector>
 
 #include "fireeagle.h" //For FireEagleConfig
+#include "parser_iface.h"
+#include "fe_intern.h"
+#include "fe_small_vector.h"
 
 using namespace std;
 
@@ -25,18 +29,94 @@ enum FE_geometry_type {
     FEGeo_POINT,
     /** A bounding box */
     FEGeo_BOX,
-    /** A polygon defined by a sequence of lines. Not implemented */
+    /** A closed polygon, vertices in a FE_VertexArena */
     FEGeo_POLYGON
 };
 
 /**
- * Base class for all geometries. Basically a parsed structure for
- * response received.
+ * Result of decoding the text of a georss element.
+ */
+enum FE_georss_status {
+    FE_GEORSS_OK = 0,
+    /** Something other than white space separated decimal numbers */
+    FE_GEORSS_SYNTAX,
+    /** Wrong number of coordinates for the geometry */
+    FE_GEORSS_COUNT,
+    /** A latitude outside [-90, 90] or a longitude outside [-180, 180] */
+    FE_GEORSS_RANGE,
+    /** An element other than georss:point, georss:box and georss:polygon */
+    FE_GEORSS_UNSUPPORTED
+};
+
+/**
+ * Read the coordinates of a georss element in place, without allocating.
+ * The text is a white space separated list of (latitude, longitude) pairs.
+ * @param text The text. Need not be null terminated.
+ * @param len Length of the text.
+ * @param coords Out argument for up to max coordinates.
+ * @param max Capacity of coords.
+ * @param count Out argument: number of coordinates in the text. Also set when
+ * it is more than max, so the caller can retry with a bigger array.
+ * @return FE_GEORSS_COUNT for an odd count or more than max coordinates.
+ */
+enum FE_georss_status FE_parse_georss(const char *text, size_t len, double *coords,
+                                      unsigned int max, unsigned int *count);
+
+/**
+ * Reference counted storage for polygon vertices, shared by all the
+ * geometries decoded from the same responses so that a polygon costs no
+ * allocation of its own. Vertices are (latitude, longitude) pairs. An arena is
+ * filled by one thread; the geometries pointing into it can then be copied
+ * and read from any number of threads.
+ */
+class FE_VertexArena {
+  private:
+    vector<double> coords;
+    int refs;
+
+    FE_VertexArena(const FE_VertexArena &other);
+    FE_VertexArena &operator=(const FE_VertexArena &other);
+
+  public:
+    /** Starts with a reference count of 1, owned by the creator. */
+    FE_VertexArena();
+
+    void ref();
+    /** Drop a reference. Deletes the arena when it was the last one. */
+    void unref();
+
+    /**
+     * Append vertices.
+     * @param latlon npoints (latitude, longitude) pairs.
+     * @param npoints Number of vertices.
+     * @return Index of the first appended vertex.
+     */
+    unsigned int add(const double *latlon, unsigned int npoints);
+
+    /** Number of vertices stored, in all polygons. */
+    unsigned int size() const;
+
+    /** @return Pointer to the pair of vertex i. Invalidated by add. */
+    const double *vertex(unsigned int i) const;
+};
+
+/**
+ * A geometry from a location response. A plain value: points and boxes are
+ * stored inline, polygon vertices in a shared FE_VertexArena. There are no
+ * virtual methods, so copying a FEGeo_Point or FEGeo_Box into a
+ * FE_geometry loses nothing.
  */
 class FE_geometry {
+  private:
+    FE_VertexArena *arena;
+    unsigned int first_vertex;
+    unsigned int nvertices;
+
   public:
-    /** Type of the derived class */
+    /** Type of the geometry */
     enum FE_geometry_type type;
+    /** Why the geometry is FEGeo_INVALID after set_from_georss. */
+    enum FE_georss_status error;
     /** Center of the bounding box in case of an area or polygon.
      * Initialized to 0.
      */
@@ -45,43 +125,76 @@ class FE_geometry {
      * Initialized to 0.
      */
     double longitude;
+    /** Bounding box of the geometry. For a point, all four are the point
+     * itself. Initialized to 0 */
+    double min_lat;
+    double min_lon;
+    double max_lat;
+    double max_lon;
 
     /**
-     * @param type Each derived class is expected to supply the correct
-     * type.
+     * @param type Type of the geometry. Coordinates start at 0.
      */
     FE_geometry(FE_geometry_type type = FEGeo_INVALID);
 
-    /** Method for debugging. Override for your own style.
+    FE_geometry(const FE_geometry &other);
+    FE_geometry &operator=(const FE_geometry &other);
+    ~FE_geometry();
+
+    /** Make this a point. */
+    void set_point(double lat, double lon);
+
+    /** Make this a box. The center is the middle of the box. */
+    void set_box(double _min_lat, double _min_lon, double _max_lat, double _max_lon);
+
+    /**
+     * Make this a polygon. The bounding box is computed once here.
+     * @param _arena Arena to store the vertices in. Referenced, not owned.
+     * @param latlon npoints (latitude, longitude) pairs, as in georss:polygon.
+     * @param npoints Number of vertices.
+     */
+    void set_polygon(FE_VertexArena *_arena, const double *latlon, unsigned int npoints);
+
+    /**
+     * Decode a georss element. On failure the geometry is left FEGeo_INVALID
+     * with the reason in error; nothing is thrown.
+     * @param id FE_NODE_GEORSS_POINT, FE_NODE_GEORSS_BOX or
+     * FE_NODE_GEORSS_POLYGON. Anything else is FE_GEORSS_UNSUPPORTED.
+     * @param text Text of the element.
+     * @param len Length of the text.
+     * @param _arena Arena for polygon vertices. May be NULL for the others.
+     * @return The new value of error.
+     */
+    enum FE_georss_status set_from_georss(enum FE_node_id id, const char *text, size_t len,
+                                          FE_VertexArena *_arena);
+
+    /** Number of polygon vertices. 0 for the other types. */
+    unsigned int vertex_count() const;
+
+    /** @return (latitude, longitude) of polygon vertex i. */
+    const double *vertex(unsigned int i) const;
+
+    /** Method for debugging. Prints according to the type.
      * @param os Any output stream.
      * @param indent Indentation level. Used for pretty printing.
      */
-    virtual void print(ostream &os, unsigned int indent = 0) const;
+    void print(ostream &os, unsigned int indent = 0) const;
 };
 
-/** Implementation of a point location. Basically the same as the base
- * class.
+/** A point location. Kept for compatibility: a FE_geometry of type
+ * FEGeo_POINT.
  */
 class FEGeo_Point : public FE_geometry {
   public:
     FEGeo_Point();
-    virtual void print(ostream &os, unsigned int indent = 0) const;
 };
 
-/**Implementation of a bounding box location. */
+/** A bounding box location. Kept for compatibility: a FE_geometry of type
+ * FEGeo_BOX, with the bounds in FE_geometry.
+ */
 class FEGeo_Box : public FE_geometry {
   public:
-    /** Minimum latitude of the box. Initialized to 0 */
-    double min_lat;
-    /** Minimum longitude of the box. Initialized to 0 */
-    double min_lon;
-    /** Maximum latitude of the box. Initialized to 0 */
-    double max_lat;
-    /** Maximum longitude of the box. Initialized to 0 */
-    double max_lon;
-
     FEGeo_Box();
-    virtual void print(ostream &os, unsigned int indent = 0) const;
 };
 
 /** A parsed structure for a location. Note that all member variables
@@ -103,9 +216,11 @@ class FE_location {
     /** Timestamp of update of location at the current level as recorded by Fire Eagle.
      * The reason for the legalese is that your country level can still not get updated
      * if you are going from one city to another city in the same country.
-     * Not sure if this includes the TZ.
-     * Would have preferred a UTC */
+     * The text includes the offset from UTC; see timestamp_ms for the UTC value. */
     string timestamp;
+    /** timestamp in milliseconds since the epoch (UTC), parsed once when the
+     * location is decoded. 0 if the timestamp is missing or not ISO 8601. */
+    long long timestamp_ms;
     /** The complete location string including less granular levels. */
     string full_location;
     /** Name of the location object at current level. For example, if the level is a 'city',
@@ -131,6 +246,9 @@ class FE_location {
      */
     virtual void print(ostream &os, unsigned int indent = 0) const;
 
+    /** Exchange contents with another location without copying strings. */
+    void swap(FE_location &other);
+
     /** Factory method to parse API responses according to content type. Throws
      * exception if the content_type is not handled in config.
      * @param resp The actual response body to be parsed.
@@ -144,6 +262,21 @@ class FE_location {
                                            FireEagleConfig *config);
 };
 
+/** Moves a location by swapping, so its strings are not copied. */
+inline void FE_relocate(FE_location *to, FE_location &from) {
+    new (to) FE_location();
+    to->swap(from);
+    from.~FE_location();
+}
+
+/** Number of location levels a FE_user keeps without allocating. Users of
+ * 'within' and 'recent' mostly carry one level; a full hierarchy spills to
+ * the heap. */
+#define FE_USER_INLINE_LEVELS 2
+
+/** The location hierarchy of a FE_user. */
+typedef FE_SmallVector<FE_location, FE_USER_INLINE_LEVELS> FE_LocationLevels;
+
 /** Class representing a parsed response from the 'user' APi of Fire Eagle.
  * Remember that most of the additional info is retrieved to represent the
  * current permissions given by the user (things can change behind the
@@ -159,18 +292,24 @@ class FE_user {
      * threads) */
     string token;
     /** Timestamp of update of any location level, as recorded by Fire Eagle.
-     * Would have preferred a UTC */
+     * See last_update_ms for the UTC value. */
     string last_update_timestamp;
+    /** last_update_timestamp in milliseconds since the epoch (UTC), parsed
+     * once when the user is decoded. 0 if missing or not ISO 8601. */
+    long long last_update_ms;
     /** Timezone for all timestamps in the response. */
     string timezone;
     /** A '|' delimited list of WOE IDs (http://developer.yahoo.com/geo/) from the
      * coarsest location level to the finest (left to right) */
     string woeid_hierarchy;
+    /** woeid_hierarchy parsed once, coarsest level first. */
+    vector<unsigned int> woeids;
     /** List representing the location hierarchy of the user's last known location.
      * Note that, even if Fire Eagle may be knowing of the actual location down to the
      * exact level, privacy settings by the user may prevent the API caller to retrieve
-     * the more detailed levels in the location hierarchy. */
-    list<FE_location> location;    
+     * the more detailed levels in the location hierarchy. Kept inside the
+     * object, without allocating, up to FE_USER_INLINE_LEVELS levels. */
+    FE_LocationLevels location;
 
     FE_user();
 
@@ -180,6 +319,9 @@ class FE_user {
      */
     virtual void print(ostream &os, unsigned int indent = 0) const;
 
+    /** Exchange contents with another user without copying strings. */
+    void swap(FE_user &other);
+
     /** Factory method to parse API responses according to format. Throws
      * exception if the config does not have a parser for the format.
      * @param resp The actual response body to be parsed.
@@ -190,6 +332,239 @@ class FE_user {
      */
     static FE_user from_response(const string &resp, enum FE_format format, 
                                  FireEagleConfig *config);
+
+    /** Factory method for responses listing users, like the ones of the
+     * 'within' and 'recent' APIs. Throws exceptions like from_response.
+     * @param resp The actual response body to be parsed.
+     * @param format The response format.
+     * @param config Pointer to the FireEagleConfig with which the parsers are
+     * registered.
+     * @return The users, in response order.
+     */
+    static list<FE_user> list_from_response(const string &resp, enum FE_format format,
+                                            FireEagleConfig *config);
+};
+
+/** FE_compact_location interns the names of locations at this level (city)
+ * and coarser. */
+#define FE_COMPACT_INTERN_LEVEL 3
+
+/**
+ * A FE_location for keeping many of them around. The names of cities and
+ * coarser levels, which repeat across users (a few thousand cities and
+ * countries), and level names are FE_interner() symbols instead of string
+ * copies. The interner never shrinks, so text with no such bound stays in
+ * the object: labels, which users make up, and the names and place ids of
+ * finer levels (street addresses, postal codes, neighborhoods).
+ *
+ * Accessors return views into the interner, valid for the life of the
+ * process, or into the object, valid until it changes.
+ */
+class FE_compact_location {
+  private:
+    //Interner symbols, or FE_COMPACT_LOCAL | the offset of the text in
+    //local_text.
+    FE_symbol label_id;
+    FE_symbol level_name_id;
+    FE_symbol full_location_id;
+    FE_symbol place_name_id;
+    FE_symbol place_id_id;
+    /** Text that is not interned, each string followed by a 0. */
+    string local_text;
+
+    FE_symbol keep(const string &text, bool intern);
+    FE_StringRef text_of(FE_symbol id) const;
+
+  public:
+    /** See FE_location for the meaning of the members. The timestamp is
+     * kept as UTC milliseconds and the offset of the original text only. */
+    FE_geometry geometry;
+    long long timestamp_ms;
+    short timestamp_offset;
+    unsigned int level;
+    unsigned int woeid;
+    bool best_guess;
+    bool is_place_id_exact;
+    bool is_woeid_exact;
+
+    FE_compact_location();
+    explicit FE_compact_location(const FE_location &location);
+
+    /** Replace the contents with a location, interning its names. */
+    void assign(const FE_location &location);
+
+    /** Get the full FE_location back. */
+    void expand(FE_location &location) const;
+
+    /** Bytes of text held by the object rather than the interner. */
+    size_t local_bytes() const { return local_text.capacity(); }
+
+    FE_StringRef label() const;
+    FE_StringRef level_name() const;
+    FE_StringRef full_location() const;
+    FE_StringRef place_name() const;
+    FE_StringRef place_id() const;
+
+    /** The timestamp in the form Fire Eagle sends, in its original offset
+     * from UTC (fractions of a second are dropped). Empty if unknown. */
+    string timestamp() const;
+};
+
+/**
+ * A FE_user for keeping many of them around. See FE_compact_location.
+ */
+class FE_compact_user {
+  private:
+    FE_symbol timezone_id;
+
+  public:
+    /** See FE_user for the meaning of the members. */
+    bool can_read;
+    bool can_write;
+    string token;
+    long long last_update_ms;
+    short last_update_offset;
+    vector<unsigned int> woeids;
+    vector<FE_compact_location> location;
+
+    FE_compact_user();
+    explicit FE_compact_user(const FE_user &user);
+
+    /** Replace the contents with a user, interning its names. */
+    void assign(const FE_user &user);
+
+    /** Get the full FE_user back. */
+    void expand(FE_user &user) const;
+
+    FE_StringRef timezone() const;
+
+    /** The '|' delimited hierarchy, rebuilt from woeids rather than kept:
+     * it is different for almost every user. */
+    string woeid_hierarchy() const;
+
+    /** See FE_compact_location::timestamp. */
+    string last_update_timestamp() const;
+};
+
+/**
+ * Receives objects from a FE_ResponseDecoder as soon as each one is complete.
+ * The objects are owned by the decoder and reused for the next one: copy or
+ * swap out what is needed.
+ */
+class FE_ObjectSink {
+  public:
+    virtual ~FE_ObjectSink() {}
+
+    /**
+     * A <user> element (the only one in a 'user' response, or one of the
+     * <users> of 'within' and 'recent') has been decoded.
+     * @return true to keep going, false to stop the parse.
+     */
+    virtual bool decoded_user(FE_user &user) { return true; }
+
+    /**
+     * A <location> directly under <locations> (a 'lookup' response) has been
+     * decoded. Locations of a user are delivered as part of the user.
+     * @return true to keep going, false to stop the parse.
+     */
+    virtual bool decoded_location(FE_location &location) { return true; }
+};
+
+/**
+ * Decode an API response, handing each object to sink as soon as it is
+ * complete. Successful XML responses are decoded in a single pass over parse
+ * events when the registered parser supports them; error responses are
+ * turned into a thrown FireEagleException pointer as usual. Objects handed
+ * to the sink before a failure are not taken back.
+ * @param resp The response body.
+ * @param format The response format. Only FE_FORMAT_XML is implemented.
+ * @param config Pointer to the FireEagleConfig with which the parsers are
+ * registered.
+ * @param container What the response holds: FE_NODE_USER ('user'),
+ * FE_NODE_USERS ('within', 'recent') or FE_NODE_LOCATIONS ('lookup').
+ * @param sink Gets the objects.
+ */
+void FE_decode_response(const string &resp, enum FE_format format, FireEagleConfig *config,
+                        enum FE_node_id container, FE_ObjectSink &sink);
+
+/**
+ * Decodes XML responses straight from parse events, without a tree. The stat
+ * attribute of the root is checked on its start tag: anything but an
+ * <rsp stat="ok"> stops the parse right there, so the caller can hand error
+ * responses (which are rare and small) to the tree based error handling.
+ * Malformed coordinates leave the geometry invalid (see
+ * FE_geometry::set_from_georss). Exceptions cannot be thrown through every
+ * parser, so one thrown by the sink stops the parse and is kept for
+ * take_error. A decoder is not thread-safe; use one per thread.
+ */
+class FE_ResponseDecoder : public FE_ParseEvents {
+  public:
+    enum FE_decode_status {
+        /** No root node seen yet */
+        FE_DECODE_PENDING = 0,
+        /** The root is <rsp stat="ok"> */
+        FE_DECODE_OK,
+        /** The root is something else. The parse was stopped. */
+        FE_DECODE_NOT_OK
+    };
+
+  private:
+    FE_ObjectSink &sink;
+    enum FE_decode_status _status;
+    FireEagleException *_error;
+    /** Ids of the open nodes, root first. */
+    vector<enum FE_node_id> path;
+    /** Bit (1 << id) for every child of the root seen. */
+    unsigned long top_level;
+    enum FE_node_id first_top_level;
+    /** Depth of the open user, location or location member; 0 if none. */
+    size_t user_depth;
+    size_t location_depth;
+    size_t field_depth;
+    /** The open location member. */
+    enum FE_node_id field;
+    bool field_georss;
+    bool field_exact;
+    /** Set when the location member has children. It then has no text. */
+    bool field_nested;
+    string text;
+    FE_user user;
+    FE_location location;
+    /** Polygon vertices of the decoded locations. Created on demand. */
+    FE_VertexArena *arena;
+
+    void finish_field();
+    FE_VertexArena *vertex_arena();
+
+    FE_ResponseDecoder(const FE_ResponseDecoder &other);
+    FE_ResponseDecoder &operator=(const FE_ResponseDecoder &other);
+
+  public:
+    FE_ResponseDecoder(FE_ObjectSink &_sink);
+    ~FE_ResponseDecoder();
+
+    enum FE_decode_status status() const;
+
+    /** @return true if a child of the root with the given id was seen. */
+    bool saw(enum FE_node_id id) const;
+
+    /** @return Id of the first child of the root, FE_NODE_UNKNOWN if none. */
+    enum FE_node_id first_child() const;
+
+    /**
+     * @return The exception that stopped the parse, or NULL. The caller owns
+     * it; a second call returns NULL.
+     */
+    FireEagleException *take_error();
+
+    void reset();
+
+    bool start_node(enum FE_node_id id, const FE_StringRef &name,
+                    const FE_EventAttribute *attrs, unsigned int nattrs);
+
+    bool node_text(const FE_StringRef &text);
+
+    bool end_node(enum FE_node_id id, const FE_StringRef &name);
 };
 
 #endif //FIRE_OBJECTS_H
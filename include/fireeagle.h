@@ -11,6 +11,7 @@
 #include <string>
 #include <exception>
 #include <map>
+#include <list>
 
 #include "fireeagle_http.h"
 #include "parser_iface.h"
@@ -212,6 +213,10 @@ class ParserData {
 
 enum FE_oauth_version { OAUTH_10 = 0, OAUTH_10A };
 
+class FE_ResponseCache; //See fe_cache.h
+class FE_SingleFlight; //See fe_singleflight.h
+class FE_GeoCache; //See fe_geocache.h
+
 /**
  * A class for storing the FireEagle common stuff that applies across the
  * application. Normally we would expect this to be a singleton, but I am
@@ -236,6 +241,23 @@ class FireEagleConfig {
     /** Map for parsers of different response content types. */
     map<string,ParserData *> parsers;
 
+    /** The parser get_parser(enum FE_format) returns for each format. Kept up
+     * to date by register_parser, so that lookups on every response do not
+     * walk the map. */
+    ParserData *format_parsers[FE_FORMAT_HTML + 1];
+
+    /** Recompute format_parsers from parsers. */
+    void update_format_parsers();
+
+    /** Cache of lookup responses, or NULL. Owned by the config. */
+    FE_ResponseCache *lookup_cache;
+
+    /** Cache of lookup responses for points, or NULL. Owned by the config. */
+    FE_GeoCache *geo_cache;
+
+    /** Requests in flight, for FE_COALESCE_REQUESTS. */
+    FE_SingleFlight *single_flight;
+
   public:
     /** Contains the root URL for Fire Eagle installation. Should be possible to
      * override and point to some other test install by internal QA.
@@ -262,6 +284,15 @@ class FireEagleConfig {
      */
     bool FE_USE_OAUTH_HEADER;
 
+    /** Let concurrent identical API calls made through this config share
+     * one request: while a call is in flight, other threads making the same
+     * call (same method, token, arguments and format) wait for its response,
+     * or a copy of its exception, instead of sending their own. Calls that
+     * change state, such as update, are never shared. Set to false by
+     * default.
+     */
+    bool FE_COALESCE_REQUESTS;
+
     /** Constructs an instance without a general_token */
     FireEagleConfig(const OAuthTokenPair &_app_token);
 
@@ -317,6 +348,35 @@ class FireEagleConfig {
      */
     ParserData *get_parser(enum FE_format format);
 
+    /** Answer FireEagle::lookup, and so FireEagle::lookup_locations, from a
+     * cache when the same query (see FE_ResponseCache::make_key) was
+     * answered recently. The cache is shared by all the FireEagle instances
+     * using this config, whatever their token: lookup results do not depend
+     * on the user. Only successful responses are cached.
+     * @param cache A cache, owned by the config from now on, or NULL to stop
+     * caching.
+     * @return The previous cache, now owned by the caller, or NULL.
+     */
+    FE_ResponseCache *set_lookup_cache(FE_ResponseCache *cache);
+
+    /** @return The cache set with set_lookup_cache, or NULL. */
+    FE_ResponseCache *get_lookup_cache() const;
+
+    /** Answer FireEagle::lookup calls for a latitude and longitude (see
+     * FE_GeoCache::parse_query) from responses for points near them. This
+     * cache is tried before the lookup cache, and has the same ownership
+     * rules as set_lookup_cache.
+     * @param cache A cache, owned by the config from now on, or NULL.
+     * @return The previous cache, now owned by the caller, or NULL.
+     */
+    FE_GeoCache *set_geo_cache(FE_GeoCache *cache);
+
+    /** @return The cache set with set_geo_cache, or NULL. */
+    FE_GeoCache *get_geo_cache() const;
+
+    /** @return The requests in flight shared under FE_COALESCE_REQUESTS. */
+    FE_SingleFlight *get_single_flight() const;
+
     /** Parse config file. Contains the logic for reading a config file
      * @param file Path to the configuration file to be parsed.
      * @return A map of key-value pairs, both strings
@@ -329,6 +389,9 @@ class FireEagleConfig {
  */
 typedef map<string,string> FE_ParamPairs;
 
+class FE_user;     //See fire_objects.h
+class FE_location; //See fire_objects.h
+
 extern const FE_ParamPairs empty_params;
 
 /**
@@ -374,6 +437,13 @@ class FireEagle {
      */
     string make_oauth_header(string &url, const string &realm = "") const;
 
+    /** lookup, through the caches of the config.
+     * @param locations NULL, or out argument: the locations of the response,
+     * decoded once for both the caller and the geo cache.
+     */
+    string lookup_response(const FE_ParamPairs &args, enum FE_format format,
+                           list<FE_location> *locations) const;
+
   protected:
     /** This function is called with debug messages when FE_DEBUG is turned on.
      * Override to suit your own debug style. Default implementation outputs strings
@@ -522,6 +592,31 @@ class FireEagle {
      */
     string recent(const FE_ParamPairs &args, enum FE_format format = FE_FORMAT_XML) const;
 
+    /** The 'user' API call, returning the decoded user. The response is
+     * parsed once, in a single pass for successful responses. Include
+     * fire_objects.h to use this and the other typed calls below.
+     * @return The user for the token in 'this'.
+     */
+    FE_user user_object() const;
+
+    /** The 'lookup' API call, returning the decoded locations.
+     * @param args Actual name-value pairs as arguments for API.
+     * @return The candidate locations, best match first as sent by Fire Eagle.
+     */
+    list<FE_location> lookup_locations(const FE_ParamPairs &args) const;
+
+    /** The 'within' API call, returning the decoded users.
+     * @param args Actual name-value pairs as arguments for API.
+     * @return The users within the area.
+     */
+    list<FE_user> within_users(const FE_ParamPairs &args) const;
+
+    /** The 'recent' API call, returning the decoded users.
+     * @param args Actual name-value pairs as arguments for API.
+     * @return The users who updated recently.
+     */
+    list<FE_user> recent_users(const FE_ParamPairs &args = empty_params) const;
+
     /** Generate an actual URL with which to redirect the user to Fire Eagle site
      * along with a request token, so that the user can authorize the application
      * to access the location.
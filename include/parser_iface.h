@@ -10,8 +10,140 @@
 #include <string>
 #include <list>
 
+#include <stddef.h>
+#include <string.h>
+
 using namespace std;
 
+/**
+ * A non-owning reference to a run of characters. The characters are not
+ * necessarily null terminated, and stay valid only as long as whatever owns
+ * them (a document buffer, a parsed node, ...).
+ */
+class FE_StringRef {
+  public:
+    /** Start of the characters. NULL for an empty reference. */
+    const char *data;
+    /** Number of characters referenced. */
+    size_t length;
+
+    FE_StringRef() : data(NULL), length(0) {}
+    FE_StringRef(const char *_data, size_t _length) : data(_data), length(_length) {}
+    FE_StringRef(const string &s) : data(s.data()), length(s.length()) {}
+
+    /** Compare against a null terminated string. */
+    bool operator==(const char *s) const {
+        return (strncmp(data ? data : "", s, length) == 0) && (s[length] == 0);
+    }
+    bool operator!=(const char *s) const { return !(*this == s); }
+
+    /** Make an owning copy. */
+    string str() const { return (data) ? string(data, length) : string(); }
+};
+
+/**
+ * Vocabulary of node names used in Fire Eagle responses. Parsers that know
+ * about the vocabulary hand out these IDs with parse events so that consumers
+ * can switch on an integer instead of comparing names. Anything else is
+ * FE_NODE_UNKNOWN, and the consumer must look at the name itself.
+ */
+enum FE_node_id {
+    FE_NODE_UNKNOWN = 0,
+    FE_NODE_RSP,
+    FE_NODE_ERR,
+    FE_NODE_USERS,
+    FE_NODE_USER,
+    FE_NODE_LOCATION_HIERARCHY,
+    FE_NODE_LOCATIONS,
+    FE_NODE_LOCATION,
+    FE_NODE_GEORSS_POINT,
+    FE_NODE_GEORSS_BOX,
+    FE_NODE_GEORSS_LINE,
+    FE_NODE_GEORSS_POLYGON,
+    FE_NODE_ID,
+    FE_NODE_LABEL,
+    FE_NODE_LEVEL,
+    FE_NODE_LEVEL_NAME,
+    FE_NODE_LOCATED_AT,
+    FE_NODE_NAME,
+    FE_NODE_NORMAL_NAME,
+    FE_NODE_PLACE_ID,
+    FE_NODE_WOEID,
+    FE_NODE_QUERYSTRING,
+    FE_NODE_COUNT
+};
+
+/**
+ * Classify a node name. Uses a perfect hash over the vocabulary, so the cost
+ * is a table lookup and one string compare.
+ * @param name Node name. Need not be null terminated.
+ * @param length Length of name.
+ * @return The ID, or FE_NODE_UNKNOWN.
+ */
+enum FE_node_id FE_lookup_node_id(const char *name, size_t length);
+
+/**
+ * Reverse of FE_lookup_node_id.
+ * @return The name for a known ID, or an empty string for FE_NODE_UNKNOWN.
+ */
+const string &FE_node_name(enum FE_node_id id);
+
+/** A name-value pair passed with FE_ParseEvents::start_node */
+struct FE_EventAttribute {
+    FE_StringRef name;
+    FE_StringRef value;
+};
+
+/**
+ * Callback interface for event (SAX style) parsing, for consumers that do not
+ * need a FE_ParsedNode tree. All references passed to the callbacks are valid
+ * only for the duration of the callback. Every callback returns true to
+ * continue parsing, or false to stop the parse right there.
+ */
+class FE_ParseEvents {
+  public:
+    virtual ~FE_ParseEvents() {}
+
+    /**
+     * Called when the parser has to restart the document from the beginning,
+     * for example when falling back to a different parser implementation.
+     * Drop any state accumulated from earlier events.
+     */
+    virtual void reset() {}
+
+    /**
+     * A node starts.
+     * @param id Vocabulary ID of the node name.
+     * @param name Node name.
+     * @param attrs Array of attributes. NULL if nattrs is 0.
+     * @param nattrs Number of attributes.
+     */
+    virtual bool start_node(enum FE_node_id id, const FE_StringRef &name,
+                            const FE_EventAttribute *attrs,
+                            unsigned int nattrs) = 0;
+
+    /**
+     * A piece of the text content of the current node. The text of a node may
+     * be delivered in more than one piece.
+     */
+    virtual bool node_text(const FE_StringRef &text) = 0;
+
+    /** The current node ends. */
+    virtual bool end_node(enum FE_node_id id, const FE_StringRef &name) = 0;
+};
+
+/** Result of FE_Parser::parse_events */
+enum FE_event_status {
+    /** The parser does not support event parsing. No events were sent. */
+    FE_EVENTS_UNSUPPORTED = 0,
+    /** The whole document was parsed. */
+    FE_EVENTS_DONE,
+    /** A callback returned false. */
+    FE_EVENTS_STOPPED,
+    /** The document is not well formed. */
+    FE_EVENTS_FAILED
+};
+
 /**
  * This class is an abstraction. We need to fit this to the proper parser and
  * response format (XML or JSON). A note about the property 'text()' is in order...
@@ -32,6 +164,46 @@ class FE_ParsedNode {
      */
     virtual list<const FE_ParsedNode *> get_children(const string &name) const = 0;
 
+    /**
+     * Allocation free alternative to get_children. Returns the matching
+     * children one at a time:
+     * <pre>
+     * unsigned int cursor = 0;
+     * while ((child = node->next_child(name, cursor))) { ... }
+     * </pre>
+     * The default implementation scans the children on every call. Override
+     * it when the node can do better.
+     * @param name Name of the sub nodes to match.
+     * @param cursor Start with 0. Updated on every call, and meaningless to
+     * anyone but the node that set it.
+     * @return The next match, or NULL once there are no more.
+     */
+    virtual const FE_ParsedNode *next_child(const string &name,
+                                            unsigned int &cursor) const {
+        unsigned int count = child_count();
+        for ( ; cursor < count ; cursor++) {
+            const FE_ParsedNode &node = child(cursor);
+            if (node.name() == name) {
+                cursor++;
+                return &node;
+            }
+        }
+        return NULL;
+    }
+
+    /**
+     * Count the children of a given name without collecting them.
+     * @param name Name of the sub nodes to match.
+     * @return Number of matches.
+     */
+    virtual unsigned int count_children(const string &name) const {
+        unsigned int count = 0;
+        unsigned int cursor = 0;
+        while (next_child(name, cursor))
+            count++;
+        return count;
+    }
+
     /** Get the list of all child nodes
      * @return The count of child nodes
      */
@@ -97,6 +269,38 @@ class FE_ParsedNode {
      */
     virtual bool get_bool_property(const string &name, bool *error = NULL) const = 0;
 
+    /**
+     * The text content of this node, i.e. the 'text()' property, without
+     * going through a property lookup. The default implementation does the
+     * lookup.
+     * @return The text or an empty string.
+     */
+    virtual const string &text() const { return get_string_property("text()"); }
+
+    /**
+     * The text content of this node as a long. Same as
+     * get_long_property("text()").
+     */
+    virtual long get_long_text(bool *error = NULL) const {
+        return get_long_property("text()", error);
+    }
+
+    /**
+     * The text content of this node as a double. Same as
+     * get_double_property("text()").
+     */
+    virtual double get_double_text(bool *error = NULL) const {
+        return get_double_property("text()", error);
+    }
+
+    /**
+     * The text content of this node as a boolean. Same as
+     * get_bool_property("text()").
+     */
+    virtual bool get_bool_text(bool *error = NULL) const {
+        return get_bool_property("text()", error);
+    }
+
     /** The destructor, ofcourse, has to be virtual */
     virtual ~FE_ParsedNode() {}
 };
@@ -114,6 +318,19 @@ class FE_Parser {
      * destructor of the derived class of this class. If parsing fails, return NULL.
      */
     virtual FE_ParsedNode *parse(const string &data) = 0;
+
+    /**
+     * Parse a string without building a tree, reporting the document through
+     * callbacks instead. Optional for implementations. The default returns
+     * FE_EVENTS_UNSUPPORTED without sending any event.
+     * @param data String to be parsed.
+     * @param events Callback instance.
+     * @return See FE_event_status.
+     */
+    virtual enum FE_event_status parse_events(const string &data,
+                                              FE_ParseEvents &events) {
+        return FE_EVENTS_UNSUPPORTED;
+    }
 };
 
 #endif /* FIREEAGLE_PARSER_IFACE_H */
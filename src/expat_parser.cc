@@ -22,7 +22,7 @@ using namespace std;
 
 string FE_XMLNode::empty_value;
 
-FE_XMLNode::FE_XMLNode(const string &name) : _element(name) {
+FE_XMLNode::FE_XMLNode(const string &name) : _element(name), _index(NULL) {
     children = 0;
     _child = (FE_XMLNode **) malloc(sizeof(FE_XMLNode *) * 5);
     _child_size = 5;
@@ -33,6 +33,7 @@ FE_XMLNode::~FE_XMLNode() {
         delete(_child[i]);
     }
     free(_child);
+    delete _index;
 }
 
 const string &FE_XMLNode::text() const { return _text; }
@@ -40,25 +41,42 @@ const string &FE_XMLNode::text() const { return _text; }
 void FE_XMLNode::append_text(const char *fragment) {
     if (children > 0)
         return;
-    if (fragment)
+    if (fragment) {
         _text.append(fragment);
+        _text_cache.clear();
+    }
+}
+
+void FE_XMLNode::append_text(const char *fragment, size_t length) {
+    if (children > 0)
+        return;
+    if (fragment) {
+        _text.append(fragment, length);
+        _text_cache.clear();
+    }
 }
 
 void FE_XMLNode::add_attribute(const char *name, const char *value) {
     if (name && value) {
-        string _name(name);
-        string _value(value);
-        _attribute[name] = value;
+        Attribute &attr = _attribute[name];
+        attr.value = value;
+        attr.cache.clear();
     }
 }
 
+void FE_XMLNode::add_attribute(const FE_StringRef &name, const FE_StringRef &value) {
+    Attribute &attr = _attribute[name.str()];
+    attr.value.assign(value.data, value.length);
+    attr.cache.clear();
+}
+
 unsigned int FE_XMLNode::attribute_count() const { return _attribute.size(); }
 list<string> FE_XMLNode::attributes() const {
     list<string> names;
 
-    for (map<string,string>::const_iterator iter = _attribute.begin();
+    for (AttributeMap::const_iterator iter = _attribute.begin();
          iter != _attribute.end() ; iter++) {
-        names.push_back(iter->second);
+        names.push_back(iter->second.value);
     }
 
     return names;
@@ -66,6 +84,10 @@ list<string> FE_XMLNode::attributes() const {
 
 FE_XMLNode &FE_XMLNode::add_child(const char *element) {
     assert(element);
+    return add_child(string(element));
+}
+
+FE_XMLNode &FE_XMLNode::add_child(const string &element) {
     FE_XMLNode *newNode = new FE_XMLNode(element);
     if (_child_size == children) {
         _child = (FE_XMLNode **) realloc(_child, sizeof(FE_XMLNode *) * (_child_size + 5));
@@ -73,8 +95,14 @@ FE_XMLNode &FE_XMLNode::add_child(const char *element) {
     }
     _child[children] = newNode;
     children++;
-    if (children == 1)
+    if (_index) {
+        delete _index;
+        _index = NULL;
+    }
+    if (children == 1) {
         _text = "";
+        _text_cache.clear();
+    }
     return *newNode;
 }
 
@@ -83,12 +111,92 @@ const string &FE_XMLNode::name() const { return _element; }
 list<const FE_ParsedNode *> FE_XMLNode::get_children(const string &name) const {
     list<const FE_ParsedNode *> child_list;
 
+    unsigned int cursor = 0;
+    const FE_ParsedNode *node;
+    while ((node = next_child(name, cursor)))
+        child_list.push_back(node);
+
+    return child_list;
+}
+
+const FE_XMLNode::ChildIndex::Slot *FE_XMLNode::indexed_children(const string &name) const {
+    if (!_index) {
+        _index = new ChildIndex;
+        unsigned int size = 16;
+        while (size < (unsigned int)children * 2)
+            size *= 2;
+        ChildIndex::Slot free_slot = { 0, -1, 0 };
+        _index->slots.assign(size, free_slot);
+        _index->next.assign(children, -1);
+        // Backwards, so that each child links to the next one of its name
+        for (int i = children - 1 ; i >= 0 ; i--) {
+            const string &child_name = _child[i]->name();
+            unsigned int hash = FE_hash_fnv1a(child_name.data(), child_name.length());
+            unsigned int at = hash & (size - 1);
+            while (_index->slots[at].first >= 0 &&
+                   (_index->slots[at].hash != hash ||
+                    _child[_index->slots[at].first]->name() != child_name))
+                at = (at + 1) & (size - 1);
+            ChildIndex::Slot &slot = _index->slots[at];
+            _index->next[i] = slot.first;
+            slot.hash = hash;
+            slot.first = i;
+            slot.count++;
+        }
+    }
+
+    unsigned int mask = _index->slots.size() - 1;
+    unsigned int hash = FE_hash_fnv1a(name.data(), name.length());
+    for (unsigned int at = hash & mask ; _index->slots[at].first >= 0 ;
+         at = (at + 1) & mask) {
+        const ChildIndex::Slot &slot = _index->slots[at];
+        if (slot.hash == hash && _child[slot.first]->name() == name)
+            return &slot;
+    }
+    return NULL;
+}
+
+const FE_ParsedNode *FE_XMLNode::next_child(const string &name,
+                                            unsigned int &cursor) const {
+    // Either way, the cursor is the position after the last match returned
+    if (children > FE_XMLNODE_INDEX_THRESHOLD) {
+        const ChildIndex::Slot *slot = indexed_children(name);
+        if (!slot) {
+            cursor = children;
+            return NULL;
+        }
+        if ((cursor == 0) || ((cursor <= (unsigned int)children) &&
+                              (_child[cursor - 1]->name() == name))) {
+            int at = (cursor == 0) ? slot->first : _index->next[cursor - 1];
+            if (at < 0) {
+                cursor = children;
+                return NULL;
+            }
+            cursor = at + 1;
+            return _child[at];
+        }
+        // A cursor not left by a match of this name: scan from it
+    }
+
+    for ( ; cursor < (unsigned int)children ; cursor++) {
+        if (_child[cursor]->name() == name)
+            return _child[cursor++];
+    }
+    return NULL;
+}
+
+unsigned int FE_XMLNode::count_children(const string &name) const {
+    if (children > FE_XMLNODE_INDEX_THRESHOLD) {
+        const ChildIndex::Slot *slot = indexed_children(name);
+        return (slot) ? slot->count : 0;
+    }
+
+    unsigned int count = 0;
     for (int i = 0 ; i < children ; i++) {
         if (_child[i]->name() == name)
-            child_list.push_back(_child[i]);
+            count++;
     }
-
-    return child_list;
+    return count;
 }
 
 bool FE_XMLNode::has_property(const string &name) const {
@@ -99,69 +207,66 @@ bool FE_XMLNode::has_property(const string &name) const {
 }
 
 const string &FE_XMLNode::get_string_property(const string &name) const {
-    map<string,string>::const_iterator iter = _attribute.find(name);
+    if (name == "text()")
+        return _text;
+
+    AttributeMap::const_iterator iter = _attribute.find(name);
     if (iter != _attribute.end())
-        return iter->second;
+        return iter->second.value;
     return FE_XMLNode::empty_value;
 }
 
 long FE_XMLNode::get_long_property(const string &name, bool *error) const {
-    if (error)
-        *error = false;
-    map<string,string>::const_iterator iter = _attribute.find(name);
-    if (iter == _attribute.end()) {
-        if (error)
-            *error = true;
-        return 0;
-    }
+    if (name == "text()")
+        return get_long_text(error);
 
-    char *e;
-    const char *c = iter->second.c_str();
-    long val = strtol(c, &e, 0);
+    AttributeMap::const_iterator iter = _attribute.find(name);
+    if (iter != _attribute.end())
+        return iter->second.cache.as_long(iter->second.value, error);
 
-    if ((*e != 0) && error)
+    if (error)
         *error = true;
-
-    return val;
+    return 0;
 }
 
 double FE_XMLNode::get_double_property(const string &name, bool *error) const {
-    if (error)
-        *error = false;
-    map<string,string>::const_iterator iter = _attribute.find(name);
-    if (iter == _attribute.end()) {
-        if (error)
-            *error = true;
-        return 0;
-    }
+    if (name == "text()")
+        return get_double_text(error);
 
-    char *e;
-    const char *c = iter->second.c_str();
-    double val = strtod(c, &e);
+    AttributeMap::const_iterator iter = _attribute.find(name);
+    if (iter != _attribute.end())
+        return iter->second.cache.as_double(iter->second.value, error);
 
-    if ((*e != 0) && error)
+    if (error)
         *error = true;
-
-    return val;
+    return 0;
 }
 
 bool FE_XMLNode::get_bool_property(const string &name, bool *error) const {
-    if (error)
-        *error = false;
-    map<string,string>::const_iterator iter = _attribute.find(name);
-    if (iter == _attribute.end()) {
-        if (error)
-            *error = true;
-        return false;
-    }
+    if (name == "text()")
+        return get_bool_text(error);
 
-    if (iter->second == "true")
-        return true;
-    if ((iter->second != "false") && error)
+    AttributeMap::const_iterator iter = _attribute.find(name);
+    if (iter != _attribute.end())
+        return iter->second.cache.as_bool(iter->second.value, error);
+
+    if (error)
         *error = true;
     return false;
 }
 
+long FE_XMLNode::get_long_text(bool *error) const {
+    return _text_cache.as_long(_text, error);
+}
+
+double FE_XMLNode::get_double_text(bool *error) const {
+    return _text_cache.as_double(_text, error);
+}
+
+bool FE_XMLNode::get_bool_text(bool *error) const {
+    return _text_cache.as_bool(_text, error);
+}
+
 unsigned int FE_XMLNode::child_count() const { return children; }
 const FE_ParsedNode &FE_XMLNode::child(unsigned int i) const {
     if (i < children)
@@ -175,11 +280,11 @@ void FE_XMLNode::print(int indent) const {
     for (int i = 0 ; i < indent ; i++)
         printf("    ");
     printf("Element: %s (Children = %d)\n", name().c_str(), children);
-    for (map<string,string>::const_iterator iter = _attribute.begin() ;
+    for (AttributeMap::const_iterator iter = _attribute.begin() ;
          iter != _attribute.end() ; iter++) {
         for (int i = 0 ; i < indent ; i++)
             printf("    ");
-        printf("@%s=%s\n", iter->first.c_str(), iter->second.c_str());
+        printf("@%s=%s\n", iter->first.c_str(), iter->second.value.c_str());
     }
     if (!children) {
         for (int i = 0 ; i < indent ; i++)
@@ -229,8 +334,64 @@ extern "C" void FE_XML_handle_text(void *context, const XML_Char *s, int len) {
     FE_XMLNode *top = parser->top();
     assert(top);
 
-    char *tmps = strndup(s, len); //Since s is not null terminated.
-    top->append_text(tmps);
+    top->append_text(s, len); //s is not null terminated.
+}
+
+//Adapter from expat callbacks to FE_ParseEvents.
+class FE_XMLEventContext {
+  public:
+    XML_Parser parser;
+    FE_ParseEvents *events;
+    vector<FE_EventAttribute> attrs;
+    bool stopped;
+
+    FE_XMLEventContext(XML_Parser p, FE_ParseEvents *e)
+        : parser(p), events(e), stopped(false) {}
+
+    void stop() {
+        stopped = true;
+        XML_StopParser(parser, XML_FALSE);
+    }
+};
+
+extern "C" void FE_XML_event_begin_element(void *context, const char *elem,
+                                           const char **attrs) {
+    FE_XMLEventContext *ctx = (FE_XMLEventContext *)context;
+    if (ctx->stopped) //expat may deliver a few more after a stop.
+        return;
+
+    ctx->attrs.clear();
+    for (int i = 0 ; attrs[i] ; i += 2) {
+        FE_EventAttribute attr;
+        attr.name = FE_StringRef(attrs[i], strlen(attrs[i]));
+        attr.value = FE_StringRef(attrs[i + 1], strlen(attrs[i + 1]));
+        ctx->attrs.push_back(attr);
+    }
+
+    size_t len = strlen(elem);
+    if (!ctx->events->start_node(FE_lookup_node_id(elem, len), FE_StringRef(elem, len),
+                                 (ctx->attrs.size()) ? &(ctx->attrs[0]) : NULL,
+                                 ctx->attrs.size()))
+        ctx->stop();
+}
+
+extern "C" void FE_XML_event_end_element(void *context, const char *elem) {
+    FE_XMLEventContext *ctx = (FE_XMLEventContext *)context;
+    if (ctx->stopped)
+        return;
+
+    size_t len = strlen(elem);
+    if (!ctx->events->end_node(FE_lookup_node_id(elem, len), FE_StringRef(elem, len)))
+        ctx->stop();
+}
+
+extern "C" void FE_XML_event_handle_text(void *context, const XML_Char *s, int len) {
+    FE_XMLEventContext *ctx = (FE_XMLEventContext *)context;
+    if (ctx->stopped)
+        return;
+
+    if (!ctx->events->node_text(FE_StringRef(s, len)))
+        ctx->stop();
 }
 
 FE_XMLParser::FE_XMLParser() : root(NULL) {};
@@ -244,10 +405,36 @@ FE_ParsedNode *FE_XMLParser::parse(const string &document) {
     XML_SetCharacterDataHandler(p, FE_XML_handle_text);
     XML_SetUserData(p, (void *)this);
 
-    assert(XML_Parse(p, document.c_str(), document.length(), 1));
+    if (XML_Parse(p, document.c_str(), document.length(), 1) != XML_STATUS_OK) {
+        //Not well formed. Do not hand out half a tree.
+        delete root;
+        root = NULL;
+        while (!_stack.empty())
+            _stack.pop();
+    }
+    XML_ParserFree(p);
+
     return root;
 }
 
+enum FE_event_status FE_XMLParser::parse_events(const string &document,
+                                                FE_ParseEvents &events) {
+    XML_Parser p = XML_ParserCreate(NULL);
+    assert(p);
+
+    FE_XMLEventContext ctx(p, &events);
+    XML_SetElementHandler(p, FE_XML_event_begin_element, FE_XML_event_end_element);
+    XML_SetCharacterDataHandler(p, FE_XML_event_handle_text);
+    XML_SetUserData(p, (void *)&ctx);
+
+    XML_Status status = XML_Parse(p, document.c_str(), document.length(), 1);
+    XML_ParserFree(p);
+
+    if (ctx.stopped)
+        return FE_EVENTS_STOPPED;
+    return (status == XML_STATUS_OK) ? FE_EVENTS_DONE : FE_EVENTS_FAILED;
+}
+
 void FE_XMLParser::push(FE_XMLNode &node) { _stack.push(&node); }
 
 void FE_XMLParser::pop() { _stack.pop(); }
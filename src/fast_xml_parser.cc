@@ -0,0 +1,540 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#include <string>
+#include <vector>
+
+#include <string.h>
+#include <strings.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "fast_xml_parser.h"
+#include "expat_parser.h"
+
+using namespace std;
+
+/*
+ * Perfect hash for the Fire Eagle vocabulary:
+ *     h = (((name[0] + name[len - 1]) << 2) + name[len / 2]) & 63
+ * is collision free over the names below. The table was generated offline
+ * from the list in node_names; keep the two in sync when adding names.
+ */
+static const enum FE_node_id node_table[64] = {
+    FE_NODE_UNKNOWN, FE_NODE_USER, FE_NODE_LABEL, FE_NODE_UNKNOWN,
+    FE_NODE_GEORSS_POLYGON, FE_NODE_USERS, FE_NODE_UNKNOWN, FE_NODE_UNKNOWN,
+    FE_NODE_UNKNOWN, FE_NODE_UNKNOWN, FE_NODE_UNKNOWN, FE_NODE_UNKNOWN,
+    FE_NODE_UNKNOWN, FE_NODE_UNKNOWN, FE_NODE_ERR, FE_NODE_UNKNOWN,
+    FE_NODE_UNKNOWN, FE_NODE_WOEID, FE_NODE_UNKNOWN, FE_NODE_QUERYSTRING,
+    FE_NODE_UNKNOWN, FE_NODE_UNKNOWN, FE_NODE_LEVEL, FE_NODE_UNKNOWN,
+    FE_NODE_ID, FE_NODE_UNKNOWN, FE_NODE_UNKNOWN, FE_NODE_UNKNOWN,
+    FE_NODE_LOCATION, FE_NODE_UNKNOWN, FE_NODE_UNKNOWN, FE_NODE_UNKNOWN,
+    FE_NODE_UNKNOWN, FE_NODE_UNKNOWN, FE_NODE_UNKNOWN, FE_NODE_GEORSS_LINE,
+    FE_NODE_UNKNOWN, FE_NODE_LOCATED_AT, FE_NODE_GEORSS_POINT, FE_NODE_UNKNOWN,
+    FE_NODE_UNKNOWN, FE_NODE_UNKNOWN, FE_NODE_UNKNOWN, FE_NODE_UNKNOWN,
+    FE_NODE_UNKNOWN, FE_NODE_UNKNOWN, FE_NODE_UNKNOWN, FE_NODE_GEORSS_BOX,
+    FE_NODE_LOCATIONS, FE_NODE_LEVEL_NAME, FE_NODE_UNKNOWN, FE_NODE_UNKNOWN,
+    FE_NODE_UNKNOWN, FE_NODE_PLACE_ID, FE_NODE_UNKNOWN, FE_NODE_UNKNOWN,
+    FE_NODE_NORMAL_NAME, FE_NODE_NAME, FE_NODE_UNKNOWN, FE_NODE_RSP,
+    FE_NODE_LOCATION_HIERARCHY, FE_NODE_UNKNOWN, FE_NODE_UNKNOWN, FE_NODE_UNKNOWN
+};
+
+//Indexed by FE_node_id
+static const string node_names[FE_NODE_COUNT] = {
+    "",
+    "rsp",
+    "err",
+    "users",
+    "user",
+    "location-hierarchy",
+    "locations",
+    "location",
+    "georss:point",
+    "georss:box",
+    "georss:line",
+    "georss:polygon",
+    "id",
+    "label",
+    "level",
+    "level-name",
+    "located-at",
+    "name",
+    "normal-name",
+    "place-id",
+    "woeid",
+    "querystring"
+};
+
+enum FE_node_id FE_lookup_node_id(const char *name, size_t length) {
+    if (length < 2)
+        return FE_NODE_UNKNOWN;
+
+    unsigned char first = name[0];
+    unsigned char last = name[length - 1];
+    unsigned char middle = name[length / 2];
+    enum FE_node_id id = node_table[(((first + last) << 2) + middle) & 63];
+
+    const string &candidate = node_names[id];
+    if ((candidate.length() == length) && !memcmp(candidate.data(), name, length))
+        return id;
+    return FE_NODE_UNKNOWN;
+}
+
+const string &FE_node_name(enum FE_node_id id) {
+    if ((id < 0) || (id >= FE_NODE_COUNT))
+        return node_names[FE_NODE_UNKNOWN];
+    return node_names[id];
+}
+
+//Returns the first of '<', '>', '"' or '&' at or after p, or end.
+static inline const char *scan_markup(const char *p, const char *end) {
+#ifdef __SSE2__
+    const __m128i lt = _mm_set1_epi8('<');
+    const __m128i gt = _mm_set1_epi8('>');
+    const __m128i quot = _mm_set1_epi8('"');
+    const __m128i amp = _mm_set1_epi8('&');
+
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, lt),
+                                                 _mm_cmpeq_epi8(v, gt)),
+                                    _mm_or_si128(_mm_cmpeq_epi8(v, quot),
+                                                 _mm_cmpeq_epi8(v, amp)));
+        int mask = _mm_movemask_epi8(hits);
+        if (mask)
+            return p + __builtin_ctz(mask);
+        p += 16;
+    }
+#endif
+    while ((p < end) && (*p != '<') && (*p != '>') && (*p != '"') && (*p != '&'))
+        p++;
+    return p;
+}
+
+//Same as scan_markup for single quoted attribute values. These are rare.
+static inline const char *scan_apos(const char *p, const char *end) {
+    while ((p < end) && (*p != '<') && (*p != '\'') && (*p != '&'))
+        p++;
+    return p;
+}
+
+//Carriage returns are never let in (see FE_XMLScanner::scan).
+static inline bool is_space(char c) {
+    return (c == ' ') || (c == '\t') || (c == '\n');
+}
+
+static inline const char *skip_space(const char *p, const char *end) {
+    while ((p < end) && is_space(*p))
+        p++;
+    return p;
+}
+
+static inline bool starts_with(const char *p, const char *end, const char *prefix) {
+    size_t len = strlen(prefix);
+    return ((size_t)(end - p) >= len) && !memcmp(p, prefix, len);
+}
+
+//Returns the position right after needle, or NULL.
+static const char *skip_past(const char *p, const char *end, const char *needle) {
+    size_t len = strlen(needle);
+    const char *pos = (const char *)memmem(p, end - p, needle, len);
+    return (pos) ? pos + len : NULL;
+}
+
+static size_t encode_utf8(unsigned long cp, char *out) {
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
+    } else if (cp < 0x800) {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    } else if (cp < 0x10000) {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (cp >> 18));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+/*
+ * Decode the reference starting at p (which points to '&') into out (at least
+ * 4 bytes). Returns the position after the ';' or NULL if the reference is
+ * not one of the predefined entities or a valid character reference.
+ */
+static const char *decode_reference(const char *p, const char *end,
+                                    char *out, size_t *outlen) {
+    const char *semi = (const char *)memchr(p, ';', (end - p < 12) ? end - p : 12);
+    if (!semi)
+        return NULL;
+
+    const char *name = p + 1;
+    size_t len = semi - name;
+    *outlen = 1;
+    if ((len == 3) && !memcmp(name, "amp", 3)) {
+        out[0] = '&';
+    } else if ((len == 2) && !memcmp(name, "lt", 2)) {
+        out[0] = '<';
+    } else if ((len == 2) && !memcmp(name, "gt", 2)) {
+        out[0] = '>';
+    } else if ((len == 4) && !memcmp(name, "quot", 4)) {
+        out[0] = '"';
+    } else if ((len == 4) && !memcmp(name, "apos", 4)) {
+        out[0] = '\'';
+    } else if ((len > 1) && (name[0] == '#')) {
+        unsigned long cp = 0;
+        const char *c = name + 1;
+        bool hex = (*c == 'x');
+        if (hex)
+            c++;
+        if (c == semi)
+            return NULL;
+        for ( ; c < semi ; c++) {
+            int digit;
+            if ((*c >= '0') && (*c <= '9'))
+                digit = *c - '0';
+            else if (hex && (*c >= 'a') && (*c <= 'f'))
+                digit = *c - 'a' + 10;
+            else if (hex && (*c >= 'A') && (*c <= 'F'))
+                digit = *c - 'A' + 10;
+            else
+                return NULL;
+            cp = cp * ((hex) ? 16 : 10) + digit;
+            if (cp > 0x10FFFF)
+                return NULL;
+        }
+        //Only the characters XML allows.
+        if (!((cp == 0x9) || (cp == 0xA) || (cp == 0xD)
+              || ((cp >= 0x20) && (cp <= 0xD7FF))
+              || ((cp >= 0xE000) && (cp <= 0xFFFD))
+              || (cp >= 0x10000)))
+            return NULL;
+        *outlen = encode_utf8(cp, out);
+    } else {
+        return NULL;
+    }
+
+    return semi + 1;
+}
+
+//Attribute value normalization: literal tabs and newlines become spaces.
+static void append_normalized(string &out, const char *s, size_t len) {
+    size_t start = out.length();
+    out.append(s, len);
+    for (size_t i = start ; i < out.length() ; i++) {
+        if ((out[i] == '\t') || (out[i] == '\n'))
+            out[i] = ' ';
+    }
+}
+
+static bool needs_normalization(const char *s, size_t len) {
+    return memchr(s, '\t', len) || memchr(s, '\n', len);
+}
+
+//Checks the XML declaration at [p, end) for an encoding other than UTF-8
+static bool is_utf8_declaration(const char *p, const char *end) {
+    const char *enc = (const char *)memmem(p, end - p, "encoding", 8);
+    if (!enc)
+        return true;
+    enc = skip_space(enc + 8, end);
+    if ((enc == end) || (*enc != '='))
+        return false;
+    enc = skip_space(enc + 1, end);
+    if ((enc == end) || ((*enc != '"') && (*enc != '\'')))
+        return false;
+    enc++;
+    return ((end - enc > 5) && !strncasecmp(enc, "utf-8", 5)
+            && ((enc[5] == '"') || (enc[5] == '\'')));
+}
+
+enum FE_event_status FE_XMLScanner::scan(const char *document, size_t length,
+                                         FE_ParseEvents &events) {
+    const char *p = document;
+    const char *end = document + length;
+    bool seen_root = false;
+
+    //End-of-line handling would need a copy of the text. Leave it to expat.
+    if (memchr(document, '\r', length))
+        return FE_EVENTS_UNSUPPORTED;
+
+    open.clear();
+    if (starts_with(p, end, "\xEF\xBB\xBF"))
+        p += 3;
+
+    while (true) {
+        if (open.empty()) {
+            //Prolog or epilogue: only markup and white space.
+            p = skip_space(p, end);
+            if (p == end)
+                return (seen_root) ? FE_EVENTS_DONE : FE_EVENTS_FAILED;
+            if (*p != '<')
+                return FE_EVENTS_FAILED;
+        } else {
+            const char *q = p;
+            while (true) {
+                q = scan_markup(q, end);
+                if ((q == end) || (*q == '<') || (*q == '&'))
+                    break;
+                q++; //'>' and '"' are plain text in content.
+            }
+            if ((q > p) && !events.node_text(FE_StringRef(p, q - p)))
+                return FE_EVENTS_STOPPED;
+            if (q == end)
+                return FE_EVENTS_FAILED; //Unclosed elements.
+
+            p = q;
+            if (*p == '&') {
+                char buf[4];
+                size_t n;
+                const char *after = decode_reference(p, end, buf, &n);
+                if (!after)
+                    return FE_EVENTS_FAILED;
+                if (!events.node_text(FE_StringRef(buf, n)))
+                    return FE_EVENTS_STOPPED;
+                p = after;
+                continue;
+            }
+        }
+
+        //*p is '<'
+        if (p + 1 >= end)
+            return FE_EVENTS_FAILED;
+
+        if (p[1] == '/') {
+            const char *name = p + 2;
+            const char *q = name;
+            while ((q < end) && !is_space(*q) && (*q != '>'))
+                q++;
+            size_t len = q - name;
+            q = skip_space(q, end);
+            if ((q == end) || (*q != '>') || open.empty())
+                return FE_EVENTS_FAILED;
+
+            OpenElement top = open.back();
+            if ((top.name.length != len) || memcmp(top.name.data, name, len))
+                return FE_EVENTS_FAILED;
+            open.pop_back();
+            if (!events.end_node(top.id, top.name))
+                return FE_EVENTS_STOPPED;
+            p = q + 1;
+        } else if (p[1] == '?') {
+            const char *after = skip_past(p + 2, end, "?>");
+            if (!after)
+                return FE_EVENTS_FAILED;
+            if ((p == document) && starts_with(p, end, "<?xml")
+                && is_space(p[5]) && !is_utf8_declaration(p, after))
+                return FE_EVENTS_UNSUPPORTED;
+            p = after;
+        } else if (starts_with(p, end, "<!--")) {
+            p = skip_past(p + 4, end, "-->");
+            if (!p)
+                return FE_EVENTS_FAILED;
+        } else if (starts_with(p, end, "<![CDATA[")) {
+            if (open.empty())
+                return FE_EVENTS_FAILED;
+            const char *text = p + 9;
+            const char *after = skip_past(text, end, "]]>");
+            if (!after)
+                return FE_EVENTS_FAILED;
+            if ((after - 3 > text)
+                && !events.node_text(FE_StringRef(text, after - 3 - text)))
+                return FE_EVENTS_STOPPED;
+            p = after;
+        } else if (p[1] == '!') {
+            //DOCTYPE and friends. Only legal before the root element, so
+            //nothing has been sent yet.
+            return (seen_root) ? FE_EVENTS_FAILED : FE_EVENTS_UNSUPPORTED;
+        } else {
+            if (open.empty() && seen_root)
+                return FE_EVENTS_FAILED; //Second root element.
+            seen_root = true;
+
+            const char *name = p + 1;
+            const char *q = name;
+            while ((q < end) && !is_space(*q) && (*q != '/') && (*q != '>'))
+                q++;
+            if ((q == end) || (q == name))
+                return FE_EVENTS_FAILED;
+            OpenElement elem;
+            elem.name = FE_StringRef(name, q - name);
+            elem.id = FE_lookup_node_id(name, q - name);
+
+            attrs.clear();
+            value_offset.clear();
+            scratch.clear();
+            bool empty = false;
+            p = q;
+            while (true) {
+                const char *before = p;
+                p = skip_space(p, end);
+                if (p == end)
+                    return FE_EVENTS_FAILED;
+                if (*p == '>') {
+                    p++;
+                    break;
+                }
+                if (*p == '/') {
+                    if ((p + 1 == end) || (p[1] != '>'))
+                        return FE_EVENTS_FAILED;
+                    p += 2;
+                    empty = true;
+                    break;
+                }
+                if (p == before)
+                    return FE_EVENTS_FAILED; //Attributes need white space in between.
+
+                FE_EventAttribute attr;
+                const char *aname = p;
+                while ((p < end) && !is_space(*p) && (*p != '=') && (*p != '>') && (*p != '/'))
+                    p++;
+                if (p == aname)
+                    return FE_EVENTS_FAILED;
+                attr.name = FE_StringRef(aname, p - aname);
+                p = skip_space(p, end);
+                if ((p == end) || (*p != '='))
+                    return FE_EVENTS_FAILED;
+                p = skip_space(p + 1, end);
+                if ((p == end) || ((*p != '"') && (*p != '\'')))
+                    return FE_EVENTS_FAILED;
+
+                char quote = *p++;
+                const char *segment = p;
+                size_t offset = scratch.length();
+                bool decoded = false;
+                while (true) {
+                    const char *r = (quote == '"') ? scan_markup(p, end) : scan_apos(p, end);
+                    if ((r == end) || (*r == '<'))
+                        return FE_EVENTS_FAILED;
+                    if (*r == quote) {
+                        if (decoded || needs_normalization(segment, r - segment)) {
+                            append_normalized(scratch, segment, r - segment);
+                            decoded = true;
+                        }
+                        if (!decoded)
+                            attr.value = FE_StringRef(segment, r - segment);
+                        p = r + 1;
+                        break;
+                    }
+                    if (*r == '&') {
+                        append_normalized(scratch, segment, r - segment);
+                        decoded = true;
+
+                        char buf[4];
+                        size_t n;
+                        const char *after = decode_reference(r, end, buf, &n);
+                        if (!after)
+                            return FE_EVENTS_FAILED;
+                        scratch.append(buf, n); //References are not normalized.
+                        p = segment = after;
+                        continue;
+                    }
+                    p = r + 1; //'>' or the other quote: plain text.
+                }
+
+                if (decoded)
+                    attr.value.length = scratch.length() - offset;
+                attrs.push_back(attr);
+                value_offset.push_back((decoded) ? offset : string::npos);
+            }
+
+            //scratch may have moved while growing. Point into it only now.
+            for (size_t i = 0 ; i < attrs.size() ; i++) {
+                if (value_offset[i] != string::npos)
+                    attrs[i].value.data = scratch.data() + value_offset[i];
+            }
+
+            if (!events.start_node(elem.id, elem.name,
+                                   (attrs.size()) ? &(attrs[0]) : NULL, attrs.size()))
+                return FE_EVENTS_STOPPED;
+            if (empty) {
+                if (!events.end_node(elem.id, elem.name))
+                    return FE_EVENTS_STOPPED;
+            } else {
+                open.push_back(elem);
+            }
+        }
+    }
+}
+
+//Builds the same tree as FE_XMLParser from the scanner events
+class FE_XMLTreeBuilder : public FE_ParseEvents {
+  public:
+    FE_XMLNode *root;
+    vector<FE_XMLNode *> stack;
+
+    FE_XMLTreeBuilder() : root(NULL) {}
+
+    //Does not delete root. That goes to the caller of parse.
+    ~FE_XMLTreeBuilder() {}
+
+    void reset() {
+        delete root;
+        root = NULL;
+        stack.clear();
+    }
+
+    bool start_node(enum FE_node_id id, const FE_StringRef &name,
+                    const FE_EventAttribute *attrs, unsigned int nattrs) {
+        FE_XMLNode *node;
+        if (stack.empty()) {
+            node = new FE_XMLNode((id) ? FE_node_name(id) : name.str());
+            root = node;
+        } else {
+            node = &(stack.back()->add_child((id) ? FE_node_name(id) : name.str()));
+        }
+        for (unsigned int i = 0 ; i < nattrs ; i++)
+            node->add_attribute(attrs[i].name, attrs[i].value);
+        stack.push_back(node);
+
+        return true;
+    }
+
+    bool node_text(const FE_StringRef &text) {
+        stack.back()->append_text(text.data, text.length);
+        return true;
+    }
+
+    bool end_node(enum FE_node_id id, const FE_StringRef &name) {
+        stack.pop_back();
+        return true;
+    }
+};
+
+FE_FastXMLParser::FE_FastXMLParser() {}
+FE_FastXMLParser::~FE_FastXMLParser() { /*don't delete the tree!!*/ }
+
+FE_ParsedNode *FE_FastXMLParser::parse(const string &document) {
+    FE_XMLTreeBuilder builder;
+
+    if (scanner.scan(document.data(), document.length(), builder) == FE_EVENTS_DONE)
+        return builder.root;
+
+    //Not our kind of document. Let expat have a go.
+    builder.reset();
+    FE_XMLParser fallback;
+    return fallback.parse(document);
+}
+
+enum FE_event_status FE_FastXMLParser::parse_events(const string &document,
+                                                    FE_ParseEvents &events) {
+    enum FE_event_status status = scanner.scan(document.data(), document.length(),
+                                               events);
+    //Unsupported documents are refused before the first event. Do not retry
+    //a failed document: events already delivered cannot be taken back.
+    if (status != FE_EVENTS_UNSUPPORTED)
+        return status;
+
+    events.reset();
+    FE_XMLParser fallback;
+    return fallback.parse_events(document, events);
+}
@@ -0,0 +1,366 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "fe_batch.h"
+#include "fe_numeric.h"
+#include "fe_hierarchy.h"
+
+using namespace std;
+
+FE_LocationBatch::FE_LocationBatch() {
+    vertex_begin.push_back(0);
+}
+
+size_t FE_LocationBatch::size() const { return level.size(); }
+
+void FE_LocationBatch::clear() {
+    latitude.clear();
+    longitude.clear();
+    min_lat.clear();
+    min_lon.clear();
+    max_lat.clear();
+    max_lon.clear();
+    geometry_type.clear();
+    vertex_begin.clear();
+    vertex_begin.push_back(0);
+    vertices.clear();
+    level.clear();
+    woeid.clear();
+    timestamp_ms.clear();
+    timestamp_offset.clear();
+    flags.clear();
+    names.clear();
+    label.clear();
+    level_name.clear();
+    full_location.clear();
+    place_name.clear();
+    place_id.clear();
+}
+
+void FE_LocationBatch::reserve(size_t rows) {
+    latitude.reserve(rows);
+    longitude.reserve(rows);
+    min_lat.reserve(rows);
+    min_lon.reserve(rows);
+    max_lat.reserve(rows);
+    max_lon.reserve(rows);
+    geometry_type.reserve(rows);
+    vertex_begin.reserve(rows + 1);
+    level.reserve(rows);
+    woeid.reserve(rows);
+    timestamp_ms.reserve(rows);
+    timestamp_offset.reserve(rows);
+    flags.reserve(rows);
+    label.reserve(rows);
+    level_name.reserve(rows);
+    full_location.reserve(rows);
+    place_name.reserve(rows);
+    place_id.reserve(rows);
+}
+
+void FE_LocationBatch::append(const FE_location &location) {
+    const FE_geometry &geometry = location.geometry;
+
+    latitude.push_back(geometry.latitude);
+    longitude.push_back(geometry.longitude);
+    min_lat.push_back(geometry.min_lat);
+    min_lon.push_back(geometry.min_lon);
+    max_lat.push_back(geometry.max_lat);
+    max_lon.push_back(geometry.max_lon);
+    geometry_type.push_back((unsigned char)geometry.type);
+    unsigned int nvertices = geometry.vertex_count();
+    if (nvertices) {
+        //The vertices of one polygon are contiguous in its arena.
+        const double *latlon = geometry.vertex(0);
+        vertices.insert(vertices.end(), latlon, latlon + 2 * nvertices);
+    }
+    vertex_begin.push_back(vertex_begin.back() + nvertices);
+
+    level.push_back(location.level);
+    woeid.push_back(location.woeid);
+
+    long long ms = location.timestamp_ms;
+    int offset = 0;
+    if (ms && !FE_parse_timestamp(location.timestamp.data(), location.timestamp.length(),
+                                  &ms, &offset))
+        offset = 0;
+    timestamp_ms.push_back(ms);
+    timestamp_offset.push_back((short)offset);
+
+    flags.push_back((location.best_guess ? FE_BATCH_BEST_GUESS : 0)
+                    | (location.is_place_id_exact ? FE_BATCH_PLACE_ID_EXACT : 0)
+                    | (location.is_woeid_exact ? FE_BATCH_WOEID_EXACT : 0));
+
+    label.push_back(names.intern(location.label));
+    level_name.push_back(names.intern(location.level_name));
+    full_location.push_back(names.intern(location.full_location));
+    place_name.push_back(names.intern(location.place_name));
+    place_id.push_back(names.intern(location.place_id));
+}
+
+void FE_LocationBatch::expand(size_t i, FE_location &location) const {
+    switch (geometry_type[i]) {
+    case FEGeo_POINT:
+        location.geometry.set_point(latitude[i], longitude[i]);
+        break;
+    case FEGeo_BOX:
+        location.geometry.set_box(min_lat[i], min_lon[i], max_lat[i], max_lon[i]);
+        break;
+    case FEGeo_POLYGON: {
+        FE_VertexArena *arena = new FE_VertexArena();
+        unsigned int first = vertex_begin[i];
+        unsigned int nvertices = vertex_begin[i + 1] - first;
+        location.geometry.set_polygon(arena, (nvertices) ? &vertices[2 * first] : NULL,
+                                      nvertices);
+        arena->unref();
+        break;
+    }
+    default:
+        location.geometry = FE_geometry(FEGeo_INVALID);
+        break;
+    }
+
+    location.level = level[i];
+    location.woeid = woeid[i];
+    location.timestamp_ms = timestamp_ms[i];
+    if (timestamp_ms[i])
+        location.timestamp = FE_format_timestamp(timestamp_ms[i], timestamp_offset[i]);
+    else
+        location.timestamp.clear();
+    location.best_guess = (flags[i] & FE_BATCH_BEST_GUESS) != 0;
+    location.is_place_id_exact = (flags[i] & FE_BATCH_PLACE_ID_EXACT) != 0;
+    location.is_woeid_exact = (flags[i] & FE_BATCH_WOEID_EXACT) != 0;
+    location.label = names.lookup(label[i]).str();
+    location.level_name = names.lookup(level_name[i]).str();
+    location.full_location = names.lookup(full_location[i]).str();
+    location.place_name = names.lookup(place_name[i]).str();
+    location.place_id = names.lookup(place_id[i]).str();
+}
+
+size_t FE_LocationBatch::append_response(const string &resp, enum FE_format format,
+                                         FireEagleConfig *config) {
+    size_t before = size();
+    FE_BatchSink sink(NULL, this);
+    FE_decode_response(resp, format, config, FE_NODE_LOCATIONS, sink);
+    return size() - before;
+}
+
+//The filters below have no branch in the loop: every row is written to the
+//next free slot, which only advances when the row matches. This keeps them
+//fast whatever the selectivity.
+
+size_t FE_LocationBatch::select_level(unsigned int _level, vector<unsigned int> &rows) const {
+    size_t n = size();
+    rows.resize(n);
+    if (n == 0)
+        return 0;
+
+    const unsigned int *levels = &level[0];
+    unsigned int *out = &rows[0];
+    size_t count = 0;
+    for (size_t i = 0 ; i < n ; i++) {
+        out[count] = (unsigned int)i;
+        count += (levels[i] == _level);
+    }
+    rows.resize(count);
+    return count;
+}
+
+size_t FE_LocationBatch::select_within(double _min_lat, double _min_lon,
+                                       double _max_lat, double _max_lon,
+                                       vector<unsigned int> &rows) const {
+    size_t n = size();
+    rows.resize(n);
+    if (n == 0)
+        return 0;
+
+    const double *lat = &latitude[0];
+    const double *lon = &longitude[0];
+    unsigned int *out = &rows[0];
+    size_t count = 0;
+    for (size_t i = 0 ; i < n ; i++) {
+        out[count] = (unsigned int)i;
+        count += (lat[i] >= _min_lat) & (lat[i] <= _max_lat)
+            & (lon[i] >= _min_lon) & (lon[i] <= _max_lon);
+    }
+    rows.resize(count);
+    return count;
+}
+
+size_t FE_LocationBatch::refine_level(unsigned int _level, vector<unsigned int> &rows) const {
+    size_t n = rows.size();
+    if (n == 0)
+        return 0;
+
+    const unsigned int *levels = &level[0];
+    unsigned int *io = &rows[0];
+    size_t count = 0;
+    for (size_t j = 0 ; j < n ; j++) {
+        unsigned int i = io[j];
+        io[count] = i;
+        count += (levels[i] == _level);
+    }
+    rows.resize(count);
+    return count;
+}
+
+size_t FE_LocationBatch::refine_within(double _min_lat, double _min_lon,
+                                       double _max_lat, double _max_lon,
+                                       vector<unsigned int> &rows) const {
+    size_t n = rows.size();
+    if (n == 0)
+        return 0;
+
+    const double *lat = &latitude[0];
+    const double *lon = &longitude[0];
+    unsigned int *io = &rows[0];
+    size_t count = 0;
+    for (size_t j = 0 ; j < n ; j++) {
+        unsigned int i = io[j];
+        io[count] = i;
+        count += (lat[i] >= _min_lat) & (lat[i] <= _max_lat)
+            & (lon[i] >= _min_lon) & (lon[i] <= _max_lon);
+    }
+    rows.resize(count);
+    return count;
+}
+
+template <class T> static inline size_t columnBytes(const vector<T> &column) {
+    return column.capacity() * sizeof(T);
+}
+
+size_t FE_LocationBatch::memory_used() const {
+    return sizeof(*this) - sizeof(names) + names.memory_used() + columnBytes(latitude) + columnBytes(longitude)
+        + columnBytes(min_lat) + columnBytes(min_lon) + columnBytes(max_lat)
+        + columnBytes(max_lon) + columnBytes(geometry_type) + columnBytes(vertex_begin)
+        + columnBytes(vertices) + columnBytes(level) + columnBytes(woeid)
+        + columnBytes(timestamp_ms) + columnBytes(timestamp_offset) + columnBytes(flags)
+        + columnBytes(label) + columnBytes(level_name) + columnBytes(full_location)
+        + columnBytes(place_name) + columnBytes(place_id);
+}
+
+FE_UserBatch::FE_UserBatch() {
+    token_begin.push_back(0);
+    woeid_begin.push_back(0);
+    location_begin.push_back(0);
+}
+
+size_t FE_UserBatch::size() const { return can_read.size(); }
+
+void FE_UserBatch::clear() {
+    can_read.clear();
+    can_write.clear();
+    token_begin.clear();
+    token_begin.push_back(0);
+    token_text.clear();
+    last_update_ms.clear();
+    last_update_offset.clear();
+    timezone.clear();
+    woeid_begin.clear();
+    woeid_begin.push_back(0);
+    woeids.clear();
+    location_begin.clear();
+    location_begin.push_back(0);
+    locations.clear();
+}
+
+void FE_UserBatch::append(const FE_user &user) {
+    FE_StringInterner &interner = FE_interner();
+
+    can_read.push_back(user.can_read);
+    can_write.push_back(user.can_write);
+    token_text.append(user.token);
+    token_begin.push_back((unsigned int)token_text.length());
+
+    long long ms = user.last_update_ms;
+    int offset = 0;
+    if (ms && !FE_parse_timestamp(user.last_update_timestamp.data(),
+                                  user.last_update_timestamp.length(), &ms, &offset))
+        offset = 0;
+    last_update_ms.push_back(ms);
+    last_update_offset.push_back((short)offset);
+
+    timezone.push_back(interner.intern(user.timezone));
+    woeids.insert(woeids.end(), user.woeids.begin(), user.woeids.end());
+    woeid_begin.push_back((unsigned int)woeids.size());
+
+    FE_LocationLevels::const_iterator iter;
+    for (iter = user.location.begin() ; iter != user.location.end() ; iter++)
+        locations.append(*iter);
+    location_begin.push_back((unsigned int)locations.size());
+}
+
+void FE_UserBatch::expand(size_t i, FE_user &user) const {
+    FE_StringInterner &interner = FE_interner();
+
+    user.can_read = can_read[i] != 0;
+    user.can_write = can_write[i] != 0;
+    user.token.assign(token_text, token_begin[i], token_begin[i + 1] - token_begin[i]);
+    user.last_update_ms = last_update_ms[i];
+    if (last_update_ms[i])
+        user.last_update_timestamp = FE_format_timestamp(last_update_ms[i],
+                                                         last_update_offset[i]);
+    else
+        user.last_update_timestamp.clear();
+    user.timezone = interner.lookup(timezone[i]).str();
+    user.woeids.assign(woeids.begin() + woeid_begin[i], woeids.begin() + woeid_begin[i + 1]);
+    if (user.woeids.empty())
+        user.woeid_hierarchy.clear();
+    else
+        user.woeid_hierarchy = FE_format_woeid_hierarchy(&(user.woeids[0]), user.woeids.size());
+
+    user.location.clear();
+    user.location.reserve(location_begin[i + 1] - location_begin[i]);
+    for (unsigned int row = location_begin[i] ; row < location_begin[i + 1] ; row++)
+        locations.expand(row, user.location.push_back());
+}
+
+FE_StringRef FE_UserBatch::token(size_t i) const {
+    return FE_StringRef(token_text.data() + token_begin[i], token_begin[i + 1] - token_begin[i]);
+}
+
+size_t FE_UserBatch::user_of_location(size_t row) const {
+    //location_begin is sorted; the user is the last one starting at or
+    //before row. Users without locations start where the next one does.
+    vector<unsigned int>::const_iterator pos =
+        upper_bound(location_begin.begin(), location_begin.end(), (unsigned int)row);
+    return (pos - location_begin.begin()) - 1;
+}
+
+size_t FE_UserBatch::append_response(const string &resp, enum FE_format format,
+                                     FireEagleConfig *config, enum FE_node_id container) {
+    size_t before = size();
+    FE_BatchSink sink(this, NULL);
+    FE_decode_response(resp, format, config, container, sink);
+    return size() - before;
+}
+
+size_t FE_UserBatch::memory_used() const {
+    return sizeof(*this) - sizeof(locations) + columnBytes(can_read) + columnBytes(can_write)
+        + columnBytes(token_begin) + token_text.capacity() + columnBytes(last_update_ms)
+        + columnBytes(last_update_offset) + columnBytes(timezone)
+        + columnBytes(woeid_begin) + columnBytes(woeids)
+        + columnBytes(location_begin) + locations.memory_used();
+}
+
+FE_BatchSink::FE_BatchSink(FE_UserBatch *_users, FE_LocationBatch *_locations)
+    : users(_users), locations(_locations) {}
+
+bool FE_BatchSink::decoded_user(FE_user &user) {
+    if (users)
+        users->append(user);
+    return true;
+}
+
+bool FE_BatchSink::decoded_location(FE_location &location) {
+    if (locations)
+        locations->append(location);
+    return true;
+}
@@ -0,0 +1,290 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#include <string>
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "fe_cache.h"
+#include "fe_numeric.h"
+#include "fe_lru.h"
+
+using namespace std;
+
+#define FE_CACHE_SHARD_BITS 4
+#define FE_CACHE_SHARDS (1 << FE_CACHE_SHARD_BITS)
+#define FE_CACHE_INITIAL_BUCKETS 64
+
+//An entry is in the hash chain of its bucket and in the LRU list of its
+//shard, most recently used first.
+struct FE_CacheEntry {
+    FE_CacheEntry *chain;
+    FE_CacheEntry *newer;
+    FE_CacheEntry *older;
+    unsigned int hash;
+    long long expires;
+    size_t cost;
+    string key;
+    string response;
+};
+
+struct FE_ResponseCache::Shard {
+    pthread_mutex_t lock;
+    FE_CacheEntry **buckets;
+    unsigned int nbuckets;
+    FE_CacheEntry *newest;
+    FE_CacheEntry *oldest;
+    size_t budget;
+    FE_CacheStats stats;
+};
+
+//Bytes an entry holds, as counted against the budget.
+static size_t entry_cost(const string &key, const string &response) {
+    return sizeof(FE_CacheEntry) + sizeof(FE_CacheEntry *) + key.size() + response.size();
+}
+
+FE_ResponseCache::FE_ResponseCache(size_t max_bytes, unsigned int ttl_seconds)
+    : default_ttl(ttl_seconds) {
+    shards = new Shard[FE_CACHE_SHARDS];
+    for (int i = 0 ; i < FE_CACHE_SHARDS ; i++) {
+        Shard &shard = shards[i];
+        pthread_mutex_init(&(shard.lock), NULL);
+        shard.nbuckets = FE_CACHE_INITIAL_BUCKETS;
+        shard.buckets = (FE_CacheEntry **)calloc(shard.nbuckets, sizeof(FE_CacheEntry *));
+        shard.newest = shard.oldest = NULL;
+        shard.budget = max_bytes / FE_CACHE_SHARDS;
+        memset(&(shard.stats), 0, sizeof(shard.stats));
+    }
+}
+
+FE_ResponseCache::~FE_ResponseCache() {
+    clear();
+    for (int i = 0 ; i < FE_CACHE_SHARDS ; i++) {
+        free(shards[i].buckets);
+        pthread_mutex_destroy(&(shards[i].lock));
+    }
+    delete [] shards;
+}
+
+long long FE_ResponseCache::now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+//Arguments whose values are text typed by people, where case and spacing
+//do not change the answer. Everything else (place_id, woeid, cell ids,
+//coordinates) is an identifier and kept byte for byte: place ids are case
+//sensitive.
+static bool is_free_text(const string &name) {
+    static const char *names[] = { "address", "city", "country", "postal", "q", "state" };
+    for (size_t i = 0 ; i < sizeof(names) / sizeof(names[0]) ; i++) {
+        if (name == names[i])
+            return true;
+    }
+    return false;
+}
+
+static void append_normalized(string &key, const string &text) {
+    size_t begin = key.size();
+    bool space = false;
+    for (size_t i = 0 ; i < text.size() ; i++) {
+        char c = text[i];
+        if ((c == ' ') || (c == '\t') || (c == '\n') || (c == '\r')) {
+            space = true;
+            continue;
+        }
+        if (space && (key.size() > begin))
+            key += ' ';
+        space = false;
+        key += ((c >= 'A') && (c <= 'Z')) ? (char)(c - 'A' + 'a') : c;
+    }
+}
+
+string FE_ResponseCache::make_key(const string &method, const FE_ParamPairs &args,
+                                  enum FE_format format) {
+    string key(method);
+    key += '.';
+    key += FE_format_info[format].extension;
+    //Each name and value ends with a 0, so no value can run into the next.
+    for (FE_ParamPairs::const_iterator iter = args.begin() ; iter != args.end() ; iter++) {
+        key += '\n';
+        key += iter->first;
+        key += '\0';
+        if (is_free_text(iter->first))
+            append_normalized(key, iter->second);
+        else
+            key += iter->second;
+        key += '\0';
+    }
+    return key;
+}
+
+//Link to the entry for key, or to the NULL ending its chain. Call with the
+//lock held.
+static FE_CacheEntry **find_entry(FE_ResponseCache::Shard &shard, unsigned int h,
+                                  const string &key) {
+    FE_CacheEntry **link = &(shard.buckets[(h >> FE_CACHE_SHARD_BITS) & (shard.nbuckets - 1)]);
+    while (*link) {
+        if (((*link)->hash == h) && ((*link)->key == key))
+            break;
+        link = &((*link)->chain);
+    }
+    return link;
+}
+
+//Remove the entry *link points to. Call with the lock held.
+static void remove_entry(FE_ResponseCache::Shard &shard, FE_CacheEntry **link) {
+    FE_CacheEntry *entry = *link;
+    *link = entry->chain;
+    FE_lru_unlink(shard, entry);
+    shard.stats.entries--;
+    shard.stats.bytes -= entry->cost;
+    delete entry;
+}
+
+static void grow(FE_ResponseCache::Shard &shard) {
+    unsigned int nbuckets = shard.nbuckets * 2;
+    FE_CacheEntry **buckets = (FE_CacheEntry **)calloc(nbuckets, sizeof(FE_CacheEntry *));
+    if (!buckets)
+        return; //Keep the longer chains.
+    for (unsigned int b = 0 ; b < shard.nbuckets ; b++) {
+        FE_CacheEntry *entry = shard.buckets[b];
+        while (entry) {
+            FE_CacheEntry *next = entry->chain;
+            FE_CacheEntry *&head = buckets[(entry->hash >> FE_CACHE_SHARD_BITS) & (nbuckets - 1)];
+            entry->chain = head;
+            head = entry;
+            entry = next;
+        }
+    }
+    free(shard.buckets);
+    shard.buckets = buckets;
+    shard.nbuckets = nbuckets;
+}
+
+bool FE_ResponseCache::get(const string &key, string &response) {
+    unsigned int h = FE_hash_fnv1a(key.data(), key.size());
+    Shard &shard = shards[h & (FE_CACHE_SHARDS - 1)];
+    long long now = now_ms();
+
+    pthread_mutex_lock(&(shard.lock));
+    FE_CacheEntry **link = find_entry(shard, h, key);
+    FE_CacheEntry *entry = *link;
+    if (entry && (entry->expires <= now)) {
+        remove_entry(shard, link);
+        shard.stats.expirations++;
+        entry = NULL;
+    }
+    if (!entry) {
+        shard.stats.misses++;
+        pthread_mutex_unlock(&(shard.lock));
+        return false;
+    }
+    FE_lru_touch(shard, entry);
+    shard.stats.hits++;
+    response.assign(entry->response);
+    pthread_mutex_unlock(&(shard.lock));
+
+    return true;
+}
+
+void FE_ResponseCache::put(const string &key, const string &response) {
+    put(key, response, default_ttl);
+}
+
+void FE_ResponseCache::put(const string &key, const string &response,
+                           unsigned int ttl_seconds) {
+    size_t cost = entry_cost(key, response);
+    unsigned int h = FE_hash_fnv1a(key.data(), key.size());
+    Shard &shard = shards[h & (FE_CACHE_SHARDS - 1)];
+    //Copy outside the lock.
+    FE_CacheEntry *entry = NULL;
+    if (cost <= shard.budget) {
+        entry = new FE_CacheEntry;
+        entry->hash = h;
+        entry->expires = now_ms() + ttl_seconds * 1000LL;
+        entry->cost = cost;
+        entry->key = key;
+        entry->response = response;
+    }
+
+    pthread_mutex_lock(&(shard.lock));
+    FE_CacheEntry **link = find_entry(shard, h, key);
+    if (*link)
+        remove_entry(shard, link);
+    if (!entry) {
+        pthread_mutex_unlock(&(shard.lock));
+        return;
+    }
+
+    while (shard.oldest && (shard.stats.bytes + cost > shard.budget)) {
+        FE_CacheEntry *oldest = shard.oldest;
+        remove_entry(shard, find_entry(shard, oldest->hash, oldest->key));
+        shard.stats.evictions++;
+    }
+
+    link = find_entry(shard, h, key);
+    entry->chain = NULL;
+    *link = entry;
+    FE_lru_link_newest(shard, entry);
+    shard.stats.entries++;
+    shard.stats.bytes += cost;
+    shard.stats.insertions++;
+    if (shard.stats.entries > shard.nbuckets)
+        grow(shard);
+    pthread_mutex_unlock(&(shard.lock));
+}
+
+void FE_ResponseCache::erase(const string &key) {
+    unsigned int h = FE_hash_fnv1a(key.data(), key.size());
+    Shard &shard = shards[h & (FE_CACHE_SHARDS - 1)];
+
+    pthread_mutex_lock(&(shard.lock));
+    FE_CacheEntry **link = find_entry(shard, h, key);
+    if (*link)
+        remove_entry(shard, link);
+    pthread_mutex_unlock(&(shard.lock));
+}
+
+void FE_ResponseCache::clear() {
+    for (int i = 0 ; i < FE_CACHE_SHARDS ; i++) {
+        Shard &shard = shards[i];
+        pthread_mutex_lock(&(shard.lock));
+        FE_CacheEntry *entry = shard.newest;
+        while (entry) {
+            FE_CacheEntry *older = entry->older;
+            delete entry;
+            entry = older;
+        }
+        memset(shard.buckets, 0, shard.nbuckets * sizeof(FE_CacheEntry *));
+        shard.newest = shard.oldest = NULL;
+        shard.stats.entries = 0;
+        shard.stats.bytes = 0;
+        pthread_mutex_unlock(&(shard.lock));
+    }
+}
+
+FE_CacheStats FE_ResponseCache::stats() const {
+    FE_CacheStats total;
+    memset(&total, 0, sizeof(total));
+    for (int i = 0 ; i < FE_CACHE_SHARDS ; i++) {
+        Shard &shard = shards[i];
+        pthread_mutex_lock(&(shard.lock));
+        total.hits += shard.stats.hits;
+        total.misses += shard.stats.misses;
+        total.insertions += shard.stats.insertions;
+        total.evictions += shard.stats.evictions;
+        total.expirations += shard.stats.expirations;
+        total.entries += shard.stats.entries;
+        total.bytes += shard.stats.bytes;
+        pthread_mutex_unlock(&(shard.lock));
+    }
+    return total;
+}
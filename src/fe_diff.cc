@@ -0,0 +1,118 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#include <math.h>
+#include <string.h>
+
+#include "fe_diff.h"
+
+using namespace std;
+
+#define FNV64_OFFSET 14695981039346656037ULL
+#define FNV64_PRIME 1099511628211ULL
+
+//FNV-1a over the bytes of a value, low byte first so the hash does not
+//depend on the byte order of the host.
+static unsigned long long hash_value(unsigned long long h, unsigned long long value,
+                                     int bytes) {
+    for (int i = 0 ; i < bytes ; i++) {
+        h ^= (value >> (8 * i)) & 0xff;
+        h *= FNV64_PRIME;
+    }
+    return h;
+}
+
+static unsigned long long hash_coordinate(unsigned long long h, double degrees) {
+    long long cell = (long long)floor(degrees * FE_FINGERPRINT_GRID);
+    return hash_value(h, (unsigned long long)cell, 8);
+}
+
+static unsigned long long hash_location(const FE_location &location) {
+    unsigned long long h = FNV64_OFFSET;
+    h = hash_value(h, location.woeid, 4);
+    h = hash_value(h, location.level, 4);
+    const FE_geometry &geometry = location.geometry;
+    h = hash_value(h, geometry.type, 1);
+    if (geometry.type != FEGeo_INVALID) {
+        h = hash_coordinate(h, geometry.min_lat);
+        h = hash_coordinate(h, geometry.min_lon);
+        h = hash_coordinate(h, geometry.max_lat);
+        h = hash_coordinate(h, geometry.max_lon);
+    }
+    //0 marks an empty level.
+    return h ? h : 1;
+}
+
+FE_UserFingerprint::FE_UserFingerprint()
+    : present(0), best_guess(FE_FINGERPRINT_NO_LEVEL), can_read(false), can_write(false),
+      all(0) {
+    memset(levels, 0, sizeof(levels));
+}
+
+void FE_UserFingerprint::assign(const FE_user &user) {
+    memset(levels, 0, sizeof(levels));
+    present = 0;
+    best_guess = FE_FINGERPRINT_NO_LEVEL;
+    can_read = user.can_read;
+    can_write = user.can_write;
+
+    for (size_t i = 0 ; i < user.location.size() ; i++) {
+        const FE_location &location = user.location[i];
+        unsigned int slot = location.level;
+        if (slot >= FE_FINGERPRINT_LEVELS)
+            slot = FE_FINGERPRINT_LEVELS - 1;
+        //Two locations in a slot: keep both in its hash.
+        levels[slot] = levels[slot] ? (levels[slot] ^ hash_location(location)) * FNV64_PRIME
+            : hash_location(location);
+        present |= 1U << slot;
+        if (location.best_guess && (best_guess == FE_FINGERPRINT_NO_LEVEL))
+            best_guess = (unsigned char)slot;
+    }
+
+    unsigned long long h = FNV64_OFFSET;
+    for (int i = 0 ; i < FE_FINGERPRINT_LEVELS ; i++) {
+        if (present & (1U << i))
+            h = hash_value(h, levels[i], 8);
+    }
+    h = hash_value(h, present, 4);
+    h = hash_value(h, best_guess, 1);
+    h = hash_value(h, (can_read ? 1 : 0) | (can_write ? 2 : 0), 1);
+    all = h;
+}
+
+int FE_UserChange::finest_level() const {
+    for (int i = 0 ; i < FE_FINGERPRINT_LEVELS ; i++) {
+        if (levels & (1U << i))
+            return i;
+    }
+    return -1;
+}
+
+bool FE_diff_users(const FE_UserFingerprint &before, const FE_UserFingerprint &after,
+                   FE_UserChange &change) {
+    change = FE_UserChange();
+    if (before.all == after.all)
+        return false;
+
+    for (int i = 0 ; i < FE_FINGERPRINT_LEVELS ; i++) {
+        if (before.levels[i] != after.levels[i])
+            change.levels |= 1U << i;
+    }
+    change.best_guess = (before.best_guess != after.best_guess);
+    if (before.can_read != after.can_read)
+        change.permissions |= before.can_read ? FE_CHANGE_READ_REVOKED : FE_CHANGE_READ_GRANTED;
+    if (before.can_write != after.can_write)
+        change.permissions |= before.can_write ? FE_CHANGE_WRITE_REVOKED
+            : FE_CHANGE_WRITE_GRANTED;
+    return !change.empty();
+}
+
+bool FE_diff_users(const FE_user &before, const FE_user &after, FE_UserChange &change) {
+    FE_UserFingerprint from, to;
+    from.assign(before);
+    to.assign(after);
+    return FE_diff_users(from, to, change);
+}
@@ -0,0 +1,276 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#include <vector>
+
+#include <math.h>
+
+#if defined(__SSE2__) && !defined(FE_NO_SIMD)
+#define FE_GEO_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "fe_geo.h"
+
+using namespace std;
+
+#define DEG_TO_RAD (M_PI / 180.0)
+
+double FE_haversine(double lat1, double lon1, double lat2, double lon2) {
+    double dlat = (lat2 - lat1) * DEG_TO_RAD;
+    double dlon = (lon2 - lon1) * DEG_TO_RAD;
+    double s = sin(dlat / 2);
+    double t = sin(dlon / 2);
+    double h = s * s + cos(lat1 * DEG_TO_RAD) * cos(lat2 * DEG_TO_RAD) * t * t;
+    if (h > 1)
+        h = 1;
+    return 2 * FE_EARTH_RADIUS_M * asin(sqrt(h));
+}
+
+FE_UnitVectors::FE_UnitVectors() {}
+
+FE_UnitVectors::FE_UnitVectors(const double *lat, const double *lon, size_t n) {
+    assign(lat, lon, n);
+}
+
+void FE_UnitVectors::assign(const double *lat, const double *lon, size_t n) {
+    x.resize(n);
+    y.resize(n);
+    z.resize(n);
+    for (size_t i = 0 ; i < n ; i++) {
+        double phi = lat[i] * DEG_TO_RAD;
+        double lambda = lon[i] * DEG_TO_RAD;
+        double c = cos(phi);
+        x[i] = c * cos(lambda);
+        y[i] = c * sin(lambda);
+        z[i] = sin(phi);
+    }
+}
+
+size_t FE_UnitVectors::size() const { return x.size(); }
+
+//Great circle distance from half the chord between two unit vectors.
+static inline double chordToMeters(double half_chord) {
+    return 2 * FE_EARTH_RADIUS_M * asin((half_chord > 1) ? 1 : half_chord);
+}
+
+void FE_geo_distances(double lat, double lon, const FE_UnitVectors &points, double *meters) {
+    size_t n = points.size();
+    if (n == 0)
+        return;
+
+    double c = cos(lat * DEG_TO_RAD);
+    double px = c * cos(lon * DEG_TO_RAD);
+    double py = c * sin(lon * DEG_TO_RAD);
+    double pz = sin(lat * DEG_TO_RAD);
+    const double *x = &points.x[0];
+    const double *y = &points.y[0];
+    const double *z = &points.z[0];
+
+    //Half chords first, then the asin, which has no SIMD form.
+    size_t i = 0;
+#ifdef FE_GEO_SSE2
+    __m128d vx = _mm_set1_pd(px);
+    __m128d vy = _mm_set1_pd(py);
+    __m128d vz = _mm_set1_pd(pz);
+    __m128d half = _mm_set1_pd(0.5);
+    for ( ; i + 2 <= n ; i += 2) {
+        __m128d dx = _mm_sub_pd(_mm_loadu_pd(x + i), vx);
+        __m128d dy = _mm_sub_pd(_mm_loadu_pd(y + i), vy);
+        __m128d dz = _mm_sub_pd(_mm_loadu_pd(z + i), vz);
+        __m128d c2 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)),
+                                _mm_mul_pd(dz, dz));
+        _mm_storeu_pd(meters + i, _mm_mul_pd(_mm_sqrt_pd(c2), half));
+    }
+#endif
+    for ( ; i < n ; i++) {
+        double dx = x[i] - px;
+        double dy = y[i] - py;
+        double dz = z[i] - pz;
+        meters[i] = sqrt(dx * dx + dy * dy + dz * dz) * 0.5;
+    }
+
+    for (i = 0 ; i < n ; i++)
+        meters[i] = chordToMeters(meters[i]);
+}
+
+void FE_geo_nearest(const FE_UnitVectors &from, const FE_UnitVectors &to,
+                    unsigned int *nearest, double *meters) {
+    size_t n = from.size();
+    size_t m = to.size();
+    bool same = (&from == &to);
+    if (n == 0)
+        return;
+    if (m == 0) {
+        for (size_t i = 0 ; i < n ; i++) {
+            nearest[i] = (unsigned int)-1;
+            if (meters)
+                meters[i] = HUGE_VAL;
+        }
+        return;
+    }
+
+    const double *x = &to.x[0];
+    const double *y = &to.y[0];
+    const double *z = &to.z[0];
+
+    for (size_t i = 0 ; i < n ; i++) {
+        double px = from.x[i];
+        double py = from.y[i];
+        double pz = from.z[i];
+        //Self is skipped by comparing indexes, which are exact as doubles.
+        double self = (same) ? (double)i : -1.0;
+        double best = HUGE_VAL;
+        double best_index = -1.0;
+        size_t j = 0;
+
+#ifdef FE_GEO_SSE2
+        //Each lane keeps the first minimum of its own candidates; ties
+        //between the lanes go to the lower index, as in the plain loop.
+        __m128d vx = _mm_set1_pd(px);
+        __m128d vy = _mm_set1_pd(py);
+        __m128d vz = _mm_set1_pd(pz);
+        __m128d vself = _mm_set1_pd(self);
+        __m128d vinf = _mm_set1_pd(HUGE_VAL);
+        __m128d two = _mm_set1_pd(2.0);
+        __m128d index = _mm_set_pd(1.0, 0.0);
+        __m128d lane_best = vinf;
+        __m128d lane_index = _mm_set1_pd(-1.0);
+        for ( ; j + 2 <= m ; j += 2) {
+            __m128d dx = _mm_sub_pd(_mm_loadu_pd(x + j), vx);
+            __m128d dy = _mm_sub_pd(_mm_loadu_pd(y + j), vy);
+            __m128d dz = _mm_sub_pd(_mm_loadu_pd(z + j), vz);
+            __m128d c2 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)),
+                                    _mm_mul_pd(dz, dz));
+            __m128d is_self = _mm_cmpeq_pd(index, vself);
+            c2 = _mm_or_pd(_mm_andnot_pd(is_self, c2), _mm_and_pd(is_self, vinf));
+            __m128d better = _mm_cmplt_pd(c2, lane_best);
+            lane_best = _mm_or_pd(_mm_andnot_pd(better, lane_best), _mm_and_pd(better, c2));
+            lane_index = _mm_or_pd(_mm_andnot_pd(better, lane_index),
+                                   _mm_and_pd(better, index));
+            index = _mm_add_pd(index, two);
+        }
+
+        double bests[2], indexes[2];
+        _mm_storeu_pd(bests, lane_best);
+        _mm_storeu_pd(indexes, lane_index);
+        for (int lane = 0 ; lane < 2 ; lane++) {
+            if (indexes[lane] < 0)
+                continue;
+            if ((bests[lane] < best)
+                || ((bests[lane] == best) && (indexes[lane] < best_index))) {
+                best = bests[lane];
+                best_index = indexes[lane];
+            }
+        }
+#endif
+        for ( ; j < m ; j++) {
+            if ((double)j == self)
+                continue;
+            double dx = x[j] - px;
+            double dy = y[j] - py;
+            double dz = z[j] - pz;
+            double c2 = dx * dx + dy * dy + dz * dz;
+            if (c2 < best) {
+                best = c2;
+                best_index = (double)j;
+            }
+        }
+
+        if (best_index < 0) {
+            nearest[i] = (unsigned int)-1;
+            if (meters)
+                meters[i] = HUGE_VAL;
+        } else {
+            nearest[i] = (unsigned int)best_index;
+            if (meters)
+                meters[i] = chordToMeters(sqrt(best) * 0.5);
+        }
+    }
+}
+
+size_t FE_geo_points_in_box(const double *lat, const double *lon, size_t n,
+                            double min_lat, double min_lon, double max_lat, double max_lon,
+                            unsigned char *inside) {
+    size_t count = 0;
+    size_t i = 0;
+#ifdef FE_GEO_SSE2
+    __m128d lo_lat = _mm_set1_pd(min_lat);
+    __m128d lo_lon = _mm_set1_pd(min_lon);
+    __m128d hi_lat = _mm_set1_pd(max_lat);
+    __m128d hi_lon = _mm_set1_pd(max_lon);
+    for ( ; i + 2 <= n ; i += 2) {
+        __m128d a = _mm_loadu_pd(lat + i);
+        __m128d b = _mm_loadu_pd(lon + i);
+        __m128d in = _mm_and_pd(_mm_and_pd(_mm_cmpge_pd(a, lo_lat), _mm_cmple_pd(a, hi_lat)),
+                                _mm_and_pd(_mm_cmpge_pd(b, lo_lon), _mm_cmple_pd(b, hi_lon)));
+        int bits = _mm_movemask_pd(in);
+        inside[i] = bits & 1;
+        inside[i + 1] = (bits >> 1) & 1;
+        count += inside[i] + inside[i + 1];
+    }
+#endif
+    for ( ; i < n ; i++) {
+        inside[i] = (lat[i] >= min_lat) & (lat[i] <= max_lat)
+            & (lon[i] >= min_lon) & (lon[i] <= max_lon);
+        count += inside[i];
+    }
+    return count;
+}
+
+size_t FE_geo_boxes_containing(const double *min_lat, const double *min_lon,
+                               const double *max_lat, const double *max_lon, size_t n,
+                               double lat, double lon, unsigned char *inside) {
+    size_t count = 0;
+    size_t i = 0;
+#ifdef FE_GEO_SSE2
+    __m128d a = _mm_set1_pd(lat);
+    __m128d b = _mm_set1_pd(lon);
+    for ( ; i + 2 <= n ; i += 2) {
+        __m128d in = _mm_and_pd(
+            _mm_and_pd(_mm_cmple_pd(_mm_loadu_pd(min_lat + i), a),
+                       _mm_cmpge_pd(_mm_loadu_pd(max_lat + i), a)),
+            _mm_and_pd(_mm_cmple_pd(_mm_loadu_pd(min_lon + i), b),
+                       _mm_cmpge_pd(_mm_loadu_pd(max_lon + i), b)));
+        int bits = _mm_movemask_pd(in);
+        inside[i] = bits & 1;
+        inside[i + 1] = (bits >> 1) & 1;
+        count += inside[i] + inside[i + 1];
+    }
+#endif
+    for ( ; i < n ; i++) {
+        inside[i] = (min_lat[i] <= lat) & (max_lat[i] >= lat)
+            & (min_lon[i] <= lon) & (max_lon[i] >= lon);
+        count += inside[i];
+    }
+    return count;
+}
+
+static const char geohash_digits[] = "0123456789bcdefghjkmnpqrstuvwxyz";
+
+void FE_geohash(double lat, double lon, unsigned int precision, char *out) {
+    double lat_low = -90, lat_high = 90;
+    double lon_low = -180, lon_high = 180;
+    //Bits alternate between longitude and latitude, longitude first.
+    bool even = true;
+    for (unsigned int c = 0 ; c < precision ; c++) {
+        int digit = 0;
+        for (int bit = 0 ; bit < 5 ; bit++) {
+            double &low = (even) ? lon_low : lat_low;
+            double &high = (even) ? lon_high : lat_high;
+            double value = (even) ? lon : lat;
+            double middle = (low + high) / 2;
+            digit <<= 1;
+            if (value >= middle) {
+                digit |= 1;
+                low = middle;
+            } else
+                high = middle;
+            even = !even;
+        }
+        out[c] = geohash_digits[digit];
+    }
+}
@@ -0,0 +1,215 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#include <string>
+#include <list>
+
+#include <string.h>
+
+#include "fe_geocache.h"
+#include "fe_numeric.h"
+
+using namespace std;
+
+//An entry is a flag telling whether a bounding box follows, the box
+//(min_lat, min_lon, max_lat, max_lon) and the response.
+#define ENTRY_HAS_BOX 'B'
+#define ENTRY_NO_BOX 'P'
+#define ENTRY_HEADER (1 + 4 * sizeof(double))
+
+static const unsigned int default_precision[FE_GEOCACHE_LEVELS] = {
+    7, //exact
+    6, //postal
+    6, //neighborhood
+    5, //city
+    4, //region
+    4, //state
+    3, //country
+    3,
+    3
+};
+
+FE_GeoCache::FE_GeoCache(size_t max_bytes, unsigned int ttl_seconds)
+    : cache(max_bytes, ttl_seconds) {
+    memset(&counters, 0, sizeof(counters));
+    for (unsigned int level = 0 ; level < FE_GEOCACHE_LEVELS ; level++)
+        precision[level] = default_precision[level];
+    update_probes();
+}
+
+void FE_GeoCache::update_probes() {
+    nprobes = 0;
+    for (unsigned int chars = FE_GEOHASH_MAX ; chars > 0 ; chars--) {
+        for (unsigned int level = 0 ; level < FE_GEOCACHE_LEVELS ; level++) {
+            if (precision[level] == chars) {
+                probes[nprobes++] = chars;
+                break;
+            }
+        }
+    }
+}
+
+void FE_GeoCache::set_precision(unsigned int level, unsigned int chars) {
+    if (level >= FE_GEOCACHE_LEVELS)
+        return;
+    precision[level] = (chars > FE_GEOHASH_MAX) ? FE_GEOHASH_MAX : chars;
+    update_probes();
+}
+
+unsigned int FE_GeoCache::get_precision(unsigned int level) const {
+    return (level < FE_GEOCACHE_LEVELS) ? precision[level] : 0;
+}
+
+string FE_GeoCache::make_key(enum FE_format format, const char *cell, unsigned int chars) {
+    string key("geo.");
+    key += FE_format_info[format].extension;
+    key += ' ';
+    key.append(cell, chars);
+    return key;
+}
+
+bool FE_GeoCache::get(double lat, double lon, enum FE_format format, string &response) {
+    __sync_fetch_and_add(&(counters.lookups), 1);
+
+    char cell[FE_GEOHASH_MAX];
+    if (nprobes)
+        FE_geohash(lat, lon, probes[0], cell);
+    string entry;
+    for (unsigned int i = 0 ; i < nprobes ; i++) {
+        unsigned int chars = probes[i];
+        if (!cache.get(make_key(format, cell, chars), entry) || (entry.size() < ENTRY_HEADER))
+            continue;
+        if (entry[0] == ENTRY_HAS_BOX) {
+            double box[4];
+            memcpy(box, entry.data() + 1, sizeof(box));
+            if ((lat < box[0]) || (lon < box[1]) || (lat > box[2]) || (lon > box[3])) {
+                __sync_fetch_and_add(&(counters.outside[chars]), 1);
+                continue;
+            }
+        }
+        __sync_fetch_and_add(&(counters.hits[chars]), 1);
+        response.assign(entry, ENTRY_HEADER, string::npos);
+        return true;
+    }
+
+    __sync_fetch_and_add(&(counters.misses), 1);
+    return false;
+}
+
+//Keeps the best guess of a lookup response, or its first location if none
+//is, and stops the parse at the best guess.
+class BestGuessSink : public FE_ObjectSink {
+  public:
+    FE_location best;
+    bool found;
+
+    BestGuessSink() : found(false) {}
+
+    bool decoded_location(FE_location &location) {
+        if (!found || location.best_guess)
+            best.swap(location);
+        found = true;
+        return !best.best_guess;
+    }
+};
+
+void FE_GeoCache::put(double lat, double lon, enum FE_format format, const string &response,
+                      const list<FE_location> &locations) {
+    if (locations.empty())
+        return;
+    const FE_location *best = &(locations.front());
+    for (list<FE_location>::const_iterator iter = locations.begin() ;
+         iter != locations.end() ; iter++) {
+        if (iter->best_guess) {
+            best = &(*iter);
+            break;
+        }
+    }
+    put_best(lat, lon, format, response, *best);
+}
+
+void FE_GeoCache::put(double lat, double lon, enum FE_format format, const string &response,
+                      FireEagleConfig *config) {
+    BestGuessSink sink;
+    try {
+        FE_decode_response(response, format, config, FE_NODE_LOCATIONS, sink);
+    } catch (FireEagleException *e) {
+        delete e;
+        __sync_fetch_and_add(&(counters.decode_errors), 1);
+        return;
+    }
+    if (sink.found)
+        put_best(lat, lon, format, response, sink.best);
+}
+
+void FE_GeoCache::put_best(double lat, double lon, enum FE_format format,
+                           const string &response, const FE_location &best) {
+    unsigned int chars = get_precision(best.level);
+    if (!chars)
+        return;
+
+    string entry;
+    entry.reserve(ENTRY_HEADER + response.size());
+    double box[4] = { 0, 0, 0, 0 };
+    const FE_geometry &geometry = best.geometry;
+    if ((geometry.type == FEGeo_BOX) || (geometry.type == FEGeo_POLYGON)) {
+        entry += ENTRY_HAS_BOX;
+        box[0] = geometry.min_lat;
+        box[1] = geometry.min_lon;
+        box[2] = geometry.max_lat;
+        box[3] = geometry.max_lon;
+    } else
+        entry += ENTRY_NO_BOX;
+    entry.append((const char *)box, sizeof(box));
+    entry += response;
+
+    char cell[FE_GEOHASH_MAX];
+    FE_geohash(lat, lon, chars, cell);
+    cache.put(make_key(format, cell, chars), entry);
+    __sync_fetch_and_add(&(counters.stores[chars]), 1);
+}
+
+FE_GeoCacheStats FE_GeoCache::stats() const {
+    FE_GeoCacheStats copy;
+    copy.lookups = counters.lookups;
+    copy.misses = counters.misses;
+    copy.decode_errors = counters.decode_errors;
+    for (unsigned int chars = 0 ; chars <= FE_GEOHASH_MAX ; chars++) {
+        copy.hits[chars] = counters.hits[chars];
+        copy.outside[chars] = counters.outside[chars];
+        copy.stores[chars] = counters.stores[chars];
+    }
+    copy.cache = cache.stats();
+    return copy;
+}
+
+static bool parse_coordinate(const string &text, size_t begin, size_t end, double *value) {
+    while ((begin < end) && (text[begin] == ' '))
+        begin++;
+    while ((end > begin) && (text[end - 1] == ' '))
+        end--;
+    return (end > begin) && FE_parse_double(text.data() + begin, end - begin, value);
+}
+
+bool FE_GeoCache::parse_query(const FE_ParamPairs &args, double &lat, double &lon) {
+    bool parsed = false;
+    if (args.size() == 1) {
+        FE_ParamPairs::const_iterator q = args.find("q");
+        if (q != args.end()) {
+            size_t comma = q->second.find(',');
+            parsed = (comma != string::npos)
+                && parse_coordinate(q->second, 0, comma, &lat)
+                && parse_coordinate(q->second, comma + 1, q->second.size(), &lon);
+        }
+    } else if (args.size() == 2) {
+        FE_ParamPairs::const_iterator la = args.find("lat");
+        FE_ParamPairs::const_iterator lo = args.find("lon");
+        parsed = (la != args.end()) && (lo != args.end())
+            && parse_coordinate(la->second, 0, la->second.size(), &lat)
+            && parse_coordinate(lo->second, 0, lo->second.size(), &lon);
+    }
+    return parsed && (lat >= -90) && (lat <= 90) && (lon >= -180) && (lon <= 180);
+}
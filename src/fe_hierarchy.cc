@@ -0,0 +1,195 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#include <limits.h>
+#include <pthread.h>
+
+#include "fe_hierarchy.h"
+#include "fe_numeric.h"
+
+using namespace std;
+
+void FE_parse_woeid_hierarchy(const char *s, size_t len, vector<unsigned int> &woeids) {
+    const char *p = s;
+    const char *end = s + len;
+
+    woeids.clear();
+    while (p < end) {
+        const char *item = p;
+        while ((p < end) && (*p != '|'))
+            p++;
+
+        long woeid;
+        if (FE_parse_long(item, p - item, &woeid) && (woeid > 0) && (woeid < UINT_MAX))
+            woeids.push_back((unsigned int)woeid);
+        p++; //Skip the '|'
+    }
+}
+
+string FE_format_woeid_hierarchy(const unsigned int *woeids, size_t n) {
+    string text;
+    text.reserve(n * 9);
+    char digits[16];
+    for (size_t i = 0 ; i < n ; i++) {
+        if (i)
+            text += '|';
+        int len = 0;
+        unsigned int woeid = woeids[i];
+        do {
+            digits[len++] = (char)('0' + woeid % 10);
+            woeid /= 10;
+        } while (woeid);
+        while (len)
+            text += digits[--len];
+    }
+    return text;
+}
+
+FE_HierarchyTrie::FE_HierarchyTrie() {
+    root.woeid = 0;
+    root.parent = NULL;
+    root.total = 0;
+    pthread_rwlock_init(&lock, NULL);
+}
+
+FE_HierarchyTrie::~FE_HierarchyTrie() {
+    map<unsigned int, Node *>::iterator iter;
+    for (iter = root.children.begin() ; iter != root.children.end() ; iter++)
+        destroy(iter->second);
+    pthread_rwlock_destroy(&lock);
+}
+
+void FE_HierarchyTrie::destroy(Node *node) {
+    map<unsigned int, Node *>::iterator iter;
+    for (iter = node->children.begin() ; iter != node->children.end() ; iter++)
+        destroy(iter->second);
+    delete node;
+}
+
+//Take a user off its node, dropping the nodes that no longer lead to anyone.
+//Call with the write lock held.
+void FE_HierarchyTrie::unlink(const string &token, Node *node) {
+    vector<string>::iterator pos = find(node->users.begin(), node->users.end(), token);
+    if (pos != node->users.end()) {
+        pos->swap(node->users.back());
+        node->users.pop_back();
+    }
+
+    for (Node *n = node ; n ; n = n->parent)
+        n->total--;
+
+    while ((node != &root) && (node->total == 0)) {
+        Node *parent = node->parent;
+        parent->children.erase(node->woeid);
+
+        vector<Node *> &nodes = by_woeid[node->woeid];
+        nodes.erase(find(nodes.begin(), nodes.end(), node));
+        if (nodes.empty())
+            by_woeid.erase(node->woeid);
+
+        delete node;
+        node = parent;
+    }
+}
+
+void FE_HierarchyTrie::insert(const string &token, const vector<unsigned int> &woeids) {
+    pthread_rwlock_wrlock(&lock);
+
+    map<string, Node *>::iterator user = by_user.find(token);
+    if (user != by_user.end()) {
+        unlink(token, user->second);
+        by_user.erase(user);
+    }
+
+    if (!woeids.empty()) {
+        Node *node = &root;
+        for (size_t i = 0 ; i < woeids.size() ; i++) {
+            map<unsigned int, Node *>::iterator child = node->children.find(woeids[i]);
+            if (child != node->children.end()) {
+                node = child->second;
+                continue;
+            }
+
+            Node *next = new Node();
+            next->woeid = woeids[i];
+            next->parent = node;
+            next->total = 0;
+            node->children[woeids[i]] = next;
+            by_woeid[woeids[i]].push_back(next);
+            node = next;
+        }
+
+        node->users.push_back(token);
+        by_user[token] = node;
+        for (Node *n = node ; n ; n = n->parent)
+            n->total++;
+    }
+
+    pthread_rwlock_unlock(&lock);
+}
+
+bool FE_HierarchyTrie::remove(const string &token) {
+    pthread_rwlock_wrlock(&lock);
+
+    map<string, Node *>::iterator user = by_user.find(token);
+    bool found = (user != by_user.end());
+    if (found) {
+        unlink(token, user->second);
+        by_user.erase(user);
+    }
+
+    pthread_rwlock_unlock(&lock);
+    return found;
+}
+
+void FE_HierarchyTrie::collect(const Node *node, vector<string> &tokens) const {
+    tokens.insert(tokens.end(), node->users.begin(), node->users.end());
+
+    map<unsigned int, Node *>::const_iterator iter;
+    for (iter = node->children.begin() ; iter != node->children.end() ; iter++)
+        collect(iter->second, tokens);
+}
+
+size_t FE_HierarchyTrie::users_under(unsigned int woeid, vector<string> &tokens) const {
+    size_t before = tokens.size();
+
+    pthread_rwlock_rdlock(&lock);
+    map<unsigned int, vector<Node *> >::const_iterator iter = by_woeid.find(woeid);
+    if (iter != by_woeid.end()) {
+        for (size_t i = 0 ; i < iter->second.size() ; i++)
+            collect(iter->second[i], tokens);
+    }
+    pthread_rwlock_unlock(&lock);
+
+    return tokens.size() - before;
+}
+
+size_t FE_HierarchyTrie::count_under(unsigned int woeid) const {
+    size_t count = 0;
+
+    pthread_rwlock_rdlock(&lock);
+    map<unsigned int, vector<Node *> >::const_iterator iter = by_woeid.find(woeid);
+    if (iter != by_woeid.end()) {
+        for (size_t i = 0 ; i < iter->second.size() ; i++)
+            count += iter->second[i]->total;
+    }
+    pthread_rwlock_unlock(&lock);
+
+    return count;
+}
+
+size_t FE_HierarchyTrie::size() const {
+    pthread_rwlock_rdlock(&lock);
+    size_t count = root.total;
+    pthread_rwlock_unlock(&lock);
+
+    return count;
+}
@@ -0,0 +1,326 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#include <string>
+#include <vector>
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "fe_intern.h"
+#include "fe_numeric.h"
+#include "fireeagle.h" //For FireEagleException
+
+using namespace std;
+
+#define FE_INTERN_SHARD_BITS 4
+#define FE_INTERN_SHARDS (1 << FE_INTERN_SHARD_BITS)
+//Symbol texts are kept in pages that never move, so lookup needs no lock.
+#define FE_INTERN_PAGE_BITS 12
+#define FE_INTERN_PAGE_SIZE (1 << FE_INTERN_PAGE_BITS)
+#define FE_INTERN_PAGES 1024 //4M strings per shard.
+#define FE_INTERN_BLOCK_SIZE 65536
+#define FE_INTERN_INITIAL_SLOTS 1024
+
+struct FE_StringInterner::Shard {
+    pthread_mutex_t lock;
+    /** Text of each local id. Local ids start at 1. */
+    FE_StringRef *pages[FE_INTERN_PAGES];
+    unsigned int count;
+    /** Open addressing hash table of local ids (0 for a free slot), with the
+     * hash of each next to it to skip most string compares. */
+    unsigned int *slots;
+    unsigned int *hashes;
+    unsigned int capacity;
+    /** String text, packed into blocks. */
+    vector<char *> blocks;
+    char *free_space;
+    size_t free_left;
+    size_t bytes;
+};
+
+FE_StringInterner::FE_StringInterner() {
+    shards = new Shard[FE_INTERN_SHARDS];
+    for (int i = 0 ; i < FE_INTERN_SHARDS ; i++) {
+        Shard &shard = shards[i];
+        pthread_mutex_init(&(shard.lock), NULL);
+        memset(shard.pages, 0, sizeof(shard.pages));
+        shard.count = 0;
+        shard.capacity = FE_INTERN_INITIAL_SLOTS;
+        shard.slots = (unsigned int *)calloc(shard.capacity, sizeof(unsigned int));
+        shard.hashes = (unsigned int *)calloc(shard.capacity, sizeof(unsigned int));
+        shard.free_space = NULL;
+        shard.free_left = 0;
+        shard.bytes = 0;
+    }
+}
+
+FE_StringInterner::~FE_StringInterner() {
+    for (int i = 0 ; i < FE_INTERN_SHARDS ; i++) {
+        Shard &shard = shards[i];
+        for (int p = 0 ; p < FE_INTERN_PAGES ; p++)
+            delete [] shard.pages[p];
+        for (size_t b = 0 ; b < shard.blocks.size() ; b++)
+            free(shard.blocks[b]);
+        free(shard.slots);
+        free(shard.hashes);
+        pthread_mutex_destroy(&(shard.lock));
+    }
+    delete [] shards;
+}
+
+//Stores a null terminated copy of s in the blocks of shard.
+static const char *store_text(FE_StringInterner::Shard &shard, const char *s, size_t len) {
+    char *text;
+    if (len + 1 > FE_INTERN_BLOCK_SIZE / 16) {
+        //Big strings get their own block, so they do not waste a shared one.
+        text = (char *)malloc(len + 1);
+        shard.blocks.push_back(text);
+        shard.bytes += len + 1;
+    } else {
+        if (shard.free_left < len + 1) {
+            shard.free_space = (char *)malloc(FE_INTERN_BLOCK_SIZE);
+            shard.free_left = FE_INTERN_BLOCK_SIZE;
+            shard.blocks.push_back(shard.free_space);
+            shard.bytes += FE_INTERN_BLOCK_SIZE;
+        }
+        text = shard.free_space;
+        shard.free_space += len + 1;
+        shard.free_left -= len + 1;
+    }
+    memcpy(text, s, len);
+    text[len] = 0;
+    return text;
+}
+
+static void grow(FE_StringInterner::Shard &shard) {
+    unsigned int capacity = shard.capacity * 2;
+    unsigned int mask = capacity - 1;
+    unsigned int *slots = (unsigned int *)calloc(capacity, sizeof(unsigned int));
+    unsigned int *hashes = (unsigned int *)calloc(capacity, sizeof(unsigned int));
+
+    for (unsigned int i = 0 ; i < shard.capacity ; i++) {
+        if (!shard.slots[i])
+            continue;
+        unsigned int j = (shard.hashes[i] >> FE_INTERN_SHARD_BITS) & mask;
+        while (slots[j])
+            j = (j + 1) & mask;
+        slots[j] = shard.slots[i];
+        hashes[j] = shard.hashes[i];
+    }
+
+    free(shard.slots);
+    free(shard.hashes);
+    shard.slots = slots;
+    shard.hashes = hashes;
+    shard.capacity = capacity;
+}
+
+static inline FE_StringRef &entry(FE_StringInterner::Shard &shard, unsigned int local) {
+    return shard.pages[local >> FE_INTERN_PAGE_BITS][local & (FE_INTERN_PAGE_SIZE - 1)];
+}
+
+//Slot of s in the table, or of the free slot where it belongs. Call with
+//the lock held.
+static unsigned int find_slot(FE_StringInterner::Shard &shard, unsigned int h,
+                              const char *s, size_t len) {
+    unsigned int mask = shard.capacity - 1;
+    unsigned int i = (h >> FE_INTERN_SHARD_BITS) & mask;
+    while (shard.slots[i]) {
+        if (shard.hashes[i] == h) {
+            const FE_StringRef &text = entry(shard, shard.slots[i]);
+            if ((text.length == len) && !memcmp(text.data, s, len))
+                break;
+        }
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+FE_symbol FE_StringInterner::intern(const char *s, size_t len) {
+    if (len == 0)
+        return 0;
+
+    unsigned int h = FE_hash_fnv1a(s, len);
+    unsigned int shard_index = h & (FE_INTERN_SHARDS - 1);
+    Shard &shard = shards[shard_index];
+
+    pthread_mutex_lock(&(shard.lock));
+    unsigned int i = find_slot(shard, h, s, len);
+    unsigned int local = shard.slots[i];
+    if (!local) {
+        local = shard.count + 1;
+        if ((local >> FE_INTERN_PAGE_BITS) >= FE_INTERN_PAGES) {
+            pthread_mutex_unlock(&(shard.lock));
+            throw new FireEagleException("FE_StringInterner: too many strings",
+                                         FE_INTERNAL_ERROR);
+        }
+        FE_StringRef *&page = shard.pages[local >> FE_INTERN_PAGE_BITS];
+        if (!page) {
+            page = new FE_StringRef[FE_INTERN_PAGE_SIZE];
+            shard.bytes += FE_INTERN_PAGE_SIZE * sizeof(FE_StringRef);
+        }
+        entry(shard, local) = FE_StringRef(store_text(shard, s, len), len);
+
+        shard.slots[i] = local;
+        shard.hashes[i] = h;
+        shard.count = local;
+        if (shard.count * 4 > shard.capacity * 3)
+            grow(shard);
+    }
+    pthread_mutex_unlock(&(shard.lock));
+
+    return (local << FE_INTERN_SHARD_BITS) | shard_index;
+}
+
+FE_symbol FE_StringInterner::intern(const string &s) {
+    return intern(s.data(), s.length());
+}
+
+FE_symbol FE_StringInterner::find(const char *s, size_t len) const {
+    if (len == 0)
+        return 0;
+
+    unsigned int h = FE_hash_fnv1a(s, len);
+    unsigned int shard_index = h & (FE_INTERN_SHARDS - 1);
+    Shard &shard = shards[shard_index];
+
+    pthread_mutex_lock(&(shard.lock));
+    unsigned int local = shard.slots[find_slot(shard, h, s, len)];
+    pthread_mutex_unlock(&(shard.lock));
+
+    return (local) ? ((local << FE_INTERN_SHARD_BITS) | shard_index) : FE_NO_SYMBOL;
+}
+
+FE_StringRef FE_StringInterner::lookup(FE_symbol symbol) const {
+    if (symbol == 0)
+        return FE_StringRef("", 0);
+    return entry(shards[symbol & (FE_INTERN_SHARDS - 1)], symbol >> FE_INTERN_SHARD_BITS);
+}
+
+size_t FE_StringInterner::size() const {
+    size_t total = 0;
+    for (int i = 0 ; i < FE_INTERN_SHARDS ; i++) {
+        pthread_mutex_lock(&(shards[i].lock));
+        total += shards[i].count;
+        pthread_mutex_unlock(&(shards[i].lock));
+    }
+    return total;
+}
+
+size_t FE_StringInterner::memory_used() const {
+    size_t total = sizeof(*this) + FE_INTERN_SHARDS * sizeof(Shard);
+    for (int i = 0 ; i < FE_INTERN_SHARDS ; i++) {
+        pthread_mutex_lock(&(shards[i].lock));
+        total += shards[i].bytes + 2 * shards[i].capacity * sizeof(unsigned int);
+        pthread_mutex_unlock(&(shards[i].lock));
+    }
+    return total;
+}
+
+FE_StringInterner &FE_interner() {
+    static FE_StringInterner interner;
+    return interner;
+}
+
+#define FE_DICTIONARY_INITIAL_SLOTS 64
+
+FE_StringDictionary::FE_StringDictionary() {
+    clear();
+}
+
+//Slot of s in the table, or of the free slot where it belongs.
+unsigned int FE_StringDictionary::find_slot(unsigned int h, const char *s, size_t len) const {
+    unsigned int mask = slots.size() - 1;
+    unsigned int i = h & mask;
+    while (slots[i]) {
+        if (hashes[i] == h) {
+            unsigned int symbol = slots[i];
+            if ((offsets[symbol + 1] - offsets[symbol] - 1 == len)
+                && !memcmp(text.data() + offsets[symbol], s, len))
+                break;
+        }
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+void FE_StringDictionary::grow() {
+    size_t capacity = slots.size() * 2;
+    unsigned int mask = capacity - 1;
+    vector<unsigned int> grown_slots(capacity, 0);
+    vector<unsigned int> grown_hashes(capacity, 0);
+    for (size_t i = 0 ; i < slots.size() ; i++) {
+        if (!slots[i])
+            continue;
+        unsigned int j = hashes[i] & mask;
+        while (grown_slots[j])
+            j = (j + 1) & mask;
+        grown_slots[j] = slots[i];
+        grown_hashes[j] = hashes[i];
+    }
+    slots.swap(grown_slots);
+    hashes.swap(grown_hashes);
+}
+
+FE_symbol FE_StringDictionary::intern(const char *s, size_t len) {
+    if (len == 0)
+        return 0;
+
+    unsigned int h = FE_hash_fnv1a(s, len);
+    unsigned int i = find_slot(h, s, len);
+    if (slots[i])
+        return slots[i];
+
+    if (text.size() + len + 1 > 0xffffffffU)
+        throw new FireEagleException("FE_StringDictionary: too much text", FE_INTERNAL_ERROR);
+    FE_symbol symbol = offsets.size() - 1;
+    text.append(s, len);
+    text.push_back('\0');
+    offsets.push_back(text.size());
+    slots[i] = symbol;
+    hashes[i] = h;
+    if (size() * 4 > slots.size() * 3)
+        grow();
+    return symbol;
+}
+
+FE_symbol FE_StringDictionary::intern(const string &s) {
+    return intern(s.data(), s.length());
+}
+
+FE_symbol FE_StringDictionary::find(const char *s, size_t len) const {
+    if (len == 0)
+        return 0;
+    unsigned int symbol = slots[find_slot(FE_hash_fnv1a(s, len), s, len)];
+    return (symbol) ? symbol : FE_NO_SYMBOL;
+}
+
+FE_StringRef FE_StringDictionary::lookup(FE_symbol symbol) const {
+    return FE_StringRef(text.data() + offsets[symbol],
+                        offsets[symbol + 1] - offsets[symbol] - 1);
+}
+
+size_t FE_StringDictionary::size() const {
+    return offsets.size() - 2;
+}
+
+void FE_StringDictionary::clear() {
+    //Swap with empty containers: clear() alone keeps the memory.
+    string().swap(text);
+    vector<unsigned int>().swap(offsets);
+    vector<unsigned int>(FE_DICTIONARY_INITIAL_SLOTS, 0).swap(slots);
+    vector<unsigned int>(FE_DICTIONARY_INITIAL_SLOTS, 0).swap(hashes);
+    text.push_back('\0');
+    offsets.push_back(0);
+    offsets.push_back(1);
+}
+
+size_t FE_StringDictionary::memory_used() const {
+    return sizeof(*this) + text.capacity()
+        + (offsets.capacity() + slots.capacity() + hashes.capacity()) * sizeof(unsigned int);
+}
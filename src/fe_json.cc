@@ -0,0 +1,375 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#include <string>
+#include <sstream>
+
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fe_json.h"
+#include "fe_numeric.h"
+#include "fireeagle.h"
+
+/** Bytes collected before they are written to a file descriptor. */
+#define FE_JSON_FLUSH_SIZE 65536
+
+/** Escapes for the control characters, by character: 'u' for \u00XX. */
+static const char control_escapes[32] = {
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u'
+};
+
+static const char hex_digits[] = "0123456789abcdef";
+
+FE_JsonWriter::FE_JsonWriter(enum FE_json_mode _mode)
+    : buffer(NULL), length(0), capacity(0), fd(-1), mode(_mode), _records(0) {
+}
+
+FE_JsonWriter::FE_JsonWriter(int _fd, enum FE_json_mode _mode)
+    : buffer(NULL), length(0), capacity(0), fd(_fd), mode(_mode), _records(0) {
+}
+
+FE_JsonWriter::~FE_JsonWriter() {
+    if (fd >= 0) {
+        try {
+            flush();
+        } catch (FireEagleException *e) {
+            delete e;
+        }
+    }
+    free(buffer);
+}
+
+void FE_JsonWriter::reserve(size_t more) {
+    if (length + more <= capacity)
+        return;
+    size_t grown = capacity ? capacity * 2 : 4096;
+    while (grown < length + more)
+        grown *= 2;
+    char *p = (char *)realloc(buffer, grown);
+    if (!p)
+        throw new FireEagleException("FE_JsonWriter: Out of memory", FE_INTERNAL_ERROR);
+    buffer = p;
+    capacity = grown;
+}
+
+inline void FE_JsonWriter::put(char c) {
+    if (length == capacity)
+        reserve(1);
+    buffer[length++] = c;
+}
+
+inline void FE_JsonWriter::put(const char *s, size_t len) {
+    reserve(len);
+    memcpy(buffer + length, s, len);
+    length += len;
+}
+
+void FE_JsonWriter::put_key(const char *key) {
+    put('"');
+    put(key, strlen(key));
+    put("\":", 2);
+}
+
+void FE_JsonWriter::put_string(const string &s) {
+    const char *p = s.data();
+    const char *end = p + s.size();
+    // Worst case, every byte becomes \u00XX.
+    reserve(s.size() * 6 + 2);
+    char *out = buffer + length;
+    *out++ = '"';
+    while (p < end) {
+        // Copy the run of characters that need no escape in one go.
+        const char *run = p;
+        while (p < end && (unsigned char)*p >= 0x20 && *p != '"' && *p != '\\')
+            p++;
+        memcpy(out, run, p - run);
+        out += p - run;
+        if (p == end)
+            break;
+        unsigned char c = (unsigned char)*p++;
+        *out++ = '\\';
+        if (c == '"' || c == '\\') {
+            *out++ = c;
+        } else if (control_escapes[c] != 'u') {
+            *out++ = control_escapes[c];
+        } else {
+            *out++ = 'u';
+            *out++ = '0';
+            *out++ = '0';
+            *out++ = hex_digits[c >> 4];
+            *out++ = hex_digits[c & 15];
+        }
+    }
+    *out++ = '"';
+    length = out - buffer;
+}
+
+void FE_JsonWriter::put_bool(bool value) {
+    if (value)
+        put("true", 4);
+    else
+        put("false", 5);
+}
+
+void FE_JsonWriter::put_number(double value) {
+    if (isnan(value) || isinf(value)) {
+        put("null", 4);
+        return;
+    }
+    reserve(FE_DOUBLE_CHARS);
+    length += FE_format_double(value, buffer + length);
+}
+
+void FE_JsonWriter::put_integer(long long value) {
+    char digits[24];
+    char *p = digits + sizeof(digits);
+    unsigned long long u = value < 0 ? 0ULL - (unsigned long long)value
+                                     : (unsigned long long)value;
+    do {
+        *--p = (char)('0' + u % 10);
+        u /= 10;
+    } while (u);
+    if (value < 0)
+        *--p = '-';
+    put(p, digits + sizeof(digits) - p);
+}
+
+void FE_JsonWriter::put_uint(unsigned int value) {
+    if (value == UINT_MAX)
+        put("null", 4);
+    else
+        put_integer(value);
+}
+
+void FE_JsonWriter::put_lonlat(double lat, double lon) {
+    put('[');
+    put_number(lon);
+    put(',');
+    put_number(lat);
+    put(']');
+}
+
+void FE_JsonWriter::put_geometry(const FE_geometry &geometry) {
+    switch (geometry.type) {
+    case FEGeo_POINT:
+        put("{\"type\":\"Point\",\"coordinates\":", 30);
+        put_lonlat(geometry.latitude, geometry.longitude);
+        put('}');
+        return;
+    case FEGeo_BOX:
+    case FEGeo_POLYGON:
+        break;
+    default:
+        put("null", 4);
+        return;
+    }
+
+    put("{\"type\":\"Polygon\",\"bbox\":[", 26);
+    put_number(geometry.min_lon);
+    put(',');
+    put_number(geometry.min_lat);
+    put(',');
+    put_number(geometry.max_lon);
+    put(',');
+    put_number(geometry.max_lat);
+    put("],\"coordinates\":[[", 18);
+    if (geometry.type == FEGeo_BOX) {
+        // Counterclockwise, as GeoJSON wants exterior rings.
+        put_lonlat(geometry.min_lat, geometry.min_lon);
+        put(',');
+        put_lonlat(geometry.min_lat, geometry.max_lon);
+        put(',');
+        put_lonlat(geometry.max_lat, geometry.max_lon);
+        put(',');
+        put_lonlat(geometry.max_lat, geometry.min_lon);
+        put(',');
+        put_lonlat(geometry.min_lat, geometry.min_lon);
+    } else {
+        unsigned int n = geometry.vertex_count();
+        for (unsigned int i = 0 ; i < n ; i++) {
+            const double *latlon = geometry.vertex(i);
+            if (i)
+                put(',');
+            put_lonlat(latlon[0], latlon[1]);
+        }
+        // GeoJSON rings end where they start.
+        if (n) {
+            const double *first = geometry.vertex(0);
+            const double *last = geometry.vertex(n - 1);
+            if (first[0] != last[0] || first[1] != last[1]) {
+                put(',');
+                put_lonlat(first[0], first[1]);
+            }
+        }
+    }
+    put("]]}", 3);
+}
+
+void FE_JsonWriter::put_location(const FE_location &location) {
+    put("{\"best_guess\":", 14);
+    put_bool(location.best_guess);
+    put(',');
+    put_key("label");
+    put_string(location.label);
+    put(',');
+    put_key("level");
+    put_uint(location.level);
+    put(',');
+    put_key("level_name");
+    put_string(location.level_name);
+    put(',');
+    put_key("located_at");
+    put_string(location.timestamp);
+    put(',');
+    put_key("located_at_ms");
+    if (location.timestamp_ms)
+        put_integer(location.timestamp_ms);
+    else
+        put("null", 4);
+    put(',');
+    put_key("name");
+    put_string(location.full_location);
+    put(',');
+    put_key("normal_name");
+    put_string(location.place_name);
+    put(',');
+    put_key("place_id");
+    put_string(location.place_id);
+    put(',');
+    put_key("place_id_exact");
+    put_bool(location.is_place_id_exact);
+    put(',');
+    put_key("woeid");
+    put_uint(location.woeid);
+    put(',');
+    put_key("woeid_exact");
+    put_bool(location.is_woeid_exact);
+    put(',');
+    put_key("geometry");
+    put_geometry(location.geometry);
+    put('}');
+}
+
+void FE_JsonWriter::put_user(const FE_user &user) {
+    put("{\"token\":", 9);
+    put_string(user.token);
+    put(',');
+    put_key("readable");
+    put_bool(user.can_read);
+    put(',');
+    put_key("writable");
+    put_bool(user.can_write);
+    put(',');
+    put_key("located_at");
+    put_string(user.last_update_timestamp);
+    put(',');
+    put_key("located_at_ms");
+    if (user.last_update_ms)
+        put_integer(user.last_update_ms);
+    else
+        put("null", 4);
+    put(',');
+    put_key("timezone");
+    put_string(user.timezone);
+    put(',');
+    put_key("woeid_hierarchy");
+    put_string(user.woeid_hierarchy);
+    put(',');
+    put_key("location_hierarchy");
+    put('[');
+    for (FE_LocationLevels::const_iterator iter = user.location.begin() ;
+         iter != user.location.end() ; iter++) {
+        if (iter != user.location.begin())
+            put(',');
+        put_location(*iter);
+    }
+    put("]}", 2);
+}
+
+void FE_JsonWriter::begin_record() {
+    if (mode == FE_JSON_ARRAY)
+        put(_records ? ',' : '[');
+}
+
+void FE_JsonWriter::end_record() {
+    if (mode == FE_JSON_LINES)
+        put('\n');
+    _records++;
+    if (fd >= 0 && length >= FE_JSON_FLUSH_SIZE)
+        flush();
+}
+
+void FE_JsonWriter::write(const FE_user &user) {
+    begin_record();
+    put_user(user);
+    end_record();
+}
+
+void FE_JsonWriter::write(const FE_location &location) {
+    begin_record();
+    put_location(location);
+    end_record();
+}
+
+void FE_JsonWriter::write(const FE_geometry &geometry) {
+    begin_record();
+    put_geometry(geometry);
+    end_record();
+}
+
+void FE_JsonWriter::finish() {
+    if (mode == FE_JSON_ARRAY) {
+        if (!_records)
+            put('[');
+        put("]\n", 2);
+    }
+    flush();
+}
+
+void FE_JsonWriter::flush() {
+    if (fd < 0)
+        return;
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = ::write(fd, buffer + done, length - done);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            int error = errno;
+            // Keep what was not written, so a caller may retry.
+            memmove(buffer, buffer + done, length - done);
+            length -= done;
+            ostringstream os;
+            os << "FE_JsonWriter: Could not write JSON output (" << strerror(error) << ")";
+            throw new FireEagleException(os.str(), FE_INTERNAL_ERROR);
+        }
+        done += n;
+    }
+    length = 0;
+}
+
+const char *FE_JsonWriter::data() const {
+    return buffer;
+}
+
+size_t FE_JsonWriter::size() const {
+    return length;
+}
+
+void FE_JsonWriter::clear() {
+    length = 0;
+    _records = 0;
+}
+
+size_t FE_JsonWriter::records() const {
+    return _records;
+}
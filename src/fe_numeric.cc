@@ -0,0 +1,416 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#include <string>
+
+#include <limits.h>
+#include <math.h>
+#include <locale.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "fe_numeric.h"
+
+using namespace std;
+
+bool FE_parse_long(const char *s, size_t len, long *value) {
+    const char *p = s;
+    const char *end = s + len;
+    bool negative = false;
+
+    if ((p < end) && ((*p == '-') || (*p == '+'))) {
+        negative = (*p == '-');
+        p++;
+    }
+    if (p == end)
+        return false;
+
+    unsigned long limit = (negative) ? (unsigned long)LONG_MAX + 1 : LONG_MAX;
+    unsigned long val = 0;
+    for ( ; p < end ; p++) {
+        if ((*p < '0') || (*p > '9'))
+            return false;
+        unsigned int digit = *p - '0';
+        if (val > (limit - digit) / 10)
+            return false;
+        val = val * 10 + digit;
+    }
+
+    *value = (negative) ? (long)(0 - val) : (long)val;
+    return true;
+}
+
+//Powers of ten that are exact in a double.
+static const double exact_powers[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static bool parse_double_slow(const char *s, size_t len, double *value) {
+    static locale_t c_locale = newlocale(LC_ALL_MASK, "C", (locale_t)0);
+
+    char buffer[64];
+    string copy;
+    const char *str = buffer;
+    if (len < sizeof(buffer)) {
+        memcpy(buffer, s, len);
+        buffer[len] = 0;
+    } else {
+        copy.assign(s, len);
+        str = copy.c_str();
+    }
+
+    char *e;
+    double val = strtod_l(str, &e, c_locale);
+    if (e != str + len)
+        return false;
+    *value = val;
+    return true;
+}
+
+//Digits of value, most significant first. Returns the count.
+static size_t format_digits(unsigned long long value, char *out) {
+    char digits[20];
+    size_t n = 0;
+    do {
+        digits[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+    for (size_t i = 0 ; i < n ; i++)
+        out[i] = digits[n - 1 - i];
+    return n;
+}
+
+size_t FE_format_double(double value, char *out) {
+    static locale_t c_locale = newlocale(LC_ALL_MASK, "C", (locale_t)0);
+
+    if (value != value) {
+        memcpy(out, "nan", 3);
+        return 3;
+    }
+    if ((value > 1.7976931348623157e308) || (value < -1.7976931348623157e308)) {
+        if (value < 0) {
+            memcpy(out, "-inf", 4);
+            return 4;
+        }
+        memcpy(out, "inf", 3);
+        return 3;
+    }
+
+    size_t n = 0;
+    if ((value < 0) || ((value == 0) && signbit(value)))
+        out[n++] = '-';
+    double magnitude = (value < 0) ? -value : value;
+
+    //The fewest decimals that give value back. q / 10^p is correctly
+    //rounded as long as q is exact, so the check is exact too.
+    if (magnitude < 1e9) {
+        for (int p = 0 ; p <= 9 ; p++) {
+            double scaled = magnitude * exact_powers[p];
+            if (scaled >= 9007199254740992.0) //2^53
+                break;
+            unsigned long long q = (unsigned long long)(scaled + 0.5);
+            if ((double)q / exact_powers[p] != magnitude)
+                continue;
+
+            unsigned long long unit = (unsigned long long)exact_powers[p];
+            n += format_digits(q / unit, out + n);
+            if (p) {
+                out[n++] = '.';
+                unsigned long long fraction = q % unit;
+                for (int i = p - 1 ; i >= 0 ; i--) {
+                    out[n + i] = (char)('0' + fraction % 10);
+                    fraction /= 10;
+                }
+                n += p;
+            }
+            return n;
+        }
+    }
+
+    //17 significant digits always give the value back; fewer often do.
+    locale_t previous = uselocale(c_locale);
+    char buffer[FE_DOUBLE_CHARS];
+    int len = 0;
+    for (int precision = 15 ; precision <= 17 ; precision++) {
+        len = snprintf(buffer, sizeof(buffer), "%.*g", precision, magnitude);
+        if (strtod_l(buffer, NULL, c_locale) == magnitude)
+            break;
+    }
+    uselocale(previous);
+    memcpy(out + n, buffer, len);
+    return n + len;
+}
+
+bool FE_parse_double(const char *s, size_t len, double *value) {
+    const char *p = s;
+    const char *end = s + len;
+    bool negative = false;
+
+    if ((p < end) && ((*p == '-') || (*p == '+'))) {
+        negative = (*p == '-');
+        p++;
+    }
+
+    unsigned long long mantissa = 0;
+    int significant = 0; //Digits in mantissa, not counting leading zeroes.
+    bool truncated = false;
+    bool any_digit = false;
+    int exponent = 0;
+
+    for ( ; (p < end) && (*p >= '0') && (*p <= '9') ; p++) {
+        any_digit = true;
+        if (significant < 19) {
+            mantissa = mantissa * 10 + (*p - '0');
+            if (mantissa)
+                significant++;
+        } else {
+            exponent++;
+            truncated |= (*p != '0');
+        }
+    }
+    if ((p < end) && (*p == '.')) {
+        for (p++ ; (p < end) && (*p >= '0') && (*p <= '9') ; p++) {
+            any_digit = true;
+            if (significant < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa)
+                    significant++;
+                exponent--;
+            } else {
+                truncated |= (*p != '0');
+            }
+        }
+    }
+    if (!any_digit)
+        return false;
+
+    if ((p < end) && ((*p == 'e') || (*p == 'E'))) {
+        p++;
+        bool negative_exp = false;
+        if ((p < end) && ((*p == '-') || (*p == '+'))) {
+            negative_exp = (*p == '-');
+            p++;
+        }
+        if ((p == end) || (*p < '0') || (*p > '9'))
+            return false;
+        int exp = 0;
+        for ( ; (p < end) && (*p >= '0') && (*p <= '9') ; p++) {
+            if (exp < 100000)
+                exp = exp * 10 + (*p - '0');
+        }
+        exponent += (negative_exp) ? -exp : exp;
+    }
+    if (p != end)
+        return false;
+
+    if (mantissa == 0) {
+        *value = (negative) ? -0.0 : 0.0;
+        return true;
+    }
+
+    //Both the mantissa and the power of ten are exact, so one IEEE operation
+    //gives the correctly rounded result.
+    if (!truncated && (mantissa <= (1ULL << 53)) && (exponent >= -22) && (exponent <= 22)) {
+        double val = (double)mantissa;
+        if (exponent < 0)
+            val /= exact_powers[-exponent];
+        else
+            val *= exact_powers[exponent];
+        *value = (negative) ? -val : val;
+        return true;
+    }
+
+    return parse_double_slow(s, len, value);
+}
+
+//Days since 1970-01-01 of a date in the proleptic Gregorian calendar.
+static long long days_from_civil(int y, unsigned int m, unsigned int d) {
+    y -= (m <= 2);
+    int era = ((y >= 0) ? y : y - 399) / 400;
+    unsigned int yoe = (unsigned int)(y - era * 400);
+    unsigned int doy = (153 * (m + ((m > 2) ? -3 : 9)) + 2) / 5 + d - 1;
+    unsigned int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return (long long)era * 146097 + (long long)doe - 719468;
+}
+
+static void civil_from_days(long long z, int *y, unsigned int *m, unsigned int *d) {
+    z += 719468;
+    long long era = ((z >= 0) ? z : z - 146096) / 146097;
+    unsigned int doe = (unsigned int)(z - era * 146097);
+    unsigned int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    unsigned int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    unsigned int mp = (5 * doy + 2) / 153;
+    *d = doy - (153 * mp + 2) / 5 + 1;
+    *m = (mp < 10) ? mp + 3 : mp - 9;
+    *y = (int)(yoe + era * 400) + (*m <= 2);
+}
+
+static inline bool is_leap(int y) {
+    return ((y % 4) == 0) && (((y % 100) != 0) || ((y % 400) == 0));
+}
+
+//Reads n digits at p. Returns false if any is not a digit.
+static inline bool read_digits(const char *p, int n, unsigned int *value) {
+    unsigned int v = 0;
+    for (int i = 0 ; i < n ; i++) {
+        unsigned int digit = (unsigned char)p[i] - '0';
+        if (digit > 9)
+            return false;
+        v = v * 10 + digit;
+    }
+    *value = v;
+    return true;
+}
+
+bool FE_parse_timestamp(const char *s, size_t len, long long *epoch_ms, int *offset_minutes) {
+    static const unsigned char month_days[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    unsigned int year, month, day, hour, minute, second;
+
+    //YYYY-MM-DDTHH:MM:SS is 19 characters, and the zone at least one more.
+    if ((len < 20) || (s[4] != '-') || (s[7] != '-') || ((s[10] != 'T') && (s[10] != 't'))
+        || (s[13] != ':') || (s[16] != ':'))
+        return false;
+    if (!read_digits(s, 4, &year) || !read_digits(s + 5, 2, &month)
+        || !read_digits(s + 8, 2, &day) || !read_digits(s + 11, 2, &hour)
+        || !read_digits(s + 14, 2, &minute) || !read_digits(s + 17, 2, &second))
+        return false;
+    if ((month < 1) || (month > 12) || (day < 1) || (hour > 23) || (minute > 59)
+        || (second > 60))
+        return false;
+    unsigned int days_in_month = month_days[month - 1];
+    if ((month == 2) && is_leap(year))
+        days_in_month++;
+    if (day > days_in_month)
+        return false;
+
+    const char *p = s + 19;
+    const char *end = s + len;
+    unsigned int millis = 0;
+    if (*p == '.') {
+        int digits = 0;
+        for (p++ ; (p < end) && (*p >= '0') && (*p <= '9') ; p++, digits++) {
+            if (digits < 3)
+                millis = millis * 10 + (*p - '0');
+        }
+        if (digits == 0)
+            return false;
+        for ( ; digits < 3 ; digits++)
+            millis *= 10;
+    }
+
+    int offset = 0;
+    if ((p < end) && ((*p == 'Z') || (*p == 'z'))) {
+        p++;
+    } else if ((p < end) && ((*p == '+') || (*p == '-'))) {
+        unsigned int oh, om;
+        bool colon = (end - p >= 6) && (p[3] == ':');
+        if ((end - p < ((colon) ? 6 : 5)) || !read_digits(p + 1, 2, &oh)
+            || !read_digits(p + ((colon) ? 4 : 3), 2, &om) || (oh > 23) || (om > 59))
+            return false;
+        offset = oh * 60 + om;
+        if (*p == '-')
+            offset = -offset;
+        p += (colon) ? 6 : 5;
+    } else {
+        return false;
+    }
+    if (p != end)
+        return false;
+
+    long long seconds = days_from_civil(year, month, day) * 86400LL
+        + hour * 3600 + minute * 60 + second - offset * 60LL;
+    *epoch_ms = seconds * 1000 + millis;
+    if (offset_minutes)
+        *offset_minutes = offset;
+    return true;
+}
+
+string FE_format_timestamp(long long epoch_ms, int offset_minutes) {
+    long long local = ((epoch_ms >= 0) ? epoch_ms / 1000 : (epoch_ms - 999) / 1000)
+        + offset_minutes * 60LL;
+    long long days = (local >= 0) ? local / 86400 : (local - 86399) / 86400;
+    unsigned int secs = (unsigned int)(local - days * 86400);
+    int y;
+    unsigned int m, d;
+    civil_from_days(days, &y, &m, &d);
+
+    unsigned int offset = (offset_minutes < 0) ? -offset_minutes : offset_minutes;
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%04d-%02u-%02uT%02u:%02u:%02u%c%02u:%02u",
+             y, m, d, secs / 3600, (secs / 60) % 60, secs % 60,
+             (offset_minutes < 0) ? '-' : '+', offset / 60, offset % 60);
+    return string(buffer);
+}
+
+#define FE_VALUE_LONG 1
+#define FE_VALUE_DOUBLE 2
+#define FE_VALUE_BOOL 4
+
+static void trim(const string &text, const char **begin, size_t *len) {
+    const char *b = text.data();
+    const char *e = b + text.length();
+    while ((b < e) && ((*b == ' ') || (*b == '\t') || (*b == '\n') || (*b == '\r')))
+        b++;
+    while ((e > b) && ((e[-1] == ' ') || (e[-1] == '\t') || (e[-1] == '\n') || (e[-1] == '\r')))
+        e--;
+    *begin = b;
+    *len = e - b;
+}
+
+FE_ValueCache::FE_ValueCache() : parsed(0), failed(0), long_value(0),
+                                 double_value(0), bool_value(false) {}
+
+void FE_ValueCache::clear() {
+    parsed = 0;
+    failed = 0;
+}
+
+long FE_ValueCache::as_long(const string &text, bool *error) const {
+    if (!(parsed & FE_VALUE_LONG)) {
+        const char *b;
+        size_t len;
+        trim(text, &b, &len);
+        long_value = 0;
+        if (!FE_parse_long(b, len, &long_value))
+            failed |= FE_VALUE_LONG;
+        parsed |= FE_VALUE_LONG;
+    }
+    if (error)
+        *error = (failed & FE_VALUE_LONG) != 0;
+    return long_value;
+}
+
+double FE_ValueCache::as_double(const string &text, bool *error) const {
+    if (!(parsed & FE_VALUE_DOUBLE)) {
+        const char *b;
+        size_t len;
+        trim(text, &b, &len);
+        double_value = 0;
+        if (!FE_parse_double(b, len, &double_value))
+            failed |= FE_VALUE_DOUBLE;
+        parsed |= FE_VALUE_DOUBLE;
+    }
+    if (error)
+        *error = (failed & FE_VALUE_DOUBLE) != 0;
+    return double_value;
+}
+
+bool FE_ValueCache::as_bool(const string &text, bool *error) const {
+    if (!(parsed & FE_VALUE_BOOL)) {
+        const char *b;
+        size_t len;
+        trim(text, &b, &len);
+        bool_value = ((len == 4) && !memcmp(b, "true", 4));
+        if (!bool_value && !((len == 5) && !memcmp(b, "false", 5)))
+            failed |= FE_VALUE_BOOL;
+        parsed |= FE_VALUE_BOOL;
+    }
+    if (error)
+        *error = (failed & FE_VALUE_BOOL) != 0;
+    return bool_value;
+}
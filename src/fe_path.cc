@@ -0,0 +1,332 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#include <string>
+#include <vector>
+
+#include <string.h>
+
+#include "fe_path.h"
+#include "fireeagle.h" //For FireEagleException
+
+using namespace std;
+
+static void syntax_error(const string &expr, const char *what) {
+    string message("Invalid path expression '");
+    message.append(expr).append("': ").append(what);
+    throw new FireEagleException(message, FE_INTERNAL_ERROR);
+}
+
+static inline bool equals(const FE_StringRef &ref, const string &str) {
+    return (ref.length == str.length()) && !memcmp(ref.data, str.data(), ref.length);
+}
+
+FE_PathQuery::FE_PathQuery(const string &expr) : expression(expr) {
+    compile();
+}
+
+const string &FE_PathQuery::source() const { return expression; }
+
+void FE_PathQuery::compile() {
+    const string &e = expression;
+    size_t pos = (e.length() && (e[0] == '/')) ? 1 : 0;
+
+    target = FE_PATH_NODE;
+    while (true) {
+        //A step runs up to the next '/' outside of brackets and quotes.
+        size_t end = pos;
+        int brackets = 0;
+        char quote = 0;
+        for ( ; end < e.length() ; end++) {
+            char c = e[end];
+            if (quote) {
+                if (c == quote)
+                    quote = 0;
+            } else if ((brackets > 0) && ((c == '\'') || (c == '"'))) {
+                quote = c;
+            } else if (c == '[') {
+                brackets++;
+            } else if (c == ']') {
+                brackets--;
+            } else if ((c == '/') && (brackets == 0)) {
+                break;
+            }
+        }
+        if (quote || brackets)
+            syntax_error(e, "unbalanced brackets or quotes");
+        if (end == pos)
+            syntax_error(e, "empty step");
+
+        string text = e.substr(pos, end - pos);
+        bool last = (end == e.length());
+
+        if ((text == "text()") || (text[0] == '@')) {
+            if (!last || steps.empty())
+                syntax_error(e, "text() and @attribute must be the last step");
+            if (text[0] == '@') {
+                if (text.length() == 1)
+                    syntax_error(e, "missing attribute name");
+                target = FE_PATH_ATTRIBUTE;
+                target_attribute = text.substr(1);
+            } else {
+                target = FE_PATH_TEXT;
+            }
+            break;
+        }
+
+        Step step;
+        size_t bracket = text.find('[');
+        step.name = text.substr(0, bracket);
+        if (step.name.empty())
+            syntax_error(e, "missing node name");
+        step.any = (step.name == "*");
+        step.id = FE_lookup_node_id(step.name.data(), step.name.length());
+        step.position = 0;
+
+        while (bracket != string::npos) {
+            if (step.position)
+                syntax_error(e, "a position must be the last predicate of a step");
+
+            size_t close = bracket + 1;
+            quote = 0;
+            for ( ; close < text.length() ; close++) {
+                if (quote) {
+                    if (text[close] == quote)
+                        quote = 0;
+                } else if ((text[close] == '\'') || (text[close] == '"')) {
+                    quote = text[close];
+                } else if (text[close] == ']') {
+                    break;
+                }
+            }
+            string pred = text.substr(bracket + 1, close - bracket - 1);
+            if (pred.empty())
+                syntax_error(e, "empty predicate");
+
+            if (pred[0] == '@') {
+                Predicate p;
+                size_t eq = pred.find('=');
+                p.attribute = pred.substr(1, eq - 1);
+                p.has_value = (eq != string::npos);
+                if (p.attribute.empty())
+                    syntax_error(e, "missing attribute name in predicate");
+                if (p.has_value) {
+                    p.value = pred.substr(eq + 1);
+                    size_t vlen = p.value.length();
+                    if ((vlen >= 2) && ((p.value[0] == '\'') || (p.value[0] == '"'))
+                        && (p.value[vlen - 1] == p.value[0]))
+                        p.value = p.value.substr(1, vlen - 2);
+                }
+                step.predicates.push_back(p);
+            } else {
+                unsigned long n = 0;
+                for (size_t i = 0 ; i < pred.length() ; i++) {
+                    if ((pred[i] < '0') || (pred[i] > '9') || (n > 100000000))
+                        syntax_error(e, "unsupported predicate");
+                    n = n * 10 + (pred[i] - '0');
+                }
+                if (n == 0)
+                    syntax_error(e, "positions start at 1");
+                step.position = n;
+            }
+
+            bracket = close + 1;
+            if (bracket == text.length())
+                break;
+            if (text[bracket] != '[')
+                syntax_error(e, "junk after predicate");
+        }
+
+        steps.push_back(step);
+        if (last)
+            break;
+        pos = end + 1;
+    }
+}
+
+bool FE_PathQuery::name_matches(const Step &step, const FE_ParsedNode &node) const {
+    return step.any || (node.name() == step.name);
+}
+
+bool FE_PathQuery::predicates_match(const Step &step, const FE_ParsedNode &node) const {
+    for (size_t i = 0 ; i < step.predicates.size() ; i++) {
+        const Predicate &p = step.predicates[i];
+        if (!node.has_property(p.attribute))
+            return false;
+        if (p.has_value && (node.get_string_property(p.attribute) != p.value))
+            return false;
+    }
+    return true;
+}
+
+//Returns false once limit is reached.
+bool FE_PathQuery::walk(const FE_ParsedNode &node, size_t step,
+                        vector<FE_PathMatch> &matches, size_t limit) const {
+    if (step == steps.size()) {
+        FE_PathMatch match;
+        match.node = &node;
+        if (target == FE_PATH_ATTRIBUTE) {
+            if (!node.has_property(target_attribute))
+                return true;
+            match.value = FE_StringRef(node.get_string_property(target_attribute));
+        } else {
+            match.value = FE_StringRef(node.text());
+        }
+        matches.push_back(match);
+        return (limit == 0) || (matches.size() < limit);
+    }
+
+    const Step &s = steps[step];
+    unsigned int seen = 0;
+    if (s.any) {
+        unsigned int count = node.child_count();
+        for (unsigned int i = 0 ; i < count ; i++) {
+            const FE_ParsedNode &child = node.child(i);
+            if (!predicates_match(s, child))
+                continue;
+            seen++;
+            if (s.position && (seen != s.position))
+                continue;
+            if (!walk(child, step + 1, matches, limit))
+                return false;
+            if (s.position)
+                break;
+        }
+    } else {
+        unsigned int cursor = 0;
+        const FE_ParsedNode *child;
+        while ((child = node.next_child(s.name, cursor))) {
+            if (!predicates_match(s, *child))
+                continue;
+            seen++;
+            if (s.position && (seen != s.position))
+                continue;
+            if (!walk(*child, step + 1, matches, limit))
+                return false;
+            if (s.position)
+                break;
+        }
+    }
+    return true;
+}
+
+size_t FE_PathQuery::select(const FE_ParsedNode &root, vector<FE_PathMatch> &matches,
+                            size_t limit) const {
+    matches.clear();
+
+    //The root is the only node at its level, so a position can only be 1.
+    const Step &first = steps[0];
+    if (name_matches(first, root) && predicates_match(first, root)
+        && (first.position <= 1))
+        walk(root, 1, matches, limit);
+
+    return matches.size();
+}
+
+bool FE_PathQuery::select_first(const FE_ParsedNode &root, FE_StringRef &value) const {
+    vector<FE_PathMatch> matches;
+    if (!select(root, matches, 1))
+        return false;
+    value = matches[0].value;
+    return true;
+}
+
+enum FE_event_status FE_PathQuery::scan(FE_Parser &parser, const string &document,
+                                        FE_PathCallback &callback) const {
+    FE_PathMatcher matcher(*this, callback);
+    return parser.parse_events(document, matcher);
+}
+
+FE_PathMatcher::FE_PathMatcher(const FE_PathQuery &_query, FE_PathCallback &_callback)
+    : query(_query), callback(_callback) {
+    seen.resize(query.steps.size());
+    reset();
+}
+
+void FE_PathMatcher::reset() {
+    depth = 0;
+    matched = 0;
+    seen[0] = 0;
+    pending = false;
+    capturing = false;
+    text.clear();
+}
+
+bool FE_PathMatcher::start_node(enum FE_node_id id, const FE_StringRef &name,
+                                const FE_EventAttribute *attrs, unsigned int nattrs) {
+    depth++;
+    if (capturing && (depth == matched + 1)) {
+        //Like FE_XMLNode, a node with children has no text.
+        capturing = false;
+        text.clear();
+    }
+    if ((matched != depth - 1) || (matched == query.steps.size()))
+        return true;
+
+    const FE_PathQuery::Step &step = query.steps[matched];
+    if (!step.any) {
+        if (step.id != FE_NODE_UNKNOWN) {
+            if (id != step.id)
+                return true;
+        } else if (!equals(name, step.name)) {
+            return true;
+        }
+    }
+
+    for (size_t i = 0 ; i < step.predicates.size() ; i++) {
+        const FE_PathQuery::Predicate &p = step.predicates[i];
+        unsigned int j;
+        for (j = 0 ; j < nattrs ; j++) {
+            if (equals(attrs[j].name, p.attribute))
+                break;
+        }
+        if ((j == nattrs) || (p.has_value && !equals(attrs[j].value, p.value)))
+            return true;
+    }
+
+    seen[matched]++;
+    if (step.position && (seen[matched] != step.position))
+        return true;
+
+    matched++;
+    if (matched < query.steps.size()) {
+        seen[matched] = 0;
+        return true;
+    }
+
+    if (query.target == FE_PathQuery::FE_PATH_ATTRIBUTE) {
+        for (unsigned int j = 0 ; j < nattrs ; j++) {
+            if (equals(attrs[j].name, query.target_attribute))
+                return callback.path_match(attrs[j].value);
+        }
+        return true;
+    }
+
+    pending = true;
+    capturing = true;
+    text.clear();
+    return true;
+}
+
+bool FE_PathMatcher::node_text(const FE_StringRef &fragment) {
+    if (capturing && (depth == matched))
+        text.append(fragment.data, fragment.length);
+    return true;
+}
+
+bool FE_PathMatcher::end_node(enum FE_node_id id, const FE_StringRef &name) {
+    bool keep_going = true;
+    if (depth == matched) {
+        if (pending) {
+            pending = false;
+            capturing = false;
+            keep_going = callback.path_match(FE_StringRef(text));
+        }
+        matched--;
+    }
+    depth--;
+    return keep_going;
+}
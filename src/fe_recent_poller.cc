@@ -0,0 +1,176 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#include <string>
+#include <map>
+#include <vector>
+#include <sstream>
+
+#include <string.h>
+#include <pthread.h>
+
+#include "fe_recent_poller.h"
+#include "fe_numeric.h"
+
+using namespace std;
+
+//One 'recent' call, made on the thread calling poll or on a worker.
+struct FE_RecentPoller::Fetch : public FE_PendingCall {
+    FE_RecentPoller *poller;
+    FE_ParamPairs args;
+
+    Fetch(FE_RecentPoller *_poller)
+        : FE_PendingCall("FE_RecentPoller::fetch_page"), poller(_poller) {}
+
+    ~Fetch() {
+        wait();
+    }
+
+    string call() {
+        return poller->fetch_page(args);
+    }
+};
+
+//Decides, for each user of a page, whether it goes to the callback. The
+//tokens seen are only updated on delivery.
+class RecentChangeSink : public FE_ObjectSink {
+  private:
+    const map<string, long long> &last_seen;
+
+  public:
+    vector<FE_user> changed;
+    vector<bool> is_new;
+    size_t seen;
+    long long latest;
+
+    RecentChangeSink(const map<string, long long> &_last_seen)
+        : last_seen(_last_seen), seen(0), latest(0) {}
+
+    bool decoded_user(FE_user &user) {
+        seen++;
+        if (user.last_update_ms > latest)
+            latest = user.last_update_ms;
+        map<string, long long>::const_iterator iter = last_seen.find(user.token);
+        bool found = (iter != last_seen.end());
+        if (found && (user.last_update_ms <= iter->second))
+            return true;
+        changed.push_back(FE_user());
+        changed.back().swap(user);
+        is_new.push_back(!found);
+        return true;
+    }
+};
+
+FE_RecentPoller::FE_RecentPoller(FireEagleConfig *_config, FE_RecentCallback *_callback,
+                                 FE_WorkerPool *_pool, unsigned int _page_size)
+    : config(_config), callback(_callback), pool(_pool), page_size(_page_size),
+      cursor_ms(0) {
+    if (!_config)
+        throw new FireEagleException("NULL pointer for FireEagleConfig", FE_INTERNAL_ERROR);
+    if (!_callback)
+        throw new FireEagleException("NULL pointer for FE_RecentCallback", FE_INTERNAL_ERROR);
+    if (page_size == 0)
+        page_size = 1;
+    memset(&counters, 0, sizeof(counters));
+}
+
+FE_RecentPoller::~FE_RecentPoller() {
+}
+
+string FE_RecentPoller::fetch_page(const FE_ParamPairs &args) {
+    FireEagle fe(config);
+    return fe.recent(args);
+}
+
+void FE_RecentPoller::start_fetch(Fetch *fetch, bool background) {
+    counters.pages++;
+    if (fetch->start(background ? pool : NULL))
+        counters.prefetched++;
+}
+
+size_t FE_RecentPoller::poll() {
+    counters.polls++;
+
+    FE_ParamPairs args;
+    ostringstream count;
+    count << page_size;
+    args["count"] = count.str();
+    if (cursor_ms > 0)
+        args["time"] = FE_format_timestamp(cursor_ms, 0);
+
+    //Two pages: the one being delivered and the next one, in flight.
+    Fetch first(this), second(this);
+    Fetch *current = &first;
+    Fetch *next = &second;
+    unsigned int start = 0;
+    size_t delivered = 0;
+    long long latest = cursor_ms;
+
+    current->args = args;
+    current->args["start"] = "0";
+    start_fetch(current, false);
+    try {
+        while (true) {
+            const string &response = current->take();
+            RecentChangeSink sink(last_seen);
+            FE_decode_response(response, FE_FORMAT_XML, config, FE_NODE_USERS, sink);
+            counters.seen += sink.seen;
+            if (sink.latest > latest)
+                latest = sink.latest;
+
+            //A full page means there may be more: ask for them while the
+            //changes of this one are delivered.
+            bool more = (sink.seen >= page_size);
+            if (more) {
+                start += page_size;
+                ostringstream offset;
+                offset << start;
+                next->args = args;
+                next->args["start"] = offset.str();
+                start_fetch(next, true);
+            }
+
+            for (size_t i = 0 ; i < sink.changed.size() ; i++) {
+                FE_user &user = sink.changed[i];
+                last_seen[user.token] = (user.last_update_ms > 0) ? user.last_update_ms : 0;
+                callback->user_changed(user, sink.is_new[i]);
+                delivered++;
+                counters.delivered++;
+            }
+
+            if (!more)
+                break;
+            Fetch *done = current;
+            current = next;
+            next = done;
+        }
+    } catch (...) {
+        //The next page may still be in flight.
+        next->wait();
+        throw;
+    }
+
+    cursor_ms = latest;
+    return delivered;
+}
+
+long long FE_RecentPoller::cursor() const {
+    return cursor_ms;
+}
+
+void FE_RecentPoller::set_cursor(long long epoch_ms) {
+    cursor_ms = epoch_ms;
+}
+
+void FE_RecentPoller::clear() {
+    last_seen.clear();
+}
+
+FE_RecentPollerStats FE_RecentPoller::stats() const {
+    FE_RecentPollerStats copy = counters;
+    copy.tokens = last_seen.size();
+    return copy;
+}
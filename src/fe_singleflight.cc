@@ -0,0 +1,120 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#include <string>
+#include <map>
+
+#include <pthread.h>
+
+#include "fe_singleflight.h"
+
+using namespace std;
+
+struct FE_SingleFlight::Flight {
+    pthread_cond_t finished;
+    bool done;
+    /** Threads still to look at the flight, leader included. */
+    int refs;
+    string response;
+    FireEagleException *error;
+    map<string, Flight *>::iterator position;
+};
+
+FE_SingleFlight::FE_SingleFlight() : _leaders(0), _followers(0) {
+    pthread_mutex_init(&lock, NULL);
+}
+
+FE_SingleFlight::~FE_SingleFlight() {
+    //Flights still in the map belong to threads that are still running;
+    //destroying the group under them is a bug of the caller.
+    pthread_mutex_destroy(&lock);
+}
+
+void FE_SingleFlight::release(Flight *flight) {
+    if (--(flight->refs) > 0)
+        return;
+    pthread_cond_destroy(&(flight->finished));
+    delete flight->error;
+    delete flight;
+}
+
+FE_SingleFlight::Flight *FE_SingleFlight::join(const string &key, bool &leader) {
+    pthread_mutex_lock(&lock);
+    map<string, Flight *>::iterator iter = flights.find(key);
+    Flight *flight;
+    if (iter != flights.end()) {
+        flight = iter->second;
+        flight->refs++;
+        leader = false;
+        _followers++;
+    } else {
+        flight = new Flight;
+        pthread_cond_init(&(flight->finished), NULL);
+        flight->done = false;
+        flight->refs = 1;
+        flight->error = NULL;
+        flight->position = flights.insert(make_pair(key, flight)).first;
+        leader = true;
+        _leaders++;
+    }
+    pthread_mutex_unlock(&lock);
+    return flight;
+}
+
+void FE_SingleFlight::done(Flight *flight, const string &response) {
+    //Copy before taking the lock; waiters only read it once done is set.
+    flight->response = response;
+
+    pthread_mutex_lock(&lock);
+    flights.erase(flight->position);
+    flight->done = true;
+    pthread_cond_broadcast(&(flight->finished));
+    release(flight);
+    pthread_mutex_unlock(&lock);
+}
+
+void FE_SingleFlight::fail(Flight *flight, const FireEagleException *e) {
+    flight->error = new FireEagleException(*e);
+
+    pthread_mutex_lock(&lock);
+    flights.erase(flight->position);
+    flight->done = true;
+    pthread_cond_broadcast(&(flight->finished));
+    release(flight);
+    pthread_mutex_unlock(&lock);
+}
+
+string FE_SingleFlight::wait(Flight *flight) {
+    pthread_mutex_lock(&lock);
+    while (!flight->done)
+        pthread_cond_wait(&(flight->finished), &lock);
+    FireEagleException *error = NULL;
+    string response;
+    if (flight->error)
+        error = new FireEagleException(*(flight->error));
+    else
+        response = flight->response;
+    release(flight);
+    pthread_mutex_unlock(&lock);
+
+    if (error)
+        throw error;
+    return response;
+}
+
+unsigned long long FE_SingleFlight::leaders() const {
+    pthread_mutex_lock(&lock);
+    unsigned long long n = _leaders;
+    pthread_mutex_unlock(&lock);
+    return n;
+}
+
+unsigned long long FE_SingleFlight::followers() const {
+    pthread_mutex_lock(&lock);
+    unsigned long long n = _followers;
+    pthread_mutex_unlock(&lock);
+    return n;
+}
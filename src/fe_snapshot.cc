@@ -0,0 +1,619 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#include <string>
+#include <vector>
+#include <sstream>
+
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "fe_snapshot.h"
+#include "fe_numeric.h"
+#include "fe_hierarchy.h"
+
+using namespace std;
+
+#define FE_SNAPSHOT_MAGIC "FESN"
+#define FE_SNAPSHOT_FLUSH 65536
+#define FE_SNAPSHOT_ARENA_VERTICES 16384
+#define FE_SNAPSHOT_INITIAL_SLOTS 1024
+//Coordinates are stored in units of 1e-7 degrees (about a centimeter).
+#define FE_SNAPSHOT_SCALE 1e7
+
+//Bits of the flags byte of a location record. The geometry type is in the
+//top bits.
+#define LOC_BEST_GUESS 0x01
+#define LOC_PLACE_ID_EXACT 0x02
+#define LOC_WOEID_EXACT 0x04
+#define LOC_RAW_TIMESTAMP 0x08
+#define LOC_RAW_COORDS 0x10
+#define LOC_TYPE_SHIFT 5
+
+//Bits of the flags byte of a user record.
+#define USER_CAN_READ 0x01
+#define USER_CAN_WRITE 0x02
+#define USER_RAW_TIMESTAMP 0x04
+#define USER_RAW_HIERARCHY 0x08
+
+//Whether the names of a location at a level are written as names, or as text
+//when they are nearly unique. Mirrors FE_compact_location.
+static inline bool coarse_level(unsigned int level) {
+    return (level >= FE_COMPACT_INTERN_LEVEL) && (level != UINT_MAX);
+}
+
+static inline unsigned long long zigzag(long long value) {
+    return ((unsigned long long)value << 1) ^ (unsigned long long)(value >> 63);
+}
+
+static inline long long unzigzag(unsigned long long value) {
+    return (long long)(value >> 1) ^ -(long long)(value & 1);
+}
+
+//The multiple of 1e-7 giving back exactly value, if there is one.
+static bool quantize(double value, long long &q) {
+    if (!(fabs(value) <= 1000))
+        return false;
+    q = llround(value * FE_SNAPSHOT_SCALE);
+    return (q / FE_SNAPSHOT_SCALE) == value;
+}
+
+//Whether a timestamp can be stored as milliseconds and an offset: the text
+//must be exactly what FE_format_timestamp gives back.
+static bool compactTimestamp(const string &text, long long ms, int &offset) {
+    long long parsed;
+    if (!ms || !FE_parse_timestamp(text.data(), text.length(), &parsed, &offset))
+        return false;
+    return (parsed == ms) && (FE_format_timestamp(ms, offset) == text);
+}
+
+//Collects the coordinates of a geometry, as written to a snapshot.
+static void geometryCoords(const FE_geometry &geometry, vector<double> &coords) {
+    coords.clear();
+    switch (geometry.type) {
+    case FEGeo_POINT:
+        coords.push_back(geometry.latitude);
+        coords.push_back(geometry.longitude);
+        break;
+    case FEGeo_BOX:
+        coords.push_back(geometry.min_lat);
+        coords.push_back(geometry.min_lon);
+        coords.push_back(geometry.max_lat);
+        coords.push_back(geometry.max_lon);
+        break;
+    case FEGeo_POLYGON:
+        for (unsigned int i = 0 ; i < geometry.vertex_count() ; i++) {
+            const double *latlon = geometry.vertex(i);
+            coords.push_back(latlon[0]);
+            coords.push_back(latlon[1]);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+FE_SnapshotWriter::FE_SnapshotWriter(const string &file) : owned(true) {
+    fp = fopen(file.c_str(), "wb");
+    if (!fp) {
+        ostringstream os;
+        os << "FE_SnapshotWriter: Could not open snapshot file (" << file << ") for saving.";
+        throw new FireEagleException(os.str(), FE_INTERNAL_ERROR);
+    }
+    begin();
+}
+
+FE_SnapshotWriter::FE_SnapshotWriter(FILE *_fp) : fp(_fp), owned(false) {
+    begin();
+}
+
+void FE_SnapshotWriter::begin() {
+    _records = 0;
+    _bytes = 0;
+    last_lat = last_lon = last_ms = 0;
+    slots.assign(FE_SNAPSHOT_INITIAL_SLOTS, 0);
+    buffer.reserve(FE_SNAPSHOT_FLUSH + 4096);
+    buffer.append(FE_SNAPSHOT_MAGIC);
+    put_varint(FE_SNAPSHOT_VERSION);
+    _bytes = buffer.length();
+}
+
+FE_SnapshotWriter::~FE_SnapshotWriter() {
+    try {
+        flush();
+    } catch (FireEagleException *e) {
+        delete e;
+    }
+    if (owned)
+        fclose(fp);
+}
+
+void FE_SnapshotWriter::put_varint(unsigned long long value) {
+    while (value >= 0x80) {
+        buffer.push_back((char)((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    buffer.push_back((char)value);
+}
+
+void FE_SnapshotWriter::put_signed(long long value) {
+    put_varint(zigzag(value));
+}
+
+void FE_SnapshotWriter::put_text(const string &text) {
+    put_varint(text.length());
+    buffer.append(text);
+}
+
+//0 is the empty string, 2 * (index + 1) a name already written, and an odd
+//number the length of a new name, which follows.
+void FE_SnapshotWriter::put_name(const string &name) {
+    if (name.empty()) {
+        put_varint(0);
+        return;
+    }
+
+    unsigned int mask = slots.size() - 1;
+    unsigned int i = FE_hash_fnv1a(name.data(), name.length()) & mask;
+    while (slots[i]) {
+        if (names[slots[i] - 1] == name) {
+            put_varint(2 * (unsigned long long)slots[i]);
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+
+    names.push_back(name);
+    slots[i] = names.size();
+    put_varint(2 * (unsigned long long)name.length() + 1);
+    buffer.append(name);
+
+    if (names.size() * 2 > slots.size()) {
+        slots.assign(slots.size() * 2, 0);
+        mask = slots.size() - 1;
+        for (size_t n = 0 ; n < names.size() ; n++) {
+            i = FE_hash_fnv1a(names[n].data(), names[n].length()) & mask;
+            while (slots[i])
+                i = (i + 1) & mask;
+            slots[i] = n + 1;
+        }
+    }
+}
+
+void FE_SnapshotWriter::put_level_name(unsigned int level, const string &name) {
+    if (coarse_level(level))
+        put_name(name);
+    else
+        put_text(name);
+}
+
+void FE_SnapshotWriter::put_timestamp(bool raw, const string &text, long long ms, int offset) {
+    if (raw) {
+        put_text(text);
+    } else {
+        put_signed(ms - last_ms);
+        put_signed(offset);
+        last_ms = ms;
+    }
+}
+
+void FE_SnapshotWriter::put_location(const FE_location &location) {
+    const FE_geometry &geometry = location.geometry;
+
+    geometryCoords(geometry, coords);
+    quantized.resize(coords.size());
+    bool raw_coords = false;
+    for (size_t i = 0 ; i < coords.size() ; i++) {
+        if (!quantize(coords[i], quantized[i])) {
+            raw_coords = true;
+            break;
+        }
+    }
+
+    int offset = 0;
+    bool raw_timestamp = !compactTimestamp(location.timestamp, location.timestamp_ms, offset);
+
+    unsigned char flags = (unsigned char)(geometry.type << LOC_TYPE_SHIFT);
+    if (location.best_guess)
+        flags |= LOC_BEST_GUESS;
+    if (location.is_place_id_exact)
+        flags |= LOC_PLACE_ID_EXACT;
+    if (location.is_woeid_exact)
+        flags |= LOC_WOEID_EXACT;
+    if (raw_timestamp)
+        flags |= LOC_RAW_TIMESTAMP;
+    if (raw_coords)
+        flags |= LOC_RAW_COORDS;
+    buffer.push_back((char)flags);
+
+    //UINT_MAX, for unknown, is 0; anything else is one more.
+    put_varint((location.level == UINT_MAX) ? 0 : (unsigned long long)location.level + 1);
+    put_varint((location.woeid == UINT_MAX) ? 0 : (unsigned long long)location.woeid + 1);
+    put_timestamp(raw_timestamp, location.timestamp, location.timestamp_ms, offset);
+    put_text(location.label);
+    put_name(location.level_name);
+    put_level_name(location.level, location.full_location);
+    put_level_name(location.level, location.place_name);
+    put_level_name(location.level, location.place_id);
+
+    if (geometry.type == FEGeo_INVALID) {
+        buffer.push_back((char)geometry.error);
+        return;
+    }
+    if (geometry.type == FEGeo_POLYGON)
+        put_varint(geometry.vertex_count());
+
+    for (size_t i = 0 ; i < coords.size() ; i++) {
+        if (raw_coords) {
+            unsigned long long bits;
+            memcpy(&bits, &coords[i], sizeof(bits));
+            for (int b = 0 ; b < 8 ; b++)
+                buffer.push_back((char)(bits >> (8 * b)));
+        } else {
+            //Latitudes and longitudes alternate.
+            long long &last = (i % 2) ? last_lon : last_lat;
+            put_signed(quantized[i] - last);
+            last = quantized[i];
+        }
+    }
+}
+
+void FE_SnapshotWriter::write(const FE_user &user) {
+    int offset = 0;
+    bool raw_timestamp = !compactTimestamp(user.last_update_timestamp, user.last_update_ms,
+                                           offset);
+    unsigned char flags = 0;
+    if (user.can_read)
+        flags |= USER_CAN_READ;
+    if (user.can_write)
+        flags |= USER_CAN_WRITE;
+    if (raw_timestamp)
+        flags |= USER_RAW_TIMESTAMP;
+    const vector<unsigned int> &woeids = user.woeids;
+    bool raw_hierarchy = (user.woeid_hierarchy
+                          != FE_format_woeid_hierarchy((woeids.empty()) ? NULL : &woeids[0],
+                                                       woeids.size()));
+    if (raw_hierarchy)
+        flags |= USER_RAW_HIERARCHY;
+
+    size_t before = buffer.length();
+    buffer.push_back((char)FE_SNAPSHOT_USER);
+    buffer.push_back((char)flags);
+    put_text(user.token);
+    put_timestamp(raw_timestamp, user.last_update_timestamp, user.last_update_ms, offset);
+    put_name(user.timezone);
+    if (raw_hierarchy) {
+        put_text(user.woeid_hierarchy);
+    } else {
+        put_varint(woeids.size());
+        for (size_t i = 0 ; i < woeids.size() ; i++)
+            put_varint(woeids[i]);
+    }
+    put_varint(user.location.size());
+    FE_LocationLevels::const_iterator iter;
+    for (iter = user.location.begin() ; iter != user.location.end() ; iter++)
+        put_location(*iter);
+
+    _bytes += buffer.length() - before;
+    _records++;
+    maybe_flush();
+}
+
+void FE_SnapshotWriter::write(const FE_location &location) {
+    size_t before = buffer.length();
+    buffer.push_back((char)FE_SNAPSHOT_LOCATION);
+    put_location(location);
+
+    _bytes += buffer.length() - before;
+    _records++;
+    maybe_flush();
+}
+
+void FE_SnapshotWriter::maybe_flush() {
+    if (buffer.length() >= FE_SNAPSHOT_FLUSH)
+        flush();
+}
+
+void FE_SnapshotWriter::flush() {
+    if (buffer.length()
+        && (fwrite(buffer.data(), 1, buffer.length(), fp) != buffer.length())) {
+        buffer.clear();
+        throw new FireEagleException("FE_SnapshotWriter: Could not write snapshot.",
+                                     FE_INTERNAL_ERROR);
+    }
+    buffer.clear();
+    if (fflush(fp) != 0)
+        throw new FireEagleException("FE_SnapshotWriter: Could not write snapshot.",
+                                     FE_INTERNAL_ERROR);
+}
+
+size_t FE_SnapshotWriter::records() const { return _records; }
+
+size_t FE_SnapshotWriter::bytes() const { return _bytes; }
+
+FE_SnapshotReader::FE_SnapshotReader(const string &file)
+    : data(NULL), length(0), mapping(NULL), arena(NULL) {
+    int fd = open(file.c_str(), O_RDONLY);
+    struct stat st;
+    if ((fd < 0) || (fstat(fd, &st) != 0)) {
+        if (fd >= 0)
+            close(fd);
+        ostringstream os;
+        os << "FE_SnapshotReader: Could not open snapshot file (" << file << ").";
+        throw new FireEagleException(os.str(), FE_INTERNAL_ERROR);
+    }
+
+    length = st.st_size;
+    if (length > 0) {
+        void *map = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            mapping = map;
+            data = (const char *)map;
+        }
+    }
+    close(fd);
+    if (length && !mapping) {
+        ostringstream os;
+        os << "FE_SnapshotReader: Could not map snapshot file (" << file << ").";
+        throw new FireEagleException(os.str(), FE_INTERNAL_ERROR);
+    }
+
+    try {
+        begin();
+    } catch (FireEagleException *e) {
+        if (mapping)
+            munmap(mapping, length);
+        throw;
+    }
+}
+
+FE_SnapshotReader::FE_SnapshotReader(const char *_data, size_t _length)
+    : data(_data), length(_length), mapping(NULL), arena(NULL) {
+    begin();
+}
+
+FE_SnapshotReader::~FE_SnapshotReader() {
+    if (arena)
+        arena->unref();
+    if (mapping)
+        munmap(mapping, length);
+}
+
+void FE_SnapshotReader::corrupt(const char *what) const {
+    ostringstream os;
+    os << "FE_SnapshotReader: Corrupt snapshot at byte " << pos << ": " << what;
+    throw new FireEagleException(os.str(), FE_INTERNAL_ERROR);
+}
+
+void FE_SnapshotReader::begin() {
+    pos = 0;
+    last_lat = last_lon = last_ms = 0;
+    if ((length < 4) || memcmp(data, FE_SNAPSHOT_MAGIC, 4))
+        corrupt("not a snapshot");
+    pos = 4;
+    unsigned long long number = get_varint();
+    if ((number == 0) || (number > FE_SNAPSHOT_VERSION))
+        corrupt("unsupported version");
+    version = (unsigned int)number;
+}
+
+unsigned long long FE_SnapshotReader::get_varint() {
+    unsigned long long value = 0;
+    for (int shift = 0 ; shift < 64 ; shift += 7) {
+        if (pos >= length)
+            corrupt("truncated");
+        unsigned char byte = (unsigned char)data[pos++];
+        value |= (unsigned long long)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return value;
+    }
+    corrupt("varint too long");
+    return 0;
+}
+
+long long FE_SnapshotReader::get_signed() {
+    return unzigzag(get_varint());
+}
+
+FE_StringRef FE_SnapshotReader::get_bytes(size_t len) {
+    if (len > length - pos)
+        corrupt("truncated");
+    FE_StringRef bytes(data + pos, len);
+    pos += len;
+    return bytes;
+}
+
+FE_StringRef FE_SnapshotReader::get_text() {
+    return get_bytes(get_varint());
+}
+
+FE_StringRef FE_SnapshotReader::get_name() {
+    unsigned long long code = get_varint();
+    if (code == 0)
+        return FE_StringRef("", 0);
+    if (code & 1) {
+        FE_StringRef name = get_bytes(code >> 1);
+        names.push_back(name);
+        return name;
+    }
+    if ((code >> 1) > names.size())
+        corrupt("unknown name");
+    return names[(code >> 1) - 1];
+}
+
+//Version 1 wrote every name of a location as a name.
+FE_StringRef FE_SnapshotReader::get_level_name(unsigned int level) {
+    if ((version == 1) || coarse_level(level))
+        return get_name();
+    return get_text();
+}
+
+void FE_SnapshotReader::get_timestamp(bool raw, string &text, long long &ms) {
+    if (raw) {
+        FE_StringRef ref = get_text();
+        text.assign(ref.data, ref.length);
+        //As the factories do.
+        if (!FE_parse_timestamp(ref.data, ref.length, &ms, NULL))
+            ms = 0;
+    } else {
+        ms = last_ms + get_signed();
+        last_ms = ms;
+        long long offset = get_signed();
+        if ((offset < -24 * 60) || (offset > 24 * 60))
+            corrupt("bad offset");
+        text = FE_format_timestamp(ms, (int)offset);
+    }
+}
+
+static inline void assignRef(string &to, const FE_StringRef &from) {
+    to.assign(from.data, from.length);
+}
+
+void FE_SnapshotReader::get_location(FE_location &location) {
+    if (pos >= length)
+        corrupt("truncated");
+    unsigned char flags = (unsigned char)data[pos++];
+    unsigned int type = flags >> LOC_TYPE_SHIFT;
+    if (type > FEGeo_POLYGON)
+        corrupt("bad geometry type");
+
+    unsigned long long level = get_varint();
+    unsigned long long woeid = get_varint();
+    if ((level > UINT_MAX) || (woeid > UINT_MAX))
+        corrupt("bad level or woeid");
+    location.level = (level) ? (unsigned int)(level - 1) : UINT_MAX;
+    location.woeid = (woeid) ? (unsigned int)(woeid - 1) : UINT_MAX;
+    location.best_guess = (flags & LOC_BEST_GUESS) != 0;
+    location.is_place_id_exact = (flags & LOC_PLACE_ID_EXACT) != 0;
+    location.is_woeid_exact = (flags & LOC_WOEID_EXACT) != 0;
+    get_timestamp((flags & LOC_RAW_TIMESTAMP) != 0, location.timestamp, location.timestamp_ms);
+    assignRef(location.label, (version == 1) ? get_name() : get_text());
+    assignRef(location.level_name, get_name());
+    assignRef(location.full_location, get_level_name(location.level));
+    assignRef(location.place_name, get_level_name(location.level));
+    assignRef(location.place_id, get_level_name(location.level));
+
+    if (type == FEGeo_INVALID) {
+        if (pos >= length)
+            corrupt("truncated");
+        location.geometry = FE_geometry(FEGeo_INVALID);
+        location.geometry.error = (enum FE_georss_status)(unsigned char)data[pos++];
+        return;
+    }
+
+    size_t ncoords = (type == FEGeo_POINT) ? 2 : 4;
+    if (type == FEGeo_POLYGON) {
+        unsigned long long nvertices = get_varint();
+        //Every coordinate takes at least a byte.
+        if (nvertices > (length - pos) / 2)
+            corrupt("bad vertex count");
+        ncoords = 2 * nvertices;
+    }
+
+    vertices.resize(ncoords);
+    for (size_t i = 0 ; i < ncoords ; i++) {
+        if (flags & LOC_RAW_COORDS) {
+            FE_StringRef bytes = get_bytes(8);
+            unsigned long long bits = 0;
+            for (int b = 0 ; b < 8 ; b++)
+                bits |= (unsigned long long)(unsigned char)bytes.data[b] << (8 * b);
+            memcpy(&vertices[i], &bits, sizeof(bits));
+        } else {
+            long long &last = (i % 2) ? last_lon : last_lat;
+            last += get_signed();
+            vertices[i] = last / FE_SNAPSHOT_SCALE;
+        }
+    }
+
+    switch (type) {
+    case FEGeo_POINT:
+        location.geometry.set_point(vertices[0], vertices[1]);
+        break;
+    case FEGeo_BOX:
+        location.geometry.set_box(vertices[0], vertices[1], vertices[2], vertices[3]);
+        break;
+    default:
+        if (arena && (arena->size() >= FE_SNAPSHOT_ARENA_VERTICES)) {
+            arena->unref();
+            arena = NULL;
+        }
+        if (!arena)
+            arena = new FE_VertexArena();
+        location.geometry.set_polygon(arena, (ncoords) ? &vertices[0] : NULL, ncoords / 2);
+        break;
+    }
+}
+
+enum FE_snapshot_record FE_SnapshotReader::peek() const {
+    if (pos >= length)
+        return FE_SNAPSHOT_END;
+    unsigned char type = (unsigned char)data[pos];
+    if ((type != FE_SNAPSHOT_USER) && (type != FE_SNAPSHOT_LOCATION))
+        corrupt("unknown record");
+    return (enum FE_snapshot_record)type;
+}
+
+void FE_SnapshotReader::expect(enum FE_snapshot_record type) {
+    if (peek() != type)
+        corrupt((type == FE_SNAPSHOT_USER) ? "expected a user" : "expected a location");
+    pos++;
+}
+
+bool FE_SnapshotReader::next(FE_user &user) {
+    if (peek() == FE_SNAPSHOT_END)
+        return false;
+    expect(FE_SNAPSHOT_USER);
+
+    if (pos >= length)
+        corrupt("truncated");
+    unsigned char flags = (unsigned char)data[pos++];
+    user.can_read = (flags & USER_CAN_READ) != 0;
+    user.can_write = (flags & USER_CAN_WRITE) != 0;
+    assignRef(user.token, get_text());
+    get_timestamp((flags & USER_RAW_TIMESTAMP) != 0, user.last_update_timestamp,
+                  user.last_update_ms);
+    assignRef(user.timezone, get_name());
+    if ((version == 1) || (flags & USER_RAW_HIERARCHY)) {
+        assignRef(user.woeid_hierarchy, (version == 1) ? get_name() : get_text());
+        FE_parse_woeid_hierarchy(user.woeid_hierarchy.data(), user.woeid_hierarchy.length(),
+                                 user.woeids);
+    } else {
+        unsigned long long nwoeids = get_varint();
+        if (nwoeids > length - pos)
+            corrupt("bad woeid count");
+        user.woeids.resize(nwoeids);
+        for (size_t i = 0 ; i < nwoeids ; i++) {
+            unsigned long long woeid = get_varint();
+            if (woeid > UINT_MAX)
+                corrupt("bad woeid");
+            user.woeids[i] = (unsigned int)woeid;
+        }
+        user.woeid_hierarchy = FE_format_woeid_hierarchy((nwoeids) ? &user.woeids[0] : NULL,
+                                                         nwoeids);
+    }
+
+    unsigned long long nlocations = get_varint();
+    if (nlocations > length - pos)
+        corrupt("bad location count");
+    user.location.resize(nlocations);
+    for (size_t i = 0 ; i < nlocations ; i++)
+        get_location(user.location[i]);
+    return true;
+}
+
+bool FE_SnapshotReader::next(FE_location &location) {
+    if (peek() == FE_SNAPSHOT_END)
+        return false;
+    expect(FE_SNAPSHOT_LOCATION);
+    get_location(location);
+    return true;
+}
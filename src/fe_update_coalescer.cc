@@ -0,0 +1,381 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#include <string>
+#include <map>
+#include <vector>
+
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "fe_update_coalescer.h"
+#include "fe_cache.h" //For FE_ResponseCache::now_ms
+#include "fe_geocache.h" //For FE_GeoCache::parse_query
+#include "fe_geo.h"
+
+using namespace std;
+
+//Times are on the monotonic clock.
+struct FE_UpdateCoalescer::State {
+    OAuthTokenPair token;
+
+    //Last position sent, and when.
+    bool has_sent;
+    double sent_lat;
+    double sent_lon;
+    long long sent_at;
+
+    //Deferred update and its position, due at due_at (0 when none is
+    //scheduled).
+    bool has_pending;
+    FE_ParamPairs pending;
+    double pending_lat;
+    double pending_lon;
+    long long due_at;
+
+    //Bounding boxes of the user's levels, 4 values each, from set_location.
+    vector<double> boxes;
+
+    State(const OAuthTokenPair &_token)
+        : token(_token), has_sent(false), sent_lat(0), sent_lon(0), sent_at(0),
+          has_pending(false), pending_lat(0), pending_lon(0), due_at(0) {}
+};
+
+static bool in_box(const double *box, double lat, double lon) {
+    return (lat >= box[0]) && (lon >= box[1]) && (lat <= box[2]) && (lon <= box[3]);
+}
+
+FE_UpdateCoalescer::FE_UpdateCoalescer(FireEagleConfig *_config, double _min_distance,
+                                       unsigned int window_seconds,
+                                       unsigned int _boundary_precision)
+    : config(_config), min_distance(_min_distance), window_ms(window_seconds * 1000LL),
+      boundary_precision(_boundary_precision), running(true) {
+    if (!_config)
+        throw new FireEagleException("NULL pointer for FireEagleConfig", FE_INTERNAL_ERROR);
+    if (boundary_precision > FE_GEOHASH_MAX)
+        boundary_precision = FE_GEOHASH_MAX;
+    memset(&counters, 0, sizeof(counters));
+
+    pthread_mutex_init(&lock, NULL);
+    //Deadlines are on the monotonic clock, so is the timed wait.
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&wake, &attr);
+    pthread_condattr_destroy(&attr);
+
+    if (pthread_create(&timer, NULL, timer_main, this) != 0) {
+        pthread_cond_destroy(&wake);
+        pthread_mutex_destroy(&lock);
+        throw new FireEagleException("FE_UpdateCoalescer: Could not start a thread",
+                                     FE_INTERNAL_ERROR);
+    }
+}
+
+FE_UpdateCoalescer::~FE_UpdateCoalescer() {
+    stop();
+    for (map<string, State *>::iterator iter = states.begin() ; iter != states.end() ; ++iter)
+        delete iter->second;
+    pthread_cond_destroy(&wake);
+    pthread_mutex_destroy(&lock);
+}
+
+void FE_UpdateCoalescer::stop() {
+    pthread_mutex_lock(&lock);
+    if (!running) {
+        pthread_mutex_unlock(&lock);
+        return;
+    }
+    running = false;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&lock);
+    //The timer thread sends what is left before it returns.
+    pthread_join(timer, NULL);
+}
+
+void *FE_UpdateCoalescer::timer_main(void *arg) {
+    ((FE_UpdateCoalescer *)arg)->timer_loop();
+    return NULL;
+}
+
+void FE_UpdateCoalescer::timer_loop() {
+    pthread_mutex_lock(&lock);
+    while (running) {
+        if (due.empty()) {
+            pthread_cond_wait(&wake, &lock);
+            continue;
+        }
+        long long first = due.begin()->first;
+        if (first > FE_ResponseCache::now_ms()) {
+            struct timespec deadline;
+            deadline.tv_sec = first / 1000;
+            deadline.tv_nsec = (first % 1000) * 1000000;
+            pthread_cond_timedwait(&wake, &lock, &deadline);
+            continue;
+        }
+        pthread_mutex_unlock(&lock);
+        send_due(false);
+        pthread_mutex_lock(&lock);
+    }
+    pthread_mutex_unlock(&lock);
+    send_due(true);
+}
+
+//Sends the deferred updates due by now, or all of them.
+void FE_UpdateCoalescer::send_due(bool all) {
+    pthread_mutex_lock(&lock);
+    long long now = FE_ResponseCache::now_ms();
+    while (!due.empty() && (all || (due.begin()->first <= now))) {
+        long long at = due.begin()->first;
+        string key = due.begin()->second;
+        due.erase(due.begin());
+
+        map<string, State *>::iterator iter = states.find(key);
+        //Skip entries left by updates sent or dropped since.
+        if ((iter == states.end()) || (iter->second->due_at != at))
+            continue;
+        State &state = *(iter->second);
+        OAuthTokenPair token(state.token);
+        FE_ParamPairs args;
+        args.swap(state.pending);
+        state.has_pending = false;
+        state.due_at = 0;
+        state.sent_lat = state.pending_lat;
+        state.sent_lon = state.pending_lon;
+        state.sent_at = FE_ResponseCache::now_ms();
+        counters.pending--;
+        pthread_mutex_unlock(&lock);
+
+        bool ok = true;
+        try {
+            send(token, args);
+        } catch (FireEagleException *e) {
+            delete e;
+            ok = false;
+        } catch (...) {
+            ok = false;
+        }
+
+        pthread_mutex_lock(&lock);
+        if (ok) {
+            counters.sent++;
+        } else {
+            counters.errors++;
+            //Let the next position through rather than compare with one
+            //Fire Eagle never got.
+            iter = states.find(key);
+            if (iter != states.end())
+                iter->second->has_sent = false;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+bool FE_UpdateCoalescer::crosses_boundary(const State &state, double lat, double lon) const {
+    if (!state.boxes.empty()) {
+        for (size_t i = 0 ; i < state.boxes.size() ; i += 4) {
+            const double *box = &(state.boxes[i]);
+            if (in_box(box, state.sent_lat, state.sent_lon) != in_box(box, lat, lon))
+                return true;
+        }
+        return false;
+    }
+    if (!boundary_precision)
+        return false;
+    char before[FE_GEOHASH_MAX];
+    char after[FE_GEOHASH_MAX];
+    FE_geohash(state.sent_lat, state.sent_lon, boundary_precision, before);
+    FE_geohash(lat, lon, boundary_precision, after);
+    return memcmp(before, after, boundary_precision) != 0;
+}
+
+void FE_UpdateCoalescer::send(const OAuthTokenPair &token, const FE_ParamPairs &args) {
+    FireEagle fe(config, token);
+    fe.update(args);
+}
+
+enum FE_update_action FE_UpdateCoalescer::submit(const OAuthTokenPair &token,
+                                                 const FE_ParamPairs &args) {
+    double lat = 0, lon = 0;
+    bool position = FE_GeoCache::parse_query(args, lat, lon);
+    long long now = FE_ResponseCache::now_ms();
+    enum FE_update_action action;
+
+    pthread_mutex_lock(&lock);
+    counters.submitted++;
+    map<string, State *>::iterator iter = states.find(token.token);
+    State *state;
+    if (iter != states.end()) {
+        state = iter->second;
+        state->token.secret = token.secret;
+    } else {
+        state = new State(token);
+        states[token.token] = state;
+    }
+
+    if (!position) {
+        //The user is somewhere else now: positions are no longer compared
+        //with the last one, and the deferred one is out of date.
+        action = FE_UPDATE_SENT_OTHER;
+        state->has_sent = false;
+    } else if (state->has_sent
+               && (FE_haversine(state->sent_lat, state->sent_lon, lat, lon) < min_distance)) {
+        //Back near the last position sent: what was deferred is moot too.
+        if (state->has_pending) {
+            state->has_pending = false;
+            state->pending.clear();
+            state->due_at = 0;
+            counters.pending--;
+            counters.merged++;
+        }
+        counters.suppressed++;
+        pthread_mutex_unlock(&lock);
+        return FE_UPDATE_SUPPRESSED;
+    } else if (state->has_sent && crosses_boundary(*state, lat, lon)) {
+        action = FE_UPDATE_SENT_BOUNDARY;
+        //The boxes were those of the levels just left.
+        state->boxes.clear();
+    } else if (!state->has_sent || !running || (now - state->sent_at >= window_ms)) {
+        action = FE_UPDATE_SENT;
+    } else {
+        if (state->has_pending)
+            counters.merged++;
+        else
+            counters.pending++;
+        state->has_pending = true;
+        state->pending = args;
+        state->pending_lat = lat;
+        state->pending_lon = lon;
+        if (!state->due_at) {
+            state->due_at = state->sent_at + window_ms;
+            due.insert(make_pair(state->due_at, token.token));
+            pthread_cond_signal(&wake);
+        }
+        pthread_mutex_unlock(&lock);
+        return FE_UPDATE_DEFERRED;
+    }
+
+    //Sending now replaces the deferred update.
+    if (state->has_pending) {
+        state->has_pending = false;
+        state->pending.clear();
+        state->due_at = 0;
+        counters.pending--;
+        counters.merged++;
+    }
+    if (position) {
+        state->has_sent = true;
+        state->sent_lat = lat;
+        state->sent_lon = lon;
+    }
+    state->sent_at = now;
+    pthread_mutex_unlock(&lock);
+
+    try {
+        send(token, args);
+    } catch (...) {
+        pthread_mutex_lock(&lock);
+        iter = states.find(token.token);
+        if (iter != states.end())
+            iter->second->has_sent = false;
+        pthread_mutex_unlock(&lock);
+        throw;
+    }
+
+    pthread_mutex_lock(&lock);
+    counters.sent++;
+    if (action == FE_UPDATE_SENT_BOUNDARY)
+        counters.boundary++;
+    pthread_mutex_unlock(&lock);
+    return action;
+}
+
+void FE_UpdateCoalescer::set_location(const OAuthTokenPair &token, const FE_user &user) {
+    vector<double> boxes;
+    for (size_t i = 0 ; i < user.location.size() ; i++) {
+        const FE_geometry &geometry = user.location[i].geometry;
+        if ((geometry.type != FEGeo_BOX) && (geometry.type != FEGeo_POLYGON))
+            continue;
+        boxes.push_back(geometry.min_lat);
+        boxes.push_back(geometry.min_lon);
+        boxes.push_back(geometry.max_lat);
+        boxes.push_back(geometry.max_lon);
+    }
+
+    pthread_mutex_lock(&lock);
+    map<string, State *>::iterator iter = states.find(token.token);
+    State *state;
+    if (iter != states.end()) {
+        state = iter->second;
+    } else {
+        state = new State(token);
+        states[token.token] = state;
+    }
+    state->boxes.swap(boxes);
+    pthread_mutex_unlock(&lock);
+}
+
+void FE_UpdateCoalescer::flush(const OAuthTokenPair &token) {
+    pthread_mutex_lock(&lock);
+    map<string, State *>::iterator iter = states.find(token.token);
+    if ((iter == states.end()) || !iter->second->has_pending) {
+        pthread_mutex_unlock(&lock);
+        return;
+    }
+    State &state = *(iter->second);
+    FE_ParamPairs args;
+    args.swap(state.pending);
+    state.has_pending = false;
+    state.due_at = 0;
+    state.sent_lat = state.pending_lat;
+    state.sent_lon = state.pending_lon;
+    state.sent_at = FE_ResponseCache::now_ms();
+    counters.pending--;
+    pthread_mutex_unlock(&lock);
+
+    try {
+        send(token, args);
+    } catch (...) {
+        pthread_mutex_lock(&lock);
+        iter = states.find(token.token);
+        if (iter != states.end())
+            iter->second->has_sent = false;
+        pthread_mutex_unlock(&lock);
+        throw;
+    }
+
+    pthread_mutex_lock(&lock);
+    counters.sent++;
+    pthread_mutex_unlock(&lock);
+}
+
+void FE_UpdateCoalescer::forget(const OAuthTokenPair &token) {
+    pthread_mutex_lock(&lock);
+    map<string, State *>::iterator iter = states.find(token.token);
+    if (iter != states.end()) {
+        //Its entry in due, if any, is skipped when it comes up.
+        if (iter->second->has_pending)
+            counters.pending--;
+        delete iter->second;
+        states.erase(iter);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+FE_UpdateStats FE_UpdateCoalescer::stats() const {
+    pthread_mutex_lock(&lock);
+    FE_UpdateStats copy = counters;
+    pthread_mutex_unlock(&lock);
+    return copy;
+}
+
+double FE_UpdateCoalescer::suppression_ratio() const {
+    FE_UpdateStats s = stats();
+    if (!s.submitted)
+        return 0;
+    return (double)(s.suppressed + s.merged) / s.submitted;
+}
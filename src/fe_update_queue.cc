@@ -0,0 +1,205 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#include <string>
+#include <deque>
+#include <vector>
+
+#include <string.h>
+#include <pthread.h>
+
+#include "fe_update_queue.h"
+#include "fe_cache.h" //For FE_ResponseCache::now_ms
+
+using namespace std;
+
+struct FE_UpdateQueue::Item {
+    OAuthTokenPair token;
+    FE_ParamPairs args;
+    long long queued_at;
+
+    Item(const OAuthTokenPair &_token, const FE_ParamPairs &_args)
+        : token(_token), args(_args), queued_at(FE_ResponseCache::now_ms()) {}
+};
+
+FE_UpdateQueue::FE_UpdateQueue(FireEagleConfig *_config, FE_UpdateCallback *_callback,
+                               unsigned int nsenders, size_t _capacity,
+                               enum FE_queue_policy _policy)
+    : config(_config), callback(_callback), capacity(_capacity), policy(_policy),
+      stopping(false) {
+    if (!_config)
+        throw new FireEagleException("NULL pointer for FireEagleConfig", FE_INTERNAL_ERROR);
+    if (capacity == 0)
+        capacity = 1;
+    memset(&counters, 0, sizeof(counters));
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&work, NULL);
+    pthread_cond_init(&room, NULL);
+    pthread_cond_init(&idle, NULL);
+
+    if (nsenders == 0)
+        nsenders = 1;
+    for (unsigned int i = 0 ; i < nsenders ; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, sender_main, this) != 0)
+            break;
+        threads.push_back(thread);
+    }
+    if (threads.empty()) {
+        pthread_cond_destroy(&idle);
+        pthread_cond_destroy(&room);
+        pthread_cond_destroy(&work);
+        pthread_mutex_destroy(&lock);
+        throw new FireEagleException("FE_UpdateQueue: Could not start a thread",
+                                     FE_INTERNAL_ERROR);
+    }
+}
+
+FE_UpdateQueue::~FE_UpdateQueue() {
+    stop();
+    pthread_cond_destroy(&idle);
+    pthread_cond_destroy(&room);
+    pthread_cond_destroy(&work);
+    pthread_mutex_destroy(&lock);
+}
+
+void FE_UpdateQueue::stop() {
+    pthread_mutex_lock(&lock);
+    if (stopping) {
+        pthread_mutex_unlock(&lock);
+        return;
+    }
+    stopping = true;
+    pthread_cond_broadcast(&work);
+    //Blocked submits give up.
+    pthread_cond_broadcast(&room);
+    pthread_mutex_unlock(&lock);
+
+    for (size_t i = 0 ; i < threads.size() ; i++)
+        pthread_join(threads[i], NULL);
+}
+
+void *FE_UpdateQueue::sender_main(void *arg) {
+    ((FE_UpdateQueue *)arg)->send_loop();
+    return NULL;
+}
+
+void FE_UpdateQueue::send_loop() {
+    pthread_mutex_lock(&lock);
+    while (true) {
+        while (items.empty() && !stopping)
+            pthread_cond_wait(&work, &lock);
+        //Drain the queue before stopping.
+        if (items.empty())
+            break;
+
+        //One at a time: what is still queued is counted in the depth, can
+        //be dropped, and goes to the next free sender.
+        Item *item = items.front();
+        items.pop_front();
+        counters.in_flight++;
+        pthread_cond_broadcast(&room);
+        pthread_mutex_unlock(&lock);
+
+        long long wait_ms = FE_ResponseCache::now_ms() - item->queued_at;
+        string response;
+        FireEagleException *error = NULL;
+        try {
+            response = send(item->token, item->args);
+        } catch (FireEagleException *e) {
+            error = e;
+        } catch (...) {
+            error = new FireEagleException("FE_UpdateQueue: Unknown error in send",
+                                           FE_INTERNAL_ERROR);
+        }
+        bool failed = (error != NULL);
+        if (callback) {
+            try {
+                callback->update_done(item->token, item->args, response, error, wait_ms);
+            } catch (FireEagleException *e) {
+                delete e;
+            } catch (...) {
+            }
+        }
+        delete error;
+        delete item;
+
+        pthread_mutex_lock(&lock);
+        if (failed)
+            counters.failed++;
+        else
+            counters.sent++;
+        counters.total_wait_ms += wait_ms;
+        counters.in_flight--;
+        if (items.empty() && !counters.in_flight)
+            pthread_cond_broadcast(&idle);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+string FE_UpdateQueue::send(const OAuthTokenPair &token, const FE_ParamPairs &args) {
+    FireEagle fe(config, token);
+    return fe.update(args);
+}
+
+bool FE_UpdateQueue::submit(const OAuthTokenPair &token, const FE_ParamPairs &args) {
+    //Copy outside the lock.
+    Item *item = new Item(token, args);
+    Item *dropped = NULL;
+
+    pthread_mutex_lock(&lock);
+    if ((items.size() >= capacity) && (policy == FE_QUEUE_BLOCK)) {
+        while ((items.size() >= capacity) && !stopping)
+            pthread_cond_wait(&room, &lock);
+    }
+    if (stopping || ((items.size() >= capacity) && (policy == FE_QUEUE_REJECT))) {
+        counters.rejected++;
+        pthread_mutex_unlock(&lock);
+        delete item;
+        return false;
+    }
+    if (items.size() >= capacity) {
+        dropped = items.front();
+        items.pop_front();
+        counters.dropped++;
+    }
+    items.push_back(item);
+    counters.submitted++;
+    if (items.size() > counters.max_depth)
+        counters.max_depth = items.size();
+    pthread_cond_signal(&work);
+    pthread_mutex_unlock(&lock);
+
+    if (dropped) {
+        if (callback) {
+            try {
+                callback->update_dropped(dropped->token, dropped->args);
+            } catch (FireEagleException *e) {
+                delete e;
+            } catch (...) {
+            }
+        }
+        delete dropped;
+    }
+    return true;
+}
+
+void FE_UpdateQueue::wait_idle() {
+    pthread_mutex_lock(&lock);
+    while (!items.empty() || counters.in_flight)
+        pthread_cond_wait(&idle, &lock);
+    pthread_mutex_unlock(&lock);
+}
+
+FE_UpdateQueueStats FE_UpdateQueue::stats() const {
+    pthread_mutex_lock(&lock);
+    FE_UpdateQueueStats copy = counters;
+    copy.depth = items.size();
+    copy.oldest_age_ms = items.empty() ? 0
+        : FE_ResponseCache::now_ms() - items.front()->queued_at;
+    pthread_mutex_unlock(&lock);
+    return copy;
+}
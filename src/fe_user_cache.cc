@@ -0,0 +1,316 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#include <string>
+#include <map>
+
+#include <string.h>
+#include <sys/time.h>
+#include <pthread.h>
+
+#include "fe_user_cache.h"
+#include "fe_cache.h" //For FE_ResponseCache::now_ms
+#include "fe_numeric.h"
+#include "fe_lru.h"
+
+using namespace std;
+
+#define FE_USER_CACHE_SHARD_BITS 4
+#define FE_USER_CACHE_SHARDS (1 << FE_USER_CACHE_SHARD_BITS)
+
+//Entries are in the map of their shard and in its LRU list, most recently
+//used first. Times are on the monotonic clock.
+struct FE_UserCache::Entry {
+    Entry *newer;
+    Entry *older;
+    string key;
+    FE_compact_user user;
+    long long expires;
+    long long refresh_at;
+    bool refreshing;
+    /** Unique in the shard, so that a refresh recognizes the entry it was
+     * started for. */
+    unsigned long long generation;
+    size_t cost;
+
+    Entry(const string &_key) : key(_key) {}
+};
+
+struct FE_UserCache::Shard {
+    pthread_mutex_t lock;
+    map<string, FE_UserCache::Entry *> entries;
+    FE_UserCache::Entry *newest;
+    FE_UserCache::Entry *oldest;
+    size_t budget;
+    /** Generation of the next entry stored. */
+    unsigned long long next_generation;
+    /** Calls to invalidate so far. A miss stores what it fetched only if
+     * none was made in the shard while it was fetching. */
+    unsigned long long invalidations;
+    FE_UserCacheStats stats;
+};
+
+/** Refreshes one user on a worker thread. */
+class FE_UserRefreshTask : public FE_Task {
+  private:
+    FE_UserCache *cache;
+    OAuthTokenPair token;
+    unsigned long long generation;
+
+  public:
+    FE_UserRefreshTask(FE_UserCache *_cache, const OAuthTokenPair &_token,
+                       unsigned long long _generation)
+        : cache(_cache), token(_token), generation(_generation) {}
+
+    void run() {
+        bool ok = true;
+        try {
+            FE_user user;
+            cache->fetch(token, user);
+            cache->store(token, user, generation, 0);
+        } catch (FireEagleException *e) {
+            delete e;
+            ok = false;
+        } catch (...) {
+            ok = false;
+        }
+        cache->finish_refresh(token.token, generation, ok);
+    }
+};
+
+static unsigned int hash_string(const string &s) {
+    return FE_hash_fnv1a(s.data(), s.size());
+}
+
+static long long wall_clock_ms() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000LL + tv.tv_usec / 1000;
+}
+
+//Bytes held by an entry, with the map node that points to it.
+static size_t entry_cost(const FE_UserCache::Entry &entry) {
+    const FE_compact_user &user = entry.user;
+    size_t cost = sizeof(entry) + 64 + 2 * entry.key.size() + user.token.size()
+        + user.woeids.capacity() * sizeof(unsigned int)
+        + user.location.capacity() * sizeof(FE_compact_location);
+    for (size_t i = 0 ; i < user.location.size() ; i++) {
+        cost += user.location[i].geometry.vertex_count() * 2 * sizeof(double)
+            + user.location[i].local_bytes();
+    }
+    return cost;
+}
+
+//Call with the lock held.
+static void remove_entry(FE_UserCache::Shard &shard, FE_UserCache::Entry *entry) {
+    shard.entries.erase(entry->key);
+    FE_lru_unlink(shard, entry);
+    shard.stats.entries--;
+    shard.stats.bytes -= entry->cost;
+    delete entry;
+}
+
+FE_UserCache::FE_UserCache(FireEagleConfig *_config, FE_WorkerPool *_pool, size_t max_bytes)
+    : config(_config), pool(_pool), refreshing(0) {
+    if (!_config)
+        throw new FireEagleException("NULL pointer for FireEagleConfig", FE_INTERNAL_ERROR);
+    set_ttl(60, 3600, 0.25);
+    pthread_mutex_init(&refresh_lock, NULL);
+    pthread_cond_init(&refresh_done, NULL);
+    shards = new Shard[FE_USER_CACHE_SHARDS];
+    for (int i = 0 ; i < FE_USER_CACHE_SHARDS ; i++) {
+        Shard &shard = shards[i];
+        pthread_mutex_init(&(shard.lock), NULL);
+        shard.newest = shard.oldest = NULL;
+        shard.budget = max_bytes / FE_USER_CACHE_SHARDS;
+        shard.next_generation = 1;
+        shard.invalidations = 0;
+        memset(&(shard.stats), 0, sizeof(shard.stats));
+    }
+}
+
+FE_UserCache::~FE_UserCache() {
+    wait_refreshes();
+    for (int i = 0 ; i < FE_USER_CACHE_SHARDS ; i++) {
+        Shard &shard = shards[i];
+        Entry *entry = shard.newest;
+        while (entry) {
+            Entry *older = entry->older;
+            delete entry;
+            entry = older;
+        }
+        pthread_mutex_destroy(&(shard.lock));
+    }
+    delete [] shards;
+    pthread_cond_destroy(&refresh_done);
+    pthread_mutex_destroy(&refresh_lock);
+}
+
+void FE_UserCache::set_ttl(unsigned int min_seconds, unsigned int max_seconds,
+                           double fraction, double refresh_at) {
+    min_ttl_ms = min_seconds * 1000;
+    max_ttl_ms = (max_seconds < min_seconds) ? min_ttl_ms : max_seconds * 1000;
+    idle_fraction = fraction;
+    refresh_fraction = refresh_at;
+}
+
+unsigned int FE_UserCache::ttl_for(const FE_user &user) const {
+    if (user.last_update_ms <= 0)
+        return min_ttl_ms;
+    double ttl = (wall_clock_ms() - user.last_update_ms) * idle_fraction;
+    if (ttl < min_ttl_ms)
+        return min_ttl_ms;
+    if (ttl > max_ttl_ms)
+        return max_ttl_ms;
+    return (unsigned int)ttl;
+}
+
+void FE_UserCache::fetch(const OAuthTokenPair &token, FE_user &user) {
+    FireEagle fe(config, token);
+    FE_user fetched = fe.user_object();
+    user.swap(fetched);
+}
+
+//A refresh (generation != 0) only replaces the entry it was started for,
+//and a miss only stores if the shard saw no invalidate since epoch: if the
+//user was invalidated or evicted while Fire Eagle was being asked, the user
+//fetched may be older than what the caller knows, and is dropped.
+void FE_UserCache::store(const OAuthTokenPair &token, const FE_user &user,
+                         unsigned long long generation, unsigned long long epoch) {
+    //Build the entry outside the lock: interning names may take a while.
+    Entry *entry = new Entry(token.token);
+    entry->user.assign(user);
+    unsigned int ttl = ttl_for(user);
+    long long now = FE_ResponseCache::now_ms();
+    entry->expires = now + ttl;
+    entry->refresh_at = now + (long long)(ttl * refresh_fraction);
+    entry->refreshing = false;
+    entry->cost = entry_cost(*entry);
+
+    Shard &shard = shards[hash_string(token.token) & (FE_USER_CACHE_SHARDS - 1)];
+    pthread_mutex_lock(&(shard.lock));
+    map<string, Entry *>::iterator iter = shard.entries.find(token.token);
+    bool stale;
+    if (generation) {
+        Entry *current = (iter != shard.entries.end()) ? iter->second : NULL;
+        stale = !current || !current->refreshing || (current->generation != generation);
+    } else {
+        stale = (shard.invalidations != epoch);
+    }
+    if (stale) {
+        pthread_mutex_unlock(&(shard.lock));
+        delete entry;
+        return;
+    }
+    if (iter != shard.entries.end())
+        remove_entry(shard, iter->second);
+    entry->generation = shard.next_generation++;
+    if (entry->cost > shard.budget) {
+        pthread_mutex_unlock(&(shard.lock));
+        delete entry;
+        return;
+    }
+    while (shard.oldest && (shard.stats.bytes + entry->cost > shard.budget)) {
+        remove_entry(shard, shard.oldest);
+        shard.stats.evictions++;
+    }
+    shard.entries[token.token] = entry;
+    FE_lru_link_newest(shard, entry);
+    shard.stats.entries++;
+    shard.stats.bytes += entry->cost;
+    pthread_mutex_unlock(&(shard.lock));
+}
+
+void FE_UserCache::get(const OAuthTokenPair &token, FE_user &user) {
+    Shard &shard = shards[hash_string(token.token) & (FE_USER_CACHE_SHARDS - 1)];
+    long long now = FE_ResponseCache::now_ms();
+
+    pthread_mutex_lock(&(shard.lock));
+    map<string, Entry *>::iterator iter = shard.entries.find(token.token);
+    Entry *entry = (iter != shard.entries.end()) ? iter->second : NULL;
+    if (entry && (now < entry->expires)) {
+        shard.stats.hits++;
+        FE_lru_touch(shard, entry);
+        entry->user.expand(user);
+        bool refresh = pool && !entry->refreshing && (now >= entry->refresh_at);
+        unsigned long long generation = entry->generation;
+        if (refresh) {
+            entry->refreshing = true;
+            shard.stats.refreshes++;
+        }
+        pthread_mutex_unlock(&(shard.lock));
+
+        if (refresh) {
+            pthread_mutex_lock(&refresh_lock);
+            refreshing++;
+            pthread_mutex_unlock(&refresh_lock);
+            if (!pool->submit(new FE_UserRefreshTask(this, token, generation)))
+                finish_refresh(token.token, generation, false);
+        }
+        return;
+    }
+    shard.stats.misses++;
+    unsigned long long epoch = shard.invalidations;
+    pthread_mutex_unlock(&(shard.lock));
+
+    fetch(token, user);
+    store(token, user, 0, epoch);
+}
+
+void FE_UserCache::finish_refresh(const string &token, unsigned long long generation,
+                                  bool ok) {
+    Shard &shard = shards[hash_string(token) & (FE_USER_CACHE_SHARDS - 1)];
+    pthread_mutex_lock(&(shard.lock));
+    map<string, Entry *>::iterator iter = shard.entries.find(token);
+    //A successful refresh already replaced the entry.
+    if ((iter != shard.entries.end()) && (iter->second->generation == generation))
+        iter->second->refreshing = false;
+    if (!ok)
+        shard.stats.refresh_errors++;
+    pthread_mutex_unlock(&(shard.lock));
+
+    pthread_mutex_lock(&refresh_lock);
+    refreshing--;
+    pthread_cond_broadcast(&refresh_done);
+    pthread_mutex_unlock(&refresh_lock);
+}
+
+void FE_UserCache::wait_refreshes() {
+    pthread_mutex_lock(&refresh_lock);
+    while (refreshing)
+        pthread_cond_wait(&refresh_done, &refresh_lock);
+    pthread_mutex_unlock(&refresh_lock);
+}
+
+void FE_UserCache::invalidate(const OAuthTokenPair &token) {
+    Shard &shard = shards[hash_string(token.token) & (FE_USER_CACHE_SHARDS - 1)];
+    pthread_mutex_lock(&(shard.lock));
+    map<string, Entry *>::iterator iter = shard.entries.find(token.token);
+    if (iter != shard.entries.end())
+        remove_entry(shard, iter->second);
+    //Refreshes in flight no longer find their entry; misses in flight see
+    //the new epoch. Both drop what they fetched.
+    shard.invalidations++;
+    pthread_mutex_unlock(&(shard.lock));
+}
+
+FE_UserCacheStats FE_UserCache::stats() const {
+    FE_UserCacheStats total;
+    memset(&total, 0, sizeof(total));
+    for (int i = 0 ; i < FE_USER_CACHE_SHARDS ; i++) {
+        Shard &shard = shards[i];
+        pthread_mutex_lock(&(shard.lock));
+        total.hits += shard.stats.hits;
+        total.misses += shard.stats.misses;
+        total.refreshes += shard.stats.refreshes;
+        total.refresh_errors += shard.stats.refresh_errors;
+        total.evictions += shard.stats.evictions;
+        total.entries += shard.stats.entries;
+        total.bytes += shard.stats.bytes;
+        pthread_mutex_unlock(&(shard.lock));
+    }
+    return total;
+}
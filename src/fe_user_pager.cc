@@ -0,0 +1,153 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#include <string>
+#include <deque>
+#include <vector>
+#include <sstream>
+
+#include <string.h>
+#include <pthread.h>
+
+#include "fe_user_pager.h"
+
+using namespace std;
+
+//A page asked for, fetched on a worker or on the thread calling next.
+struct FE_UserPager::Page : public FE_PendingCall {
+    FE_UserPager *pager;
+    FE_ParamPairs args;
+
+    Page(FE_UserPager *_pager)
+        : FE_PendingCall("FE_UserPager::fetch_page"), pager(_pager) {}
+
+    ~Page() {
+        wait();
+    }
+
+    string call() {
+        return pager->fetch_page(args);
+    }
+};
+
+//Keeps the users of a page, in order.
+class PageUserSink : public FE_ObjectSink {
+  private:
+    vector<FE_user> &users;
+
+  public:
+    PageUserSink(vector<FE_user> &_users) : users(_users) {}
+
+    bool decoded_user(FE_user &decoded) {
+        users.push_back(FE_user());
+        users.back().swap(decoded);
+        return true;
+    }
+};
+
+FE_UserPager::FE_UserPager(FireEagleConfig *_config, enum FE_user_list _call,
+                           const FE_ParamPairs &_args, FE_WorkerPool *_pool,
+                           unsigned int _page_size, unsigned int _prefetch)
+    : config(_config), call(_call), args(_args), pool(_pool), page_size(_page_size),
+      prefetch(_prefetch), next_start(0), last_page(false), finished(false),
+      position(0) {
+    if (!_config)
+        throw new FireEagleException("NULL pointer for FireEagleConfig", FE_INTERNAL_ERROR);
+    if (page_size == 0)
+        page_size = 1;
+    if (!pool)
+        prefetch = 0;
+    memset(&counters, 0, sizeof(counters));
+
+    ostringstream count;
+    count << page_size;
+    args["count"] = count.str();
+    users.reserve(page_size);
+}
+
+FE_UserPager::~FE_UserPager() {
+    close();
+}
+
+string FE_UserPager::fetch_page(const FE_ParamPairs &page_args) {
+    FireEagle fe(config);
+    if (call == FE_LIST_WITHIN)
+        return fe.within(page_args);
+    return fe.recent(page_args);
+}
+
+//Ask for pages until prefetch of them are ahead of the one being read, or
+//the one needed now without a pool.
+void FE_UserPager::request_pages() {
+    while (!last_page && (ahead.size() < ((prefetch > 0) ? prefetch : 1))) {
+        Page *page = new Page(this);
+        page->args = args;
+        ostringstream start;
+        start << next_start;
+        page->args["start"] = start.str();
+        next_start += page_size;
+        ahead.push_back(page);
+        counters.pages++;
+        page->start(pool);
+    }
+}
+
+bool FE_UserPager::next(FE_user &user) {
+    while (position >= users.size()) {
+        if (finished)
+            return false;
+        if (last_page) {
+            //What is still ahead was fetched past the end.
+            close();
+            return false;
+        }
+        request_pages();
+
+        Page *page = ahead.front();
+        ahead.pop_front();
+        users.clear();
+        position = 0;
+        try {
+            const string &response = page->take();
+            PageUserSink sink(users);
+            FE_decode_response(response, FE_FORMAT_XML, config, FE_NODE_USERS, sink);
+        } catch (...) {
+            delete page;
+            users.clear();
+            close();
+            throw;
+        }
+        delete page;
+        if (users.size() < page_size)
+            last_page = true;
+        //Keep the next pages coming while the caller reads this one.
+        if (prefetch)
+            request_pages();
+    }
+    user.swap(users[position]);
+    position++;
+    counters.users++;
+    return true;
+}
+
+void FE_UserPager::close() {
+    //Only a page that was not full sets last_page before this does.
+    bool past_end = last_page;
+    while (!ahead.empty()) {
+        Page *page = ahead.front();
+        ahead.pop_front();
+        page->wait();
+        delete page;
+        if (past_end)
+            counters.wasted++;
+    }
+    last_page = true;
+    finished = true;
+}
+
+FE_UserPagerStats FE_UserPager::stats() const {
+    return counters;
+}
@@ -0,0 +1,191 @@
+/**
+ * FireEagle OAuth+API C++ bindings
+ *
+ * Copyright (C) 2009 Yahoo! Inc
+ *
+ */
+#include <string>
+#include <list>
+#include <vector>
+
+#include <pthread.h>
+
+#include "fe_worker_pool.h"
+#include "fireeagle.h" //For FireEagleException
+
+using namespace std;
+
+FE_WorkerPool::FE_WorkerPool(unsigned int nthreads) : running(0), stopping(false) {
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&work, NULL);
+    pthread_cond_init(&idle, NULL);
+
+    if (nthreads == 0)
+        nthreads = 1;
+    for (unsigned int i = 0 ; i < nthreads ; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, worker_main, this) != 0)
+            break;
+        threads.push_back(thread);
+    }
+    if (threads.empty()) {
+        pthread_cond_destroy(&idle);
+        pthread_cond_destroy(&work);
+        pthread_mutex_destroy(&lock);
+        throw new FireEagleException("FE_WorkerPool: Could not start a thread",
+                                     FE_INTERNAL_ERROR);
+    }
+}
+
+FE_WorkerPool::~FE_WorkerPool() {
+    pthread_mutex_lock(&lock);
+    stopping = true;
+    pthread_cond_broadcast(&work);
+    pthread_mutex_unlock(&lock);
+
+    for (size_t i = 0 ; i < threads.size() ; i++)
+        pthread_join(threads[i], NULL);
+
+    pthread_cond_destroy(&idle);
+    pthread_cond_destroy(&work);
+    pthread_mutex_destroy(&lock);
+}
+
+void *FE_WorkerPool::worker_main(void *arg) {
+    ((FE_WorkerPool *)arg)->work_loop();
+    return NULL;
+}
+
+void FE_WorkerPool::work_loop() {
+    pthread_mutex_lock(&lock);
+    while (true) {
+        while (tasks.empty() && !stopping)
+            pthread_cond_wait(&work, &lock);
+        //Drain the queue before stopping.
+        if (tasks.empty())
+            break;
+
+        FE_Task *task = tasks.front();
+        tasks.pop_front();
+        running++;
+        pthread_mutex_unlock(&lock);
+
+        try {
+            task->run();
+        } catch (FireEagleException *e) {
+            delete e;
+        } catch (...) {
+        }
+        delete task;
+
+        pthread_mutex_lock(&lock);
+        running--;
+        if (tasks.empty() && !running)
+            pthread_cond_broadcast(&idle);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+bool FE_WorkerPool::submit(FE_Task *task) {
+    pthread_mutex_lock(&lock);
+    if (stopping) {
+        pthread_mutex_unlock(&lock);
+        delete task;
+        return false;
+    }
+    tasks.push_back(task);
+    pthread_cond_signal(&work);
+    pthread_mutex_unlock(&lock);
+    return true;
+}
+
+void FE_WorkerPool::wait_idle() {
+    pthread_mutex_lock(&lock);
+    while (!tasks.empty() || running)
+        pthread_cond_wait(&idle, &lock);
+    pthread_mutex_unlock(&lock);
+}
+
+size_t FE_WorkerPool::pending() const {
+    pthread_mutex_lock(&lock);
+    size_t n = tasks.size();
+    pthread_mutex_unlock(&lock);
+    return n;
+}
+
+size_t FE_WorkerPool::size() const {
+    return threads.size();
+}
+
+/** Makes a FE_PendingCall on a worker thread. */
+class FE_PendingCallTask : public FE_Task {
+  private:
+    FE_PendingCall *pending_call;
+
+  public:
+    FE_PendingCallTask(FE_PendingCall *_pending_call) : pending_call(_pending_call) {}
+
+    void run() {
+        pending_call->run();
+    }
+};
+
+FE_PendingCall::FE_PendingCall(const char *_context)
+    : pending(false), error(NULL), context(_context) {
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&finished, NULL);
+}
+
+FE_PendingCall::~FE_PendingCall() {
+    delete error;
+    pthread_cond_destroy(&finished);
+    pthread_mutex_destroy(&lock);
+}
+
+bool FE_PendingCall::start(FE_WorkerPool *pool) {
+    //Not in flight: nothing else touches the call.
+    delete error;
+    error = NULL;
+    response.clear();
+    pending = true;
+    if (pool && pool->submit(new FE_PendingCallTask(this)))
+        return true;
+    run();
+    return false;
+}
+
+void FE_PendingCall::run() {
+    string result;
+    FireEagleException *failure = NULL;
+    try {
+        result = call();
+    } catch (FireEagleException *e) {
+        failure = e;
+    } catch (...) {
+        failure = new FireEagleException(string(context) + ": Unknown error",
+                                         FE_INTERNAL_ERROR);
+    }
+    pthread_mutex_lock(&lock);
+    response.swap(result);
+    error = failure;
+    pending = false;
+    pthread_cond_signal(&finished);
+    pthread_mutex_unlock(&lock);
+}
+
+void FE_PendingCall::wait() {
+    pthread_mutex_lock(&lock);
+    while (pending)
+        pthread_cond_wait(&finished, &lock);
+    pthread_mutex_unlock(&lock);
+}
+
+string &FE_PendingCall::take() {
+    wait();
+    if (error) {
+        FireEagleException *e = error;
+        error = NULL;
+        throw e;
+    }
+    return response;
+}
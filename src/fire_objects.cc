@@ -5,13 +5,17 @@
  *
  */
 #include <sstream>
+#include <algorithm>
 
 #include <stdlib.h>
 #include <limits.h>
+#include <string.h>
 
 #include "fire_objects.h"
 #include "expat_parser.h"
 #include "fireeagle.h"
+#include "fe_numeric.h"
+#include "fe_hierarchy.h"
 
 using namespace std;
 
@@ -20,48 +24,273 @@ static void do_indent(ostream &os, unsigned int indent) {
         os << "    ";
 }
 
+FE_VertexArena::FE_VertexArena() : refs(1) {}
+
+void FE_VertexArena::ref() {
+    __sync_fetch_and_add(&refs, 1);
+}
+
+void FE_VertexArena::unref() {
+    if (__sync_sub_and_fetch(&refs, 1) == 0)
+        delete this;
+}
+
+unsigned int FE_VertexArena::add(const double *latlon, unsigned int npoints) {
+    unsigned int first = coords.size() / 2;
+    coords.insert(coords.end(), latlon, latlon + 2 * npoints);
+    return first;
+}
+
+unsigned int FE_VertexArena::size() const {
+    return coords.size() / 2;
+}
+
+const double *FE_VertexArena::vertex(unsigned int i) const {
+    return &(coords[2 * i]);
+}
+
 FE_geometry::FE_geometry(FE_geometry_type _type) {
+    arena = NULL;
+    first_vertex = 0;
+    nvertices = 0;
     type = _type;
+    error = FE_GEORSS_OK;
     latitude = 0;
     longitude = 0;
+    min_lat = 0;
+    min_lon = 0;
+    max_lat = 0;
+    max_lon = 0;
 }
 
-void FE_geometry::print(ostream &os, unsigned int indent) const {
-    if (type == FEGeo_INVALID)
+FE_geometry::FE_geometry(const FE_geometry &other) {
+    arena = other.arena;
+    if (arena)
+        arena->ref();
+    first_vertex = other.first_vertex;
+    nvertices = other.nvertices;
+    type = other.type;
+    error = other.error;
+    latitude = other.latitude;
+    longitude = other.longitude;
+    min_lat = other.min_lat;
+    min_lon = other.min_lon;
+    max_lat = other.max_lat;
+    max_lon = other.max_lon;
+}
+
+FE_geometry &FE_geometry::operator=(const FE_geometry &other) {
+    if (other.arena)
+        other.arena->ref();
+    if (arena)
+        arena->unref();
+    arena = other.arena;
+    first_vertex = other.first_vertex;
+    nvertices = other.nvertices;
+    type = other.type;
+    error = other.error;
+    latitude = other.latitude;
+    longitude = other.longitude;
+    min_lat = other.min_lat;
+    min_lon = other.min_lon;
+    max_lat = other.max_lat;
+    max_lon = other.max_lon;
+    return *this;
+}
+
+FE_geometry::~FE_geometry() {
+    if (arena)
+        arena->unref();
+}
+
+void FE_geometry::set_point(double lat, double lon) {
+    *this = FE_geometry(FEGeo_POINT);
+    latitude = min_lat = max_lat = lat;
+    longitude = min_lon = max_lon = lon;
+}
+
+void FE_geometry::set_box(double _min_lat, double _min_lon, double _max_lat, double _max_lon) {
+    *this = FE_geometry(FEGeo_BOX);
+    min_lat = _min_lat;
+    min_lon = _min_lon;
+    max_lat = _max_lat;
+    max_lon = _max_lon;
+    latitude = (min_lat + max_lat) / 2;
+    longitude = (min_lon + max_lon) / 2;
+}
+
+void FE_geometry::set_polygon(FE_VertexArena *_arena, const double *latlon,
+                              unsigned int npoints) {
+    *this = FE_geometry(FEGeo_POLYGON);
+    if (npoints == 0)
         return;
-    do_indent(os, indent); os << "Latitude: " << latitude << endl;
-    do_indent(os, indent); os << "Longitude: " << longitude << endl;
+
+    _arena->ref();
+    arena = _arena;
+    first_vertex = arena->add(latlon, npoints);
+    nvertices = npoints;
+
+    min_lat = max_lat = latlon[0];
+    min_lon = max_lon = latlon[1];
+    for (unsigned int i = 1 ; i < npoints ; i++) {
+        double lat = latlon[2 * i];
+        double lon = latlon[2 * i + 1];
+        if (lat < min_lat)
+            min_lat = lat;
+        else if (lat > max_lat)
+            max_lat = lat;
+        if (lon < min_lon)
+            min_lon = lon;
+        else if (lon > max_lon)
+            max_lon = lon;
+    }
+    latitude = (min_lat + max_lat) / 2;
+    longitude = (min_lon + max_lon) / 2;
 }
 
-FEGeo_Point::FEGeo_Point() : FE_geometry(FEGeo_POINT) {}
+static inline bool isGeoSpace(char c) {
+    return (c == ' ') || (c == '\t') || (c == '\n') || (c == '\r');
+}
+
+enum FE_georss_status FE_parse_georss(const char *text, size_t len, double *coords,
+                                      unsigned int max, unsigned int *count) {
+    const char *p = text;
+    const char *end = text + len;
+    enum FE_georss_status status = FE_GEORSS_OK;
+    unsigned int n = 0;
+
+    while (true) {
+        while ((p < end) && isGeoSpace(*p))
+            p++;
+        if (p == end)
+            break;
+        const char *token = p;
+        while ((p < end) && !isGeoSpace(*p))
+            p++;
+
+        if (n < max) {
+            double value;
+            if (!FE_parse_double(token, p - token, &value)) {
+                *count = n;
+                return FE_GEORSS_SYNTAX;
+            }
+            //Latitudes at even positions, longitudes at odd ones. NaN fails
+            //both comparisons.
+            double limit = (n % 2) ? 180 : 90;
+            if (!((value >= -limit) && (value <= limit)))
+                status = FE_GEORSS_RANGE;
+            coords[n] = value;
+        }
+        n++;
+    }
 
-void FEGeo_Point::print(ostream &os, unsigned int indent) const {
-    do_indent(os, indent); os << "Object: " << "Location point" << endl;
-    ((FE_geometry *)this)->print(os, indent);
+    *count = n;
+    if ((n > max) || (n % 2))
+        return FE_GEORSS_COUNT;
+    return status;
 }
 
-FEGeo_Box::FEGeo_Box() : FE_geometry(FEGeo_BOX) {
-    min_lat = 0;
-    min_lon = 0;
-    max_lat = 0;
-    max_lon = 0;
+//Enough for the polygons of neighborhoods without going to the heap.
+#define FE_GEORSS_STACK_COORDS 256
+
+enum FE_georss_status FE_geometry::set_from_georss(enum FE_node_id id, const char *text,
+                                                   size_t len, FE_VertexArena *_arena) {
+    double buffer[FE_GEORSS_STACK_COORDS];
+    unsigned int count = 0;
+    enum FE_georss_status status;
+
+    switch (id) {
+    case FE_NODE_GEORSS_POINT:
+        status = FE_parse_georss(text, len, buffer, 2, &count);
+        if ((status == FE_GEORSS_OK) && (count != 2))
+            status = FE_GEORSS_COUNT;
+        if (status == FE_GEORSS_OK)
+            set_point(buffer[0], buffer[1]);
+        break;
+    case FE_NODE_GEORSS_BOX:
+        status = FE_parse_georss(text, len, buffer, 4, &count);
+        if ((status == FE_GEORSS_OK) && (count != 4))
+            status = FE_GEORSS_COUNT;
+        if (status == FE_GEORSS_OK)
+            set_box(buffer[0], buffer[1], buffer[2], buffer[3]);
+        break;
+    case FE_NODE_GEORSS_POLYGON: {
+        vector<double> big;
+        double *coords = buffer;
+        status = FE_parse_georss(text, len, buffer, FE_GEORSS_STACK_COORDS, &count);
+        if ((status == FE_GEORSS_COUNT) && (count > FE_GEORSS_STACK_COORDS)) {
+            big.resize(count);
+            coords = &(big[0]);
+            status = FE_parse_georss(text, len, coords, count, &count);
+        }
+        if ((status == FE_GEORSS_OK) && (count < 6))
+            status = FE_GEORSS_COUNT;
+        if ((status == FE_GEORSS_OK) && !_arena)
+            status = FE_GEORSS_UNSUPPORTED;
+        if (status == FE_GEORSS_OK)
+            set_polygon(_arena, coords, count / 2);
+        break;
+    }
+    default:
+        status = FE_GEORSS_UNSUPPORTED;
+        break;
+    }
+
+    if (status != FE_GEORSS_OK) {
+        *this = FE_geometry(FEGeo_INVALID);
+        error = status;
+    }
+    return status;
+}
+
+unsigned int FE_geometry::vertex_count() const {
+    return nvertices;
 }
 
-void FEGeo_Box::print(ostream &os, unsigned int indent) const {
-    do_indent(os, indent); os << "Object: " << "Location bounding box" << endl;
-    ((FE_geometry *)this)->print(os, indent);
+const double *FE_geometry::vertex(unsigned int i) const {
+    return arena->vertex(first_vertex + i);
+}
+
+void FE_geometry::print(ostream &os, unsigned int indent) const {
+    switch (type) {
+    case FEGeo_POINT:
+        do_indent(os, indent); os << "Object: " << "Location point" << endl;
+        break;
+    case FEGeo_BOX:
+        do_indent(os, indent); os << "Object: " << "Location bounding box" << endl;
+        break;
+    case FEGeo_POLYGON:
+        do_indent(os, indent); os << "Object: " << "Location polygon" << endl;
+        break;
+    default:
+        return;
+    }
+
+    do_indent(os, indent); os << "Latitude: " << latitude << endl;
+    do_indent(os, indent); os << "Longitude: " << longitude << endl;
+    if (type == FEGeo_POINT)
+        return;
+
     do_indent(os, indent); os << "Latitude (min): " << min_lat << endl;
     do_indent(os, indent); os << "Longitude (min): " << min_lon << endl;
     do_indent(os, indent); os << "Latitude (max): " << max_lat << endl;
     do_indent(os, indent); os << "Longitude (max): " << max_lon << endl;
+    if (type == FEGeo_POLYGON) {
+        do_indent(os, indent); os << "Vertices: " << nvertices << endl;
+    }
 }
 
+FEGeo_Point::FEGeo_Point() : FE_geometry(FEGeo_POINT) {}
+
+FEGeo_Box::FEGeo_Box() : FE_geometry(FEGeo_BOX) {}
+
 FE_location::FE_location() {
     best_guess = false;
     level = UINT_MAX;
     is_place_id_exact = false;
     woeid = UINT_MAX;
     is_woeid_exact = false;
+    timestamp_ms = 0;
 }
 
 void FE_location::print(ostream &os, unsigned int indent) const {
@@ -102,9 +331,26 @@ void FE_location::print(ostream &os, unsigned int indent) const {
     }
 }
 
+void FE_location::swap(FE_location &other) {
+    std::swap(geometry, other.geometry);
+    std::swap(best_guess, other.best_guess);
+    label.swap(other.label);
+    std::swap(level, other.level);
+    level_name.swap(other.level_name);
+    timestamp.swap(other.timestamp);
+    std::swap(timestamp_ms, other.timestamp_ms);
+    full_location.swap(other.full_location);
+    place_name.swap(other.place_name);
+    place_id.swap(other.place_id);
+    std::swap(is_place_id_exact, other.is_place_id_exact);
+    std::swap(woeid, other.woeid);
+    std::swap(is_woeid_exact, other.is_woeid_exact);
+}
+
 FE_user::FE_user() {
     can_read = false;
     can_write = false;
+    last_update_ms = 0;
 }
 
 void FE_user::print(ostream &os, unsigned int indent) const {
@@ -130,83 +376,192 @@ void FE_user::print(ostream &os, unsigned int indent) const {
         do_indent(os, indent); os << "Location hierarchy: " << woeid_hierarchy << endl;
     }
 
-    list<FE_location>::const_iterator iter;
+    FE_LocationLevels::const_iterator iter;
     for (iter = location.begin() ; iter != location.end() ; iter++)
         iter->print(os, indent + 1);
 }
 
-static list<double> parseGeoStr(const string &s) {
-    list<double> items;
+void FE_user::swap(FE_user &other) {
+    std::swap(can_read, other.can_read);
+    std::swap(can_write, other.can_write);
+    token.swap(other.token);
+    last_update_timestamp.swap(other.last_update_timestamp);
+    std::swap(last_update_ms, other.last_update_ms);
+    timezone.swap(other.timezone);
+    woeid_hierarchy.swap(other.woeid_hierarchy);
+    woeids.swap(other.woeids);
+    location.swap(other.location);
+}
 
-    size_t begin = 0;
-    size_t pos = s.find(' ', begin);
-    while (pos != string::npos) {
-        string item = s.substr(begin, begin - pos);
-        begin = pos + 1;
-        items.push_back(strtod(item.c_str(), NULL));
-        pos = s.find(' ', begin);
-    }
+//The offset is all the compact forms need besides the milliseconds to give
+//the text back.
+static void compactTimestamp(const string &text, long long ms, long long &out_ms,
+                             short &out_offset) {
+    int offset = 0;
+    out_ms = ms;
+    if (ms && FE_parse_timestamp(text.data(), text.length(), &out_ms, &offset))
+        out_offset = (short)offset;
+    else
+        out_offset = 0;
+}
 
-    if (begin < s.length()) {
-        string item = s.substr(begin, s.length() - begin);
-        items.push_back(strtod(item.c_str(), NULL));
-    }
+FE_compact_location::FE_compact_location()
+    : label_id(0), level_name_id(0), full_location_id(0), place_name_id(0),
+      place_id_id(0), timestamp_ms(0), timestamp_offset(0), level(UINT_MAX),
+      woeid(UINT_MAX), best_guess(false),
+      is_place_id_exact(false), is_woeid_exact(false) {}
 
-    return items;
+FE_compact_location::FE_compact_location(const FE_location &location) {
+    assign(location);
 }
 
-static FE_geometry geometryFactory(const FE_ParsedNode *root) { //Do not free up root!
-                                                      //Expect the root to be a georss:<something>
-    if (root->name() == "georss:point") {
-        FEGeo_Point fpoint;
+//Marks a FE_compact_location name kept in local_text. Interner symbols stay
+//far below it.
+#define FE_COMPACT_LOCAL 0x80000000U
 
-        list<double> items = parseGeoStr(root->get_string_property("text()"));
-        if (items.size() != 2) {
-            string message = "Invalid text for georss:point : ";
-            message.append(root->get_string_property("text()"));
-            throw new FireEagleException(message, FE_INTERNAL_ERROR);
-        }
+FE_symbol FE_compact_location::keep(const string &text, bool intern) {
+    if (text.empty())
+        return 0;
+    if (intern)
+        return FE_interner().intern(text);
+    FE_symbol id = FE_COMPACT_LOCAL | (FE_symbol)local_text.size();
+    //XML text cannot hold a 0, so it safely ends each string.
+    local_text.append(text);
+    local_text += '\0';
+    return id;
+}
 
-        fpoint.type = FEGeo_POINT;
-        list<double>::iterator iter = items.begin();
-        fpoint.latitude = *(iter);
-        iter++;
-        fpoint.longitude = *(iter);
-
-        return fpoint;
-    } else if (root->name() == "georss:box") {
-        FEGeo_Box fbox;
-
-        list<double> items = parseGeoStr(root->get_string_property("text()"));
-        if (items.size() != 4) {
-            string message = "Invalid text for georss:box : ";
-            message.append(root->get_string_property("text()"));
-            throw new FireEagleException(message, FE_INTERNAL_ERROR);
-        }
+FE_StringRef FE_compact_location::text_of(FE_symbol id) const {
+    if (!(id & FE_COMPACT_LOCAL))
+        return FE_interner().lookup(id);
+    const char *text = local_text.data() + (id & ~FE_COMPACT_LOCAL);
+    return FE_StringRef(text, strlen(text));
+}
 
-        fbox.type = FEGeo_BOX;
-        list<double>::iterator iter = items.begin();
-        fbox.min_lat = *(iter);
-        iter++;
-        fbox.min_lon = *(iter);
-        iter++;
-        fbox.max_lat = *(iter);
-        iter++;
-        fbox.max_lon = *(iter);
+void FE_compact_location::assign(const FE_location &location) {
+    bool coarse = (location.level >= FE_COMPACT_INTERN_LEVEL)
+        && (location.level != UINT_MAX);
 
-        fbox.latitude = (fbox.min_lat + fbox.max_lat) / 2;
-        fbox.longitude = (fbox.min_lon + fbox.max_lon) / 2;
+    local_text.clear();
+    label_id = keep(location.label, false);
+    level_name_id = keep(location.level_name, true);
+    full_location_id = keep(location.full_location, coarse);
+    place_name_id = keep(location.place_name, coarse);
+    place_id_id = keep(location.place_id, coarse);
+    geometry = location.geometry;
+    compactTimestamp(location.timestamp, location.timestamp_ms, timestamp_ms, timestamp_offset);
+    level = location.level;
+    woeid = location.woeid;
+    best_guess = location.best_guess;
+    is_place_id_exact = location.is_place_id_exact;
+    is_woeid_exact = location.is_woeid_exact;
+}
 
-        return fbox;
-    } else {
-        //Not handling georss:polygon right now!
-        string message("Unhandled geometry: ");
-        message.append(root->name());
-        throw new FireEagleException(message, FE_INTERNAL_ERROR);
-    }
+void FE_compact_location::expand(FE_location &location) const {
+    location.label = label().str();
+    location.level_name = level_name().str();
+    location.full_location = full_location().str();
+    location.place_name = place_name().str();
+    location.place_id = place_id().str();
+    location.geometry = geometry;
+    location.timestamp = timestamp();
+    location.timestamp_ms = timestamp_ms;
+    location.level = level;
+    location.woeid = woeid;
+    location.best_guess = best_guess;
+    location.is_place_id_exact = is_place_id_exact;
+    location.is_woeid_exact = is_woeid_exact;
+}
+
+FE_StringRef FE_compact_location::label() const { return text_of(label_id); }
+
+FE_StringRef FE_compact_location::level_name() const { return text_of(level_name_id); }
+
+FE_StringRef FE_compact_location::full_location() const { return text_of(full_location_id); }
+
+FE_StringRef FE_compact_location::place_name() const { return text_of(place_name_id); }
+
+FE_StringRef FE_compact_location::place_id() const { return text_of(place_id_id); }
+
+string FE_compact_location::timestamp() const {
+    return (timestamp_ms) ? FE_format_timestamp(timestamp_ms, timestamp_offset) : string();
+}
+
+FE_compact_user::FE_compact_user()
+    : timezone_id(0), can_read(false), can_write(false),
+      last_update_ms(0), last_update_offset(0) {}
+
+FE_compact_user::FE_compact_user(const FE_user &user) {
+    assign(user);
+}
+
+void FE_compact_user::assign(const FE_user &user) {
+    FE_StringInterner &interner = FE_interner();
+
+    timezone_id = interner.intern(user.timezone);
+    can_read = user.can_read;
+    can_write = user.can_write;
+    token = user.token;
+    compactTimestamp(user.last_update_timestamp, user.last_update_ms, last_update_ms,
+                     last_update_offset);
+    woeids = user.woeids;
+
+    location.resize(user.location.size());
+    vector<FE_compact_location>::iterator out = location.begin();
+    FE_LocationLevels::const_iterator iter;
+    for (iter = user.location.begin() ; iter != user.location.end() ; iter++, out++)
+        out->assign(*iter);
 }
 
-static FE_location locationFactory(const FE_ParsedNode *root) {//Do not free root!
+void FE_compact_user::expand(FE_user &user) const {
+    user.timezone = timezone().str();
+    user.woeid_hierarchy = woeid_hierarchy();
+    user.can_read = can_read;
+    user.can_write = can_write;
+    user.token = token;
+    user.last_update_timestamp = last_update_timestamp();
+    user.last_update_ms = last_update_ms;
+    user.woeids = woeids;
+
+    user.location.clear();
+    user.location.reserve(location.size());
+    for (size_t i = 0 ; i < location.size() ; i++)
+        location[i].expand(user.location.push_back());
+}
+
+FE_StringRef FE_compact_user::timezone() const { return FE_interner().lookup(timezone_id); }
+
+string FE_compact_user::woeid_hierarchy() const {
+    return woeids.empty() ? string() : FE_format_woeid_hierarchy(&(woeids[0]), woeids.size());
+}
+
+string FE_compact_user::last_update_timestamp() const {
+    return (last_update_ms) ? FE_format_timestamp(last_update_ms, last_update_offset)
+                            : string();
+}
+
+//Sets ms from an ISO 8601 text, or to 0 when there is none.
+static void parseTimestamp(const string &text, long long &ms) {
+    if (!FE_parse_timestamp(text.data(), text.length(), &ms, NULL))
+        ms = 0;
+}
+
+static void geometryFactory(const FE_ParsedNode *root, FE_geometry &geometry) {
+    //Do not free up root! Expect the root to be a georss:<something>
+    const string &name = root->name();
+    const string &text = root->text();
+    enum FE_node_id id = FE_lookup_node_id(name.data(), name.length());
+    FE_VertexArena *arena = NULL;
+    if (id == FE_NODE_GEORSS_POLYGON)
+        arena = new FE_VertexArena();
+
+    geometry.set_from_georss(id, text.data(), text.length(), arena);
+    if (arena)
+        arena->unref();
+}
+
+//Fills location, which must be freshly constructed, in place.
+static void locationFactory(const FE_ParsedNode *root, FE_location &location) {//Do not free root!
     if (root->name() != "location") {
         //Not handling georss:polygon right now!
         string message("Expected element = location. Got: ");
@@ -214,40 +569,51 @@ static FE_location locationFactory(const FE_ParsedNode *root) {//Do not free roo
         throw new FireEagleException(message, FE_INTERNAL_ERROR);
     }
 
-    FE_location location;
     int nchildren = root->child_count();
     for (int i = 0 ; i < nchildren ; i++) {
         const FE_ParsedNode &child = root->child(i);
+        const string &name = child.name();
 
-        if (child.name() == "label")
-            location.label = child.get_string_property("text()");
-        else if (child.name() == "level")
-            location.level = (unsigned long) child.get_long_property("text()");
-        else if (child.name() == "level-name")
-            location.level_name = child.get_string_property("text()");
-        else if (child.name().substr(0, 7) == "georss:")
-            location.geometry = geometryFactory(&child);
-        else if (child.name() == "located-at")
-            location.timestamp = child.get_string_property("text()");
-        else if (child.name() == "name")
-            location.full_location = child.get_string_property("text()");
-        else if (child.name() == "normal-name")
-            location.place_name = child.get_string_property("text()");
-        else if (child.name() == "place-id") {
-            location.place_id = child.get_string_property("text()");
+        switch (FE_lookup_node_id(name.data(), name.length())) {
+        case FE_NODE_LABEL:
+            location.label = child.text();
+            break;
+        case FE_NODE_LEVEL:
+            location.level = (unsigned long) child.get_long_text();
+            break;
+        case FE_NODE_LEVEL_NAME:
+            location.level_name = child.text();
+            break;
+        case FE_NODE_LOCATED_AT:
+            location.timestamp = child.text();
+            parseTimestamp(location.timestamp, location.timestamp_ms);
+            break;
+        case FE_NODE_NAME:
+            location.full_location = child.text();
+            break;
+        case FE_NODE_NORMAL_NAME:
+            location.place_name = child.text();
+            break;
+        case FE_NODE_PLACE_ID:
+            location.place_id = child.text();
             location.is_place_id_exact = child.get_bool_property("exact-match");
-        } else if (child.name() == "woeid") {
-            location.woeid = (unsigned long) child.get_long_property("text()");
+            break;
+        case FE_NODE_WOEID:
+            location.woeid = (unsigned long) child.get_long_text();
             location.is_woeid_exact = child.get_bool_property("exact-match");
+            break;
+        default:
+            if (name.compare(0, 7, "georss:") == 0)
+                geometryFactory(&child, location.geometry);
+            break;
         }
     }
 
     location.best_guess = root->get_bool_property("best-guess");
-
-    return location;
 }
 
-FE_user userFactory(const FE_ParsedNode *root) {//Do not free root!
+//Fills user, which must be freshly constructed, in place.
+static void userFactory(const FE_ParsedNode *root, FE_user &user) {//Do not free root!
     if (root->name() != "user") {
         //Not handling georss:polygon right now!
         string message("Expected element = user. Got: ");
@@ -255,44 +621,329 @@ FE_user userFactory(const FE_ParsedNode *root) {//Do not free root!
         throw new FireEagleException(message, FE_INTERNAL_ERROR);
     }
 
-    FE_user user;
-    int nchildren = root->child_count();
     if (root->has_property("located-at"))
         user.last_update_timestamp = root->get_string_property("located-at");
+    parseTimestamp(user.last_update_timestamp, user.last_update_ms);
     user.can_read = root->get_bool_property("readable");
     user.can_write = root->get_bool_property("writable");
     if (root->has_property("token"))
         user.token = root->get_string_property("token");
     
-    for (int i = 0 ; i < nchildren ; i++) {
-        const FE_ParsedNode &child = root->child(i);
+    unsigned int cursor = 0;
+    const FE_ParsedNode *child;
+    while ((child = root->next_child(FE_node_name(FE_NODE_LOCATION_HIERARCHY), cursor))) {
+        user.woeid_hierarchy = child->get_string_property("string");
+        FE_parse_woeid_hierarchy(user.woeid_hierarchy.data(), user.woeid_hierarchy.length(),
+                                 user.woeids);
+        user.timezone = child->get_string_property("timezone");
+
+        unsigned int gcursor = 0;
+        const FE_ParsedNode *gchild;
+        while ((gchild = child->next_child(FE_node_name(FE_NODE_LOCATION), gcursor)))
+            locationFactory(gchild, user.location.push_back());
+    }
+}
+
+static const FE_StringRef *findAttribute(const FE_EventAttribute *attrs,
+                                         unsigned int nattrs, const char *name) {
+    for (unsigned int i = 0 ; i < nattrs ; i++) {
+        if (attrs[i].name == name)
+            return &(attrs[i].value);
+    }
+    return NULL;
+}
 
-        if (child.name() != "location-hierarchy")
-            continue;
+//Same as FE_ParsedNode::get_bool_property: only 'true' is true.
+static bool boolAttribute(const FE_EventAttribute *attrs, unsigned int nattrs,
+                          const char *name) {
+    const FE_StringRef *value = findAttribute(attrs, nattrs, name);
+    return value && (*value == "true");
+}
+
+FE_ResponseDecoder::FE_ResponseDecoder(FE_ObjectSink &_sink)
+    : sink(_sink), _error(NULL), arena(NULL) {
+    reset();
+}
+
+FE_ResponseDecoder::~FE_ResponseDecoder() {
+    delete _error;
+    if (arena)
+        arena->unref();
+}
+
+//Polygons of a decoder share an arena. Start a new one once it is big
+//enough, so that keeping one location does not pin the vertices of every
+//response the decoder has seen.
+#define FE_ARENA_VERTICES 16384
 
-        user.woeid_hierarchy = child.get_string_property("string");
-        user.timezone = child.get_string_property("timezone");
+FE_VertexArena *FE_ResponseDecoder::vertex_arena() {
+    if (arena && (arena->size() >= FE_ARENA_VERTICES)) {
+        arena->unref();
+        arena = NULL;
+    }
+    if (!arena)
+        arena = new FE_VertexArena();
+    return arena;
+}
 
-        int grandchildren = child.child_count();
-        for (int j = 0 ; j < grandchildren ; j++) {
-            const FE_ParsedNode &gchild = child.child(j);
-            if (gchild.name() == "location")
-                user.location.push_back(locationFactory(&gchild));
+enum FE_ResponseDecoder::FE_decode_status FE_ResponseDecoder::status() const {
+    return _status;
+}
+
+bool FE_ResponseDecoder::saw(enum FE_node_id id) const {
+    return (top_level & (1UL << id)) != 0;
+}
+
+enum FE_node_id FE_ResponseDecoder::first_child() const {
+    return first_top_level;
+}
+
+FireEagleException *FE_ResponseDecoder::take_error() {
+    FireEagleException *e = _error;
+    _error = NULL;
+    return e;
+}
+
+void FE_ResponseDecoder::reset() {
+    _status = FE_DECODE_PENDING;
+    delete _error;
+    _error = NULL;
+    path.clear();
+    top_level = 0;
+    first_top_level = FE_NODE_UNKNOWN;
+    user_depth = 0;
+    location_depth = 0;
+    field_depth = 0;
+    text.clear();
+}
+
+bool FE_ResponseDecoder::start_node(enum FE_node_id id, const FE_StringRef &name,
+                                    const FE_EventAttribute *attrs, unsigned int nattrs) {
+    enum FE_node_id parent = (path.empty()) ? FE_NODE_UNKNOWN : path.back();
+    path.push_back(id);
+    size_t depth = path.size();
+
+    if (depth == 1) {
+        const FE_StringRef *stat = findAttribute(attrs, nattrs, "stat");
+        if ((id != FE_NODE_RSP) || !stat || !(*stat == "ok")) {
+            _status = FE_DECODE_NOT_OK;
+            return false;
         }
+        _status = FE_DECODE_OK;
+        return true;
+    }
+    if (depth == 2) {
+        if (!top_level)
+            first_top_level = id;
+        top_level |= (1UL << id);
     }
 
-    return user;
+    if (field_depth) {
+        //Like FE_XMLNode, a node with children has no text.
+        field_nested = true;
+        text.clear();
+        return true;
+    }
+
+    if (location_depth && (depth == location_depth + 1)) {
+        if ((id >= FE_NODE_LABEL) && (id <= FE_NODE_WOEID)) {
+            field_georss = false;
+        } else if ((name.length > 7) && !memcmp(name.data, "georss:", 7)) {
+            field_georss = true;
+        } else {
+            return true;
+        }
+        field_depth = depth;
+        field = id;
+        field_nested = false;
+        field_exact = boolAttribute(attrs, nattrs, "exact-match");
+        text.clear();
+        return true;
+    }
+
+    switch (id) {
+    case FE_NODE_USER:
+        if (!user_depth && ((parent == FE_NODE_RSP) || (parent == FE_NODE_USERS))) {
+            const FE_StringRef *value;
+
+            user_depth = depth;
+            user = FE_user();
+            if ((value = findAttribute(attrs, nattrs, "located-at")))
+                user.last_update_timestamp.assign(value->data, value->length);
+            parseTimestamp(user.last_update_timestamp, user.last_update_ms);
+            user.can_read = boolAttribute(attrs, nattrs, "readable");
+            user.can_write = boolAttribute(attrs, nattrs, "writable");
+            if ((value = findAttribute(attrs, nattrs, "token")))
+                user.token.assign(value->data, value->length);
+        }
+        break;
+    case FE_NODE_LOCATION_HIERARCHY:
+        if (user_depth && (depth == user_depth + 1)) {
+            const FE_StringRef *value;
+
+            if ((value = findAttribute(attrs, nattrs, "string")))
+                user.woeid_hierarchy.assign(value->data, value->length);
+            else
+                user.woeid_hierarchy.clear();
+            FE_parse_woeid_hierarchy(user.woeid_hierarchy.data(), user.woeid_hierarchy.length(),
+                                     user.woeids);
+            if ((value = findAttribute(attrs, nattrs, "timezone")))
+                user.timezone.assign(value->data, value->length);
+            else
+                user.timezone.clear();
+        }
+        break;
+    case FE_NODE_LOCATION:
+        if (location_depth)
+            break;
+        if ((user_depth && (depth == user_depth + 2) && (parent == FE_NODE_LOCATION_HIERARCHY))
+            || (!user_depth && (parent == FE_NODE_LOCATIONS))) {
+            location_depth = depth;
+            location = FE_location();
+            location.best_guess = boolAttribute(attrs, nattrs, "best-guess");
+        }
+        break;
+    default:
+        break;
+    }
+
+    return true;
+}
+
+bool FE_ResponseDecoder::node_text(const FE_StringRef &fragment) {
+    if (field_depth && !field_nested && (path.size() == field_depth))
+        text.append(fragment.data, fragment.length);
+    return true;
+}
+
+//Same conversions as locationFactory.
+void FE_ResponseDecoder::finish_field() {
+    FE_ValueCache number;
+
+    switch (field) {
+    case FE_NODE_LABEL:
+        location.label = text;
+        break;
+    case FE_NODE_LEVEL:
+        location.level = (unsigned long) number.as_long(text, NULL);
+        break;
+    case FE_NODE_LEVEL_NAME:
+        location.level_name = text;
+        break;
+    case FE_NODE_LOCATED_AT:
+        location.timestamp = text;
+        parseTimestamp(location.timestamp, location.timestamp_ms);
+        break;
+    case FE_NODE_NAME:
+        location.full_location = text;
+        break;
+    case FE_NODE_NORMAL_NAME:
+        location.place_name = text;
+        break;
+    case FE_NODE_PLACE_ID:
+        location.place_id = text;
+        location.is_place_id_exact = field_exact;
+        break;
+    case FE_NODE_WOEID:
+        location.woeid = (unsigned long) number.as_long(text, NULL);
+        location.is_woeid_exact = field_exact;
+        break;
+    default:
+        if (field_georss) {
+            FE_VertexArena *polygons = (field == FE_NODE_GEORSS_POLYGON) ? vertex_arena() : NULL;
+            location.geometry.set_from_georss(field, text.data(), text.length(), polygons);
+        }
+        break;
+    }
+}
+
+bool FE_ResponseDecoder::end_node(enum FE_node_id id, const FE_StringRef &name) {
+    size_t depth = path.size();
+    bool keep_going = true;
+
+    try {
+        if (depth == field_depth) {
+            field_depth = 0;
+            finish_field();
+        } else if (depth == location_depth) {
+            location_depth = 0;
+            if (user_depth)
+                user.location.push_back().swap(location);
+            else
+                keep_going = sink.decoded_location(location);
+        } else if (depth == user_depth) {
+            user_depth = 0;
+            keep_going = sink.decoded_user(user);
+        }
+    } catch (FireEagleException *e) {
+        delete _error;
+        _error = e;
+        keep_going = false;
+    }
+
+    path.pop_back();
+    return keep_going;
 }
 
 extern bool FE_isXMLErrorMsg(const FE_ParsedNode *root, const string &msg);
 extern FireEagleException *FE_exceptionFromXML(const FE_ParsedNode *root);
-extern bool FE_isJSONErrorMsg(const FE_ParsedNode *root, const string &msg);
-extern FireEagleException *FE_exceptionFromJSON(const FE_ParsedNode *root);
 
-FE_user FE_user::from_response(const string &resp, enum FE_format format,
-                               FireEagleConfig *config) {
-    if (format == FE_FORMAT_JSON) {
-        throw new FireEagleException("FE_user::from_response is not implemented for JSON",
+//Tree path of FE_decode_response, for responses the event pass could not
+//decode. Same checks as the event pass.
+static void decodeTree(const FE_ParsedNode *root, enum FE_node_id container,
+                       FE_ObjectSink &sink) {
+    unsigned int cursor = 0;
+    const FE_ParsedNode *child;
+
+    switch (container) {
+    case FE_NODE_USER: {
+        if (root->child_count() == 0)
+            throw new FireEagleException("Expected element = user. Got an empty response",
+                                         FE_INTERNAL_ERROR);
+        FE_user user;
+        userFactory(&(root->child(0)), user);
+        sink.decoded_user(user);
+        break;
+    }
+    case FE_NODE_USERS: {
+        const FE_ParsedNode *users = root->next_child(FE_node_name(FE_NODE_USERS), cursor);
+        if (!users)
+            throw new FireEagleException("Unknown XML response format: No users element present",
+                                         FE_INTERNAL_ERROR);
+        cursor = 0;
+        while ((child = users->next_child(FE_node_name(FE_NODE_USER), cursor))) {
+            FE_user user;
+            userFactory(child, user);
+            if (!sink.decoded_user(user))
+                break;
+        }
+        break;
+    }
+    case FE_NODE_LOCATIONS: {
+        const FE_ParsedNode *locations = root->next_child(FE_node_name(FE_NODE_LOCATIONS),
+                                                          cursor);
+        if (!locations)
+            throw new FireEagleException("Unknown XML response format for lookup API: No locations element present",
+                                         FE_INTERNAL_ERROR);
+        cursor = 0;
+        while ((child = locations->next_child(FE_node_name(FE_NODE_LOCATION), cursor))) {
+            FE_location location;
+            locationFactory(child, location);
+            if (!sink.decoded_location(location))
+                break;
+        }
+        break;
+    }
+    default:
+        throw new FireEagleException("FE_decode_response: unsupported container",
+                                     FE_INTERNAL_ERROR);
+    }
+}
+
+void FE_decode_response(const string &resp, enum FE_format format, FireEagleConfig *config,
+                        enum FE_node_id container, FE_ObjectSink &sink) {
+    if (format != FE_FORMAT_XML) {
+        throw new FireEagleException("FE_decode_response is only implemented for XML",
                                      FE_INTERNAL_ERROR, resp);
     }
 
@@ -300,133 +951,141 @@ FE_user FE_user::from_response(const string &resp, enum FE_format format,
     if (!parser_data) {
         ostringstream os;
 
-        os << "Cannot parse response to make a user object.";
+        os << "Cannot parse response to make " << FE_node_name(container) << " objects.";
         os << " No registered handler for requested format.";
         throw new FireEagleException(os.str(), FE_INTERNAL_ERROR, resp);
     }
 
     FE_Parser *parser = parser_data->parser_instance();
+
+    //Almost every response is a success: decode it in a single pass. Only
+    //error responses, unexpected documents and parsers without event support
+    //take the tree path below.
+    FE_ResponseDecoder decoder(sink);
+    enum FE_event_status status = parser->parse_events(resp, decoder);
+    bool expected = (container == FE_NODE_USER) ? (decoder.first_child() == FE_NODE_USER)
+                                                : decoder.saw(container);
+    FireEagleException *error = decoder.take_error();
+    if (error && expected) {
+        delete parser;
+        throw error;
+    }
+    delete error;
+    if (((status == FE_EVENTS_DONE) || (status == FE_EVENTS_STOPPED))
+        && (decoder.status() == FE_ResponseDecoder::FE_DECODE_OK) && expected) {
+        delete parser;
+        return;
+    }
+
     FE_ParsedNode *root = parser->parse(resp);
     if (!root) {
         delete parser;
-        throw FireEagleException("Parse failed for response", FE_INTERNAL_ERROR, resp);
+        throw new FireEagleException("Parse failed for response", FE_INTERNAL_ERROR, resp);
     }
 
     //OK, we parsed. But, is this a valid response?
-    if ((format == FE_FORMAT_XML) && FE_isXMLErrorMsg(root, resp)) {
+    if (FE_isXMLErrorMsg(root, resp)) {
         FireEagleException *e = FE_exceptionFromXML(root);
         delete parser;
         delete root;
         throw e;
-    } else if ((format == FE_FORMAT_JSON) && FE_isJSONErrorMsg(root, resp)) {
-        FireEagleException *e = FE_exceptionFromJSON(root);
-        delete parser;
-        delete root;
-        throw e;
     }
 
     try {
-        FE_user user;
-        if (format == FE_FORMAT_XML) {
-            user = userFactory(&(root->child(0)));
-        } else if (format == FE_FORMAT_JSON) {
-            delete root;
-            delete parser;
-            throw new FireEagleException("FE_user::from_response is not implemented for JSON",
-                                         FE_INTERNAL_ERROR, resp);
-        }
-        delete root;
-        delete parser;
-        return user;
+        decodeTree(root, container, sink);
     } catch(FireEagleException *fex) {
         delete root;
         delete parser;
         throw fex;
-    }    
+    }
+    delete root;
+    delete parser;
 }
 
-list<FE_location> lookupFactory(const FE_ParsedNode *root) {//Do not free root!
-    list<FE_location> locations;
+//Keeps the first user of a response.
+class FirstUserSink : public FE_ObjectSink {
+  private:
+    FE_user &user;
+    bool found;
 
-    if (root->name() != "locations") {
-        string message("Expected element = locations. Got: ");
-        message.append(root->name());
-        throw new FireEagleException(message, FE_INTERNAL_ERROR);
+  public:
+    FirstUserSink(FE_user &_user) : user(_user), found(false) {}
+
+    bool decoded_user(FE_user &decoded) {
+        if (!found) {
+            user.swap(decoded);
+            found = true;
+        }
+        return true;
     }
+};
 
-    int nchildren = root->child_count();
-    for (int i = 0 ; i < nchildren ; i++)
-        locations.push_back(locationFactory(&(root->child(i))));
+//Collects the users of a within or recent response.
+class UserListSink : public FE_ObjectSink {
+  private:
+    list<FE_user> &users;
 
-    return locations;
-}
+  public:
+    UserListSink(list<FE_user> &_users) : users(_users) {}
 
-list<FE_location> FE_location::from_response(const string &resp,
-                                             enum FE_format format, 
-                                             FireEagleConfig *config) {
-    if (format == FE_FORMAT_JSON) {
-        throw new FireEagleException("FE_location::from_response is not implemented for JSON",
-                                     FE_INTERNAL_ERROR, resp);
+    bool decoded_user(FE_user &decoded) {
+        users.push_back(FE_user());
+        users.back().swap(decoded);
+        return true;
     }
+};
 
-    ParserData *parser_data = config->get_parser(format);
-    if (!parser_data) {
-        ostringstream os;
+//Collects the locations of a lookup response.
+class LocationListSink : public FE_ObjectSink {
+  private:
+    list<FE_location> &locations;
 
-        os << "Cannot parse response to make location objects.";
-        os << " No registered handler for requested format";
-        throw new FireEagleException(os.str(), FE_INTERNAL_ERROR, resp);
-    }
+  public:
+    LocationListSink(list<FE_location> &_locations) : locations(_locations) {}
 
-    FE_Parser *parser = parser_data->parser_instance();
-    FE_ParsedNode *root = parser->parse(resp);
-    if (!root) {
-        delete parser;
-        throw FireEagleException("Parse failed for response", FE_INTERNAL_ERROR, resp);
+    bool decoded_location(FE_location &decoded) {
+        locations.push_back(FE_location());
+        locations.back().swap(decoded);
+        return true;
     }
+};
 
-    //OK, we parsed. But, is this a valid response?
-    if ((format == FE_FORMAT_XML) && FE_isXMLErrorMsg(root, resp)) {
-        FireEagleException *e = FE_exceptionFromXML(root);
-        delete parser;
-        delete root;
-        throw e;
-    } else if ((format == FE_FORMAT_JSON) && FE_isJSONErrorMsg(root, resp)) {
-        FireEagleException *e = FE_exceptionFromJSON(root);
-        delete parser;
-        delete root;
-        throw e;
+FE_user FE_user::from_response(const string &resp, enum FE_format format,
+                               FireEagleConfig *config) {
+    if (format == FE_FORMAT_JSON) {
+        throw new FireEagleException("FE_user::from_response is not implemented for JSON",
+                                     FE_INTERNAL_ERROR, resp);
     }
 
+    FE_user user;
+    FirstUserSink sink(user);
+    FE_decode_response(resp, format, config, FE_NODE_USER, sink);
+    return user;
+}
 
-    bool found = false;
-    for (int i = 0 ; i < root->child_count() ; i++) {
-        if (root->child(i).name() != "locations")
-            continue;
-        found = true;
-        try {
-            if (format == FE_FORMAT_XML) {
-                list<FE_location> locations = lookupFactory(&(root->child(i)));
-                delete root;
-                delete parser;
-                return locations;
-            } else if (format == FE_FORMAT_JSON) {
-                delete root;
-                delete parser;
-                throw new FireEagleException("FE_user::from_response is not implemented for JSON",
-                                             FE_INTERNAL_ERROR, resp);
-            }
-        } catch(FireEagleException *fex) {
-            delete root;
-            delete parser;
-            throw fex;
-        }
+list<FE_user> FE_user::list_from_response(const string &resp, enum FE_format format,
+                                          FireEagleConfig *config) {
+    if (format == FE_FORMAT_JSON) {
+        throw new FireEagleException("FE_user::list_from_response is not implemented for JSON",
+                                     FE_INTERNAL_ERROR, resp);
     }
 
-    delete root;
-    delete parser;
-    if (!found)
-        throw new FireEagleException("Unknown XML response format for lookup API: No locations element present",
-                                     FE_INTERNAL_ERROR, resp);
+    list<FE_user> users;
+    UserListSink sink(users);
+    FE_decode_response(resp, format, config, FE_NODE_USERS, sink);
+    return users;
 }
 
+list<FE_location> FE_location::from_response(const string &resp,
+                                             enum FE_format format, 
+                                             FireEagleConfig *config) {
+    if (format == FE_FORMAT_JSON) {
+        throw new FireEagleException("FE_location::from_response is not implemented for JSON",
+                                     FE_INTERNAL_ERROR, resp);
+    }
+
+    list<FE_location> locations;
+    LocationListSink sink(locations);
+    FE_decode_response(resp, format, config, FE_NODE_LOCATIONS, sink);
+    return locations;
+}
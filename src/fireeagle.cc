@@ -19,6 +19,9 @@ extern "C" {
 
 #include "fireeagle.h"
 #include "fire_objects.h"
+#include "fe_cache.h"
+#include "fe_singleflight.h"
+#include "fe_geocache.h"
 //#include "fire_parser.h"
 
 using namespace std;
@@ -135,6 +138,12 @@ void FireEagleConfig::common_init() {
     this->FE_DUMP_REQUESTS = false;
     this->FE_OAUTH_VERSION = OAUTH_10A;
     this->FE_USE_OAUTH_HEADER = false;
+    this->FE_COALESCE_REQUESTS = false;
+    for (int i = 0 ; i <= FE_FORMAT_HTML ; i++)
+        format_parsers[i] = NULL;
+    this->lookup_cache = NULL;
+    this->geo_cache = NULL;
+    this->single_flight = new FE_SingleFlight();
 }
 
 FireEagleConfig::FireEagleConfig(const OAuthTokenPair &_app_token)
@@ -260,6 +269,9 @@ FireEagleConfig::~FireEagleConfig() {
         if (iter->second)
             delete iter->second;
     }
+    delete lookup_cache;
+    delete geo_cache;
+    delete single_flight;
 }
 
 static void write_config(FILE *fp, const string &name, const string &value) {
@@ -314,10 +326,26 @@ ParserData *FireEagleConfig::register_parser(const string &content_type,
         old = iter->second;
 
     parsers[content_type] = parser;
+    update_format_parsers();
 
     return old;
 }
 
+void FireEagleConfig::update_format_parsers() {
+    for (int i = 0 ; i <= FE_FORMAT_HTML ; i++)
+        format_parsers[i] = NULL;
+
+    //First in map order wins, as it always did.
+    for (map<string,ParserData *>::iterator iter = parsers.begin() ;
+         iter != parsers.end() ; iter++) {
+        if (!iter->second)
+            continue;
+        enum FE_format format = iter->second->lang();
+        if ((format >= 0) && (format <= FE_FORMAT_HTML) && !format_parsers[format])
+            format_parsers[format] = iter->second;
+    }
+}
+
 ParserData *FireEagleConfig::get_parser(const string &content_type) {
     map<string,ParserData *>::iterator iter = parsers.find(content_type);
 
@@ -328,13 +356,34 @@ ParserData *FireEagleConfig::get_parser(const string &content_type) {
 }
 
 ParserData *FireEagleConfig::get_parser(enum FE_format format) {
-    for (map<string,ParserData *>::iterator iter = parsers.begin() ;
-         iter != parsers.end() ; iter++) {
-        if (iter->second->lang() == format)
-            return iter->second;
-    }
+    if ((format < 0) || (format > FE_FORMAT_HTML))
+        return NULL;
 
-    return NULL;
+    return format_parsers[format];
+}
+
+FE_ResponseCache *FireEagleConfig::set_lookup_cache(FE_ResponseCache *cache) {
+    FE_ResponseCache *old = lookup_cache;
+    lookup_cache = cache;
+    return old;
+}
+
+FE_ResponseCache *FireEagleConfig::get_lookup_cache() const {
+    return lookup_cache;
+}
+
+FE_GeoCache *FireEagleConfig::set_geo_cache(FE_GeoCache *cache) {
+    FE_GeoCache *old = geo_cache;
+    geo_cache = cache;
+    return old;
+}
+
+FE_GeoCache *FireEagleConfig::get_geo_cache() const {
+    return geo_cache;
+}
+
+FE_SingleFlight *FireEagleConfig::get_single_flight() const {
+    return single_flight;
 }
 
 const OAuthTokenPair *FireEagleConfig::get_consumer_key() const { return &app_token; }
@@ -377,8 +426,7 @@ bool FE_isXMLErrorMsg(const FE_ParsedNode *root, const string &msg) {
     if (root->get_string_property("stat") == "ok")
         return false;
 
-    list<const FE_ParsedNode *> children = root->get_children("err");
-    if (children.size() != 1) {
+    if (root->count_children(FE_node_name(FE_NODE_ERR)) != 1) {
         delete root;
         throw new FireEagleException("Unknown XML response format from Fire Eagle",
                                      FE_INTERNAL_ERROR, msg);
@@ -396,8 +444,8 @@ FireEagleException *FE_exceptionFromXML(const FE_ParsedNode *root) {
     //Ideally this is not the guy who is being forced to throw any exception
     //It is just a factory method.
     string message("Remote error: ");
-    list<const FE_ParsedNode *> children = root->get_children("err");
-    const FE_ParsedNode *err = *(children.begin());
+    unsigned int cursor = 0;
+    const FE_ParsedNode *err = root->next_child(FE_node_name(FE_NODE_ERR), cursor);
     message.append(err->get_string_property("msg"));
     long code = err->get_long_property("code");
     FireEagleException *e = new FireEagleException(message, code);
@@ -833,10 +881,48 @@ OAuthTokenPair FireEagle::access_token(string oauth_verifier) {
     return getAccessToken(oauth_verifier);
 }
 
+//Key of a call for FE_SingleFlight. Calls signed with the token of a user
+//only match calls for the same user.
+static string flight_key(const string &method, enum FE_oauth_token token_type,
+                         const OAuthTokenPair *token, const FE_ParamPairs &args,
+                         enum FE_format format) {
+    ostringstream os;
+    os << method << '.' << FE_format_info[format].extension << ' ' << token_type;
+    if (((token_type == FE_TOKEN_ACCESS) || (token_type == FE_TOKEN_REQUEST)) && token)
+        os << ' ' << token->token.length() << ':' << token->token;
+    for (FE_ParamPairs::const_iterator iter = args.begin() ; iter != args.end() ; iter++) {
+        os << ' ' << iter->first.length() << ':' << iter->first;
+        os << ' ' << iter->second.length() << ':' << iter->second;
+    }
+    return os.str();
+}
+
 string FireEagle::call(const string &method, enum FE_oauth_token token_type,
                        const FE_ParamPairs &args, bool isPost,
                        enum FE_format format) const {
-    return oAuthRequest(methodURL(method, format), token_type, args, isPost);
+    if (isPost || !config->FE_COALESCE_REQUESTS)
+        return oAuthRequest(methodURL(method, format), token_type, args, isPost);
+
+    FE_SingleFlight *group = config->get_single_flight();
+    bool leader;
+    FE_SingleFlight::Flight *flight = group->join(flight_key(method, token_type, token,
+                                                             args, format), leader);
+    if (!leader)
+        return group->wait(flight);
+
+    string response;
+    try {
+        response = oAuthRequest(methodURL(method, format), token_type, args, isPost);
+    } catch (FireEagleException *e) {
+        group->fail(flight, e);
+        throw;
+    } catch (...) {
+        FireEagleException e("FireEagle::call: shared request failed", FE_INTERNAL_ERROR);
+        group->fail(flight, &e);
+        throw;
+    }
+    group->done(flight, response);
+    return response;
 }
 
 string FireEagle::user(enum FE_format format) const {
@@ -851,10 +937,47 @@ string FireEagle::update(const FE_ParamPairs &args, enum FE_format format) const
 }
 
 string FireEagle::lookup(const FE_ParamPairs &args, enum FE_format format) const {
+    return lookup_response(args, format, NULL);
+}
+
+string FireEagle::lookup_response(const FE_ParamPairs &args, enum FE_format format,
+                                  list<FE_location> *locations) const {
     if (args.size() == 0)
         throw new FireEagleException("FireEagle::lookup() needs a location",
                                      FE_LOCATION_REQUIRED);
-    return call("lookup", FE_TOKEN_ACCESS, args, false, format);
+
+    string response;
+    //Only XML responses can be decoded to find the area they answer for.
+    FE_GeoCache *geo = (format == FE_FORMAT_XML) ? config->get_geo_cache() : NULL;
+    double lat, lon;
+    if (geo && !FE_GeoCache::parse_query(args, lat, lon))
+        geo = NULL;
+    bool cached = geo && geo->get(lat, lon, format, response);
+
+    FE_ResponseCache *cache = config->get_lookup_cache();
+    string key;
+    if (!cached && cache) {
+        key = FE_ResponseCache::make_key("lookup", args, format);
+        cached = cache->get(key, response);
+    }
+
+    if (!cached) {
+        response = call("lookup", FE_TOKEN_ACCESS, args, false, format);
+        if (cache)
+            cache->put(key, response);
+    }
+    //The caller wants every location anyway: decode them once, and on a
+    //miss hand them to the geo cache.
+    if (locations)
+        *locations = FE_location::from_response(response, format, config);
+    if (geo && !cached) {
+        //The level and area of the answer decide which points it can serve.
+        if (locations)
+            geo->put(lat, lon, format, response, *locations);
+        else
+            geo->put(lat, lon, format, response, config);
+    }
+    return response;
 }
 
 string FireEagle::within(const FE_ParamPairs &args, enum FE_format format) const {
@@ -869,6 +992,24 @@ string FireEagle::recent(const FE_ParamPairs &args, enum FE_format format) const
     return call("recent", FE_TOKEN_GENERAL, args, false, format);
 }
 
+FE_user FireEagle::user_object() const {
+    return FE_user::from_response(user(FE_FORMAT_XML), FE_FORMAT_XML, config);
+}
+
+list<FE_location> FireEagle::lookup_locations(const FE_ParamPairs &args) const {
+    list<FE_location> locations;
+    lookup_response(args, FE_FORMAT_XML, &locations);
+    return locations;
+}
+
+list<FE_user> FireEagle::within_users(const FE_ParamPairs &args) const {
+    return FE_user::list_from_response(within(args, FE_FORMAT_XML), FE_FORMAT_XML, config);
+}
+
+list<FE_user> FireEagle::recent_users(const FE_ParamPairs &args) const {
+    return FE_user::list_from_response(recent(args, FE_FORMAT_XML), FE_FORMAT_XML, config);
+}
+
 static FE_format_info_t format_info[] = {
     { "xml" },
     { "json" },
@@ -5,13 +5,20 @@
  *
  */
 #include <iostream>
+#include <sstream>
 #include <string.h>
 
 #include <stdlib.h>
+#include <math.h>
 #include <assert.h>
+#include <sys/time.h>
 #include "fireeagle.h"
 #include "fire_objects.h"
 #include "expat_parser.h"
+#include "fast_xml_parser.h"
+#include "fe_batch.h"
+#include "fe_geo.h"
+#include "fe_json.h"
 
 #include <curl/curl.h>
 
@@ -114,6 +121,11 @@ void usage() {
     cout << "\t--update Needs an access token <name>=<value> [<name>=<value>,[...]]" << endl;
     cout << "\t--within Needs a general token <name>=<value> [<name>=<value>,[...]]" << endl;
     cout << "\t--recent Needs a general token <name>=<value> [<name>=<value>,[...]]" << endl;
+    cout << "\nBenchmarks: No tokens needed. Sample responses are in test/responses" << endl;
+    cout << "\t--bench-parse files=<file>[,<file>[...]] [iterations=<count>] Compare FE_XMLParser and FE_FastXMLParser" << endl;
+    cout << "\t--bench-geo [count=<locations>] [neighbors=<locations>] [iterations=<count>] Compare the fe_geo.h kernels with loops over FE_location" << endl;
+    cout << "\t--bench-json file=<users response> [iterations=<count>] Compare FE_JsonWriter with FE_user::print" << endl;
+    cout << "\t--check-json file=<users response> Check the names FE_JsonWriter writes against the XML" << endl;
 }
 
 OAuthTokenPair request_token(FireEagle &fe, const FE_ParamPairs &args) {
@@ -205,6 +217,273 @@ string recent(FireEagle &fe, const FE_ParamPairs &args, enum FE_format format) {
     return response;
 }
 
+static double now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + (tv.tv_usec / 1000000.0);
+}
+
+static bool read_file(const string &file, string &data) {
+    FILE *fp = fopen(file.c_str(), "r");
+    if (!fp)
+        return false;
+
+    char buffer[4096];
+    size_t n;
+    data.clear();
+    while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+        data.append(buffer, n);
+    fclose(fp);
+
+    return true;
+}
+
+static list<string> split_list(const string &str) {
+    list<string> items;
+    size_t begin = 0;
+    while (begin <= str.length()) {
+        size_t end = str.find(',', begin);
+        if (end == string::npos)
+            end = str.length();
+        if (end > begin)
+            items.push_back(str.substr(begin, end - begin));
+        begin = end + 1;
+    }
+    return items;
+}
+
+//Both parsers build FE_XMLNode trees. They better be the same.
+static bool same_tree(const FE_XMLNode &a, const FE_XMLNode &b) {
+    if ((a.name() != b.name()) || (a.text() != b.text())
+        || (a.attributes() != b.attributes())
+        || (a.child_count() != b.child_count()))
+        return false;
+
+    for (unsigned int i = 0 ; i < a.child_count() ; i++) {
+        if (!same_tree((const FE_XMLNode &)a.child(i), (const FE_XMLNode &)b.child(i)))
+            return false;
+    }
+    return true;
+}
+
+//Does nothing with the events. Measures the tokenizer alone.
+class CountingEvents : public FE_ParseEvents {
+  public:
+    unsigned long count;
+
+    CountingEvents() : count(0) {}
+    void reset() { count = 0; }
+    bool start_node(enum FE_node_id id, const FE_StringRef &name,
+                    const FE_EventAttribute *attrs, unsigned int nattrs) {
+        count++;
+        return true;
+    }
+    bool node_text(const FE_StringRef &text) { count++; return true; }
+    bool end_node(enum FE_node_id id, const FE_StringRef &name) { count++; return true; }
+};
+
+static void report(const char *what, double seconds, size_t bytes, long iterations) {
+    double mbps = (bytes * (double)iterations) / (seconds * 1024 * 1024);
+    cout << "\t" << what << ": " << (seconds * 1000000 / iterations) << " us/doc, "
+         << mbps << " MB/s" << endl;
+}
+
+int bench_parse(const FE_ParamPairs &args) {
+    FE_ParamPairs::const_iterator iter = args.find("files");
+    if (iter == args.end()) {
+        cerr << "--bench-parse needs files=<file>[,<file>...]" << endl;
+        return 1;
+    }
+    list<string> files = split_list(iter->second);
+
+    long iterations = 1000;
+    iter = args.find("iterations");
+    if (iter != args.end())
+        iterations = strtol(iter->second.c_str(), NULL, 10);
+    if (iterations <= 0)
+        iterations = 1;
+
+    for (list<string>::iterator file = files.begin() ; file != files.end() ; file++) {
+        string doc;
+        if (!read_file(*file, doc)) {
+            cerr << "Could not read " << *file << endl;
+            return 1;
+        }
+
+        FE_XMLParser check_expat;
+        FE_FastXMLParser check_fast;
+        FE_XMLNode *expat_root = (FE_XMLNode *)check_expat.parse(doc);
+        FE_XMLNode *fast_root = (FE_XMLNode *)check_fast.parse(doc);
+        bool same = (expat_root && fast_root) ? same_tree(*expat_root, *fast_root)
+                                              : (expat_root == fast_root);
+        delete expat_root;
+        delete fast_root;
+
+        cout << *file << " (" << doc.length() << " bytes, " << iterations
+             << " iterations). Trees " << ((same) ? "match" : "DIFFER") << endl;
+
+        double start = now();
+        for (long i = 0 ; i < iterations ; i++) {
+            FE_XMLParser parser;
+            delete parser.parse(doc);
+        }
+        report("FE_XMLParser tree", now() - start, doc.length(), iterations);
+
+        start = now();
+        FE_FastXMLParser fast;
+        for (long i = 0 ; i < iterations ; i++)
+            delete fast.parse(doc);
+        report("FE_FastXMLParser tree", now() - start, doc.length(), iterations);
+
+        CountingEvents events;
+        start = now();
+        for (long i = 0 ; i < iterations ; i++) {
+            FE_XMLParser parser;
+            parser.parse_events(doc, events);
+        }
+        report("FE_XMLParser events", now() - start, doc.length(), iterations);
+
+        start = now();
+        for (long i = 0 ; i < iterations ; i++)
+            fast.parse_events(doc, events);
+        report("FE_FastXMLParser events", now() - start, doc.length(), iterations);
+    }
+
+    return 0;
+}
+
+static long long_arg(const FE_ParamPairs &args, const char *name, long value) {
+    FE_ParamPairs::const_iterator iter = args.find(name);
+    if (iter != args.end())
+        value = strtol(iter->second.c_str(), NULL, 10);
+    return (value > 0) ? value : 1;
+}
+
+static void report_geo(const char *what, double seconds, long items, long iterations,
+                       const char *unit = "location") {
+    cout << "\t" << what << ": " << (seconds * 1000000000 / ((double)items * iterations))
+         << " ns/" << unit << endl;
+}
+
+int bench_geo(const FE_ParamPairs &args) {
+    long count = long_arg(args, "count", 100000);
+    long neighbors = long_arg(args, "neighbors", 2000);
+    long iterations = long_arg(args, "iterations", 20);
+
+    //Points and city sized boxes spread over the globe, as FE_location
+    //objects and as batch columns.
+    srand(42);
+    list<FE_location> objects;
+    FE_LocationBatch batch;
+    batch.reserve(count);
+    for (long i = 0 ; i < count ; i++) {
+        FE_location location;
+        double lat = (rand() / (double)RAND_MAX) * 170 - 85;
+        double lon = (rand() / (double)RAND_MAX) * 360 - 180;
+        if (i % 2)
+            location.geometry.set_point(lat, lon);
+        else
+            location.geometry.set_box(lat - 0.1, lon - 0.1, lat + 0.1, lon + 0.1);
+        objects.push_back(location);
+        batch.append(location);
+    }
+    FE_UnitVectors vectors(&batch.latitude[0], &batch.longitude[0], count);
+    vector<double> meters(count);
+    vector<unsigned char> inside(count);
+    cout << count << " locations, " << iterations << " iterations" << endl;
+
+    double lat = 37.77, lon = -122.42;
+    double last_distance = 0;
+    double start = now();
+    for (long it = 0 ; it < iterations ; it++) {
+        long i = 0;
+        for (list<FE_location>::iterator iter = objects.begin() ; iter != objects.end() ; iter++)
+            meters[i++] = FE_haversine(lat, lon, iter->geometry.latitude, iter->geometry.longitude);
+    }
+    report_geo("distance, FE_haversine per FE_location", now() - start, count, iterations);
+    last_distance = meters[count - 1];
+
+    start = now();
+    for (long it = 0 ; it < iterations ; it++)
+        FE_geo_distances(lat, lon, vectors, &meters[0]);
+    report_geo("distance, FE_geo_distances", now() - start, count, iterations);
+    cout << "\t\tlast distance " << last_distance << " / " << meters[count - 1] << " m" << endl;
+
+    size_t found = 0;
+    start = now();
+    for (long it = 0 ; it < iterations ; it++) {
+        found = 0;
+        for (list<FE_location>::iterator iter = objects.begin() ; iter != objects.end() ; iter++) {
+            const FE_geometry &g = iter->geometry;
+            if ((g.latitude >= 10) && (g.latitude <= 50) && (g.longitude >= -20)
+                && (g.longitude <= 40))
+                found++;
+        }
+    }
+    report_geo("point in box, per FE_location", now() - start, count, iterations);
+    size_t found_kernel = 0;
+    start = now();
+    for (long it = 0 ; it < iterations ; it++)
+        found_kernel = FE_geo_points_in_box(&batch.latitude[0], &batch.longitude[0], count,
+                                            10, -20, 50, 40, &inside[0]);
+    report_geo("point in box, FE_geo_points_in_box", now() - start, count, iterations);
+    cout << "\t\tinside " << found << " / " << found_kernel << endl;
+
+    found = 0;
+    start = now();
+    for (long it = 0 ; it < iterations ; it++) {
+        found = 0;
+        for (list<FE_location>::iterator iter = objects.begin() ; iter != objects.end() ; iter++) {
+            const FE_geometry &g = iter->geometry;
+            if ((g.min_lat <= lat) && (g.max_lat >= lat) && (g.min_lon <= lon)
+                && (g.max_lon >= lon))
+                found++;
+        }
+    }
+    report_geo("box contains point, per FE_location", now() - start, count, iterations);
+    start = now();
+    for (long it = 0 ; it < iterations ; it++)
+        found_kernel = FE_geo_boxes_containing(&batch.min_lat[0], &batch.min_lon[0],
+                                               &batch.max_lat[0], &batch.max_lon[0], count,
+                                               lat, lon, &inside[0]);
+    report_geo("box contains point, FE_geo_boxes_containing", now() - start, count,
+               iterations);
+    cout << "\t\tcontaining " << found << " / " << found_kernel << endl;
+
+    //Nearest neighbors are quadratic: use the first few locations only.
+    if (neighbors > count)
+        neighbors = count;
+    vector<FE_location> some(objects.begin(), objects.end());
+    some.resize(neighbors);
+    vector<unsigned int> nearest(neighbors);
+    unsigned int last_nearest = 0;
+    start = now();
+    for (long i = 0 ; i < neighbors ; i++) {
+        double best = HUGE_VAL;
+        for (long j = 0 ; j < neighbors ; j++) {
+            if (i == j)
+                continue;
+            double d = FE_haversine(some[i].geometry.latitude, some[i].geometry.longitude,
+                                    some[j].geometry.latitude, some[j].geometry.longitude);
+            if (d < best) {
+                best = d;
+                nearest[i] = j;
+            }
+        }
+    }
+    report_geo("nearest neighbors, FE_haversine per pair", now() - start,
+               neighbors * neighbors, 1, "pair");
+    last_nearest = nearest[neighbors - 1];
+    FE_UnitVectors few(&batch.latitude[0], &batch.longitude[0], neighbors);
+    start = now();
+    FE_geo_nearest(few, few, &nearest[0], NULL);
+    report_geo("nearest neighbors, FE_geo_nearest", now() - start, neighbors * neighbors, 1,
+               "pair");
+    cout << "\t\tlast neighbor " << last_nearest << " / " << nearest[neighbors - 1] << endl;
+
+    return 0;
+}
+
 FE_ParamPairs get_args(int idx, int argc, char *argv[]) {
     //Parse the arguments...
     FE_ParamPairs args;
@@ -244,6 +523,156 @@ class XMLParserData : public ParserData {
     virtual FE_Parser *parser_instance() const { return new FE_XMLParser; }
 };
 
+int bench_json(const FE_ParamPairs &args) {
+    FE_ParamPairs::const_iterator iter = args.find("file");
+    string doc;
+    if (iter == args.end() || !read_file(iter->second, doc)) {
+        cerr << "--bench-json needs file=<file> with a list of users, such as recent.xml" << endl;
+        return 1;
+    }
+    long iterations = long_arg(args, "iterations", 200);
+
+    FireEagleConfig config(OAuthTokenPair("bench", "bench"));
+    config.register_parser("application/xml", new XMLParserData);
+    list<FE_user> users = FE_user::list_from_response(doc, FE_FORMAT_XML, &config);
+    long count = users.size();
+    if (!count) {
+        cerr << "No users in " << iter->second << endl;
+        return 1;
+    }
+    cout << count << " users, " << iterations << " iterations" << endl;
+
+    //Flush both outputs every megabyte, as a pipeline would.
+    ostringstream os;
+    size_t print_bytes = 0;
+    double start = now();
+    for (long it = 0 ; it < iterations ; it++) {
+        for (list<FE_user>::iterator user = users.begin() ; user != users.end() ; user++)
+            user->print(os);
+        if (os.tellp() > (1 << 20)) {
+            print_bytes += os.tellp();
+            os.str("");
+        }
+    }
+    print_bytes += os.tellp();
+    report_geo("FE_user::print", now() - start, count, iterations, "user");
+
+    FE_JsonWriter json;
+    size_t json_bytes = 0;
+    start = now();
+    for (long it = 0 ; it < iterations ; it++) {
+        for (list<FE_user>::iterator user = users.begin() ; user != users.end() ; user++)
+            json.write(*user);
+        if (json.size() > (1 << 20)) {
+            json_bytes += json.size();
+            json.clear();
+        }
+    }
+    json_bytes += json.size();
+    report_geo("FE_JsonWriter, JSON lines", now() - start, count, iterations, "user");
+    cout << "\t\tbytes/user " << print_bytes / ((double)count * iterations) << " / "
+         << json_bytes / ((double)count * iterations) << endl;
+
+    return 0;
+}
+
+//Text of the first <tag> element between from and to, with the entities of
+//XML expanded. Empty if there is none.
+static string xml_element(const string &doc, size_t from, size_t to, const string &tag) {
+    string open = "<" + tag + ">";
+    size_t start = doc.find(open, from);
+    if ((start == string::npos) || (start >= to))
+        return "";
+    start += open.size();
+    size_t end = doc.find("</" + tag + ">", start);
+    if ((end == string::npos) || (end > to))
+        return "";
+    string text;
+    for (size_t i = start ; i < end ; i++) {
+        if (doc[i] != '&') {
+            text += doc[i];
+            continue;
+        }
+        static const char *entities[][2] = {
+            { "&amp;", "&" }, { "&lt;", "<" }, { "&gt;", ">" }, { "&quot;", "\"" },
+            { "&apos;", "'" }
+        };
+        for (int e = 0 ; e < 5 ; e++) {
+            if (doc.compare(i, strlen(entities[e][0]), entities[e][0]) == 0) {
+                text += entities[e][1];
+                i += strlen(entities[e][0]) - 1;
+                break;
+            }
+        }
+    }
+    return text;
+}
+
+//A member of a JSON object as FE_JsonWriter writes it, for text with no
+//control characters.
+static string json_member(const string &key, const string &text) {
+    string member = "\"" + key + "\":\"";
+    for (size_t i = 0 ; i < text.size() ; i++) {
+        if ((text[i] == '"') || (text[i] == '\\'))
+            member += '\\';
+        member += text[i];
+    }
+    return member + "\"";
+}
+
+//Decode a users response, write its locations as JSON and check each name
+//against the element of the XML it comes from.
+int check_json(const FE_ParamPairs &args) {
+    FE_ParamPairs::const_iterator iter = args.find("file");
+    string doc;
+    if (iter == args.end() || !read_file(iter->second, doc)) {
+        cerr << "--check-json needs file=<file> with users, such as user.xml" << endl;
+        return 1;
+    }
+
+    FireEagleConfig config(OAuthTokenPair("check", "check"));
+    config.register_parser("application/xml", new XMLParserData);
+    list<FE_user> users;
+    if (doc.find("<users") != string::npos) {
+        users = FE_user::list_from_response(doc, FE_FORMAT_XML, &config);
+    } else {
+        users.push_back(FE_user::from_response(doc, FE_FORMAT_XML, &config));
+    }
+
+    //The locations of the XML, in document order, as the users hold them.
+    size_t position = 0;
+    long checked = 0, failed = 0;
+    FE_JsonWriter json;
+    for (list<FE_user>::iterator user = users.begin() ; user != users.end() ; user++) {
+        for (FE_LocationLevels::const_iterator location = user->location.begin() ;
+             location != user->location.end() ; location++) {
+            size_t start = doc.find("<location ", position);
+            size_t end = (start == string::npos) ? string::npos
+                : doc.find("</location>", start);
+            if (end == string::npos) {
+                cerr << "More locations decoded than in the XML" << endl;
+                return 1;
+            }
+            position = end;
+
+            json.clear();
+            json.write(*location);
+            string record(json.data(), json.size());
+            const char *keys[][2] = { { "name", "name" }, { "normal_name", "normal-name" } };
+            for (int k = 0 ; k < 2 ; k++) {
+                string expected = json_member(keys[k][0], xml_element(doc, start, end, keys[k][1]));
+                if (record.find(expected) == string::npos) {
+                    cerr << "Expected " << expected << " in " << record;
+                    failed++;
+                }
+            }
+            checked++;
+        }
+    }
+    cout << checked << " locations, " << failed << " mismatches" << endl;
+    return (checked && !failed) ? 0 : 1;
+}
+
 int main(int argc, char *argv[]) {
     if (argc == 1) {
         usage();
@@ -382,6 +811,18 @@ int main(int argc, char *argv[]) {
         return 0;
     }
 
+    //Have a common place where all the args for the command can be extracted.
+    FE_ParamPairs args = get_args(idx, argc, argv);
+
+    if (strcmp(argv[idx], "--bench-parse") == 0)
+        return bench_parse(args);
+    if (strcmp(argv[idx], "--bench-geo") == 0)
+        return bench_geo(args);
+    if (strcmp(argv[idx], "--bench-json") == 0)
+        return bench_json(args);
+    if (strcmp(argv[idx], "--check-json") == 0)
+        return check_json(args);
+
     if (fe_conf.length() > 0) {
         fe_config = new FireEagleConfig(fe_conf);
     } else {
@@ -423,9 +864,6 @@ int main(int argc, char *argv[]) {
         return 0;
     }
 
-    //Have a common place where all the args for the command can be extracted.
-    FE_ParamPairs args = get_args(idx, argc, argv);
-
     try {
         if (strcmp(argv[idx], "--get_request_tok") == 0) {
             MyFireEagle fe(fe_config);